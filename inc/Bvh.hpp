@@ -0,0 +1,146 @@
+#ifndef __BVH_HPP
+#define __BVH_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// Small vector type for the collision code, which like the particle engine
+// does not depend on glm
+struct Vec3
+{
+        Vec3() : x(0.f), y(0.f), z(0.f) { }
+        Vec3(float a, float b, float c) : x(a), y(b), z(c) { }
+
+        float operator[](int i) const { return i == 0 ? x : i == 1 ? y : z; }
+        float& operator[](int i) { return i == 0 ? x : i == 1 ? y : z; }
+
+        float x, y, z;
+};
+
+inline Vec3 operator+(Vec3 const& a, Vec3 const& b) { return Vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vec3 operator-(Vec3 const& a, Vec3 const& b) { return Vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vec3 operator-(Vec3 const& a) { return Vec3(-a.x, -a.y, -a.z); }
+inline Vec3 operator*(Vec3 const& a, float s) { return Vec3(a.x * s, a.y * s, a.z * s); }
+inline Vec3 operator*(float s, Vec3 const& a) { return a * s; }
+
+inline bool operator==(Vec3 const& a, Vec3 const& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+inline bool operator!=(Vec3 const& a, Vec3 const& b) { return !(a == b); }
+
+inline float dot(Vec3 const& a, Vec3 const& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(Vec3 const& a, Vec3 const& b)
+{
+        return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+inline float length(Vec3 const& a) { return std::sqrt(dot(a, a)); }
+inline Vec3 lerp(Vec3 const& a, Vec3 const& b, float t) { return a + (b - a) * t; }
+
+// Axis aligned box, empty until something is added
+struct Box
+{
+        Box() :
+                lo(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                                std::numeric_limits<float>::max()),
+                hi(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+                                -std::numeric_limits<float>::max())
+        { }
+
+        void add(Vec3 const& p)
+        {
+                for(int a = 0; a < 3; ++a)
+                {
+                        lo[a] = std::fmin(lo[a], p[a]);
+                        hi[a] = std::fmax(hi[a], p[a]);
+                }
+        }
+
+        void add(Box const& b)
+        {
+                add(b.lo);
+                add(b.hi);
+        }
+
+        void inflate(float d)
+        {
+                lo = lo - Vec3(d, d, d);
+                hi = hi + Vec3(d, d, d);
+        }
+
+        bool overlaps(Box const& b) const
+        {
+                return lo.x <= b.hi.x && b.lo.x <= hi.x &&
+                        lo.y <= b.hi.y && b.lo.y <= hi.y &&
+                        lo.z <= b.hi.z && b.lo.z <= hi.z;
+        }
+
+        Vec3 lo, hi;
+};
+
+// Bounding volume hierarchy over a triangle mesh. The tree is built once
+// from the triangles; when the vertices move only the boxes are refitted,
+// bottom up, which is linear in the mesh size and keeps the topology. A
+// refitted tree gets looser if the mesh deforms a lot, but for animated
+// and rigid meshes it stays as tight as a rebuilt one.
+class TriangleBvh
+{
+        public:
+                // Three vertex indices per triangle
+                void build(std::vector<Vec3> const& vertices,
+                                std::vector<unsigned int> const& triangles);
+
+                // Every box bounds its triangles at both sets of positions,
+                // and so everything they sweep over in a step
+                void refit(std::vector<Vec3> const& previous, std::vector<Vec3> const& current);
+
+                // Calls visit(triangle) for the triangles in every leaf
+                // whose box overlaps the query box
+                template <typename F>
+                void query(Box const& box, F visit) const
+                {
+                        if(mNodes.empty()) return;
+                        unsigned int stack[64];
+                        int top = 0;
+                        stack[top++] = 0;
+                        while(top > 0)
+                        {
+                                const unsigned int index = stack[--top];
+                                Node const& node = mNodes[index];
+                                if(!node.box.overlaps(box)) continue;
+                                if(node.count > 0)
+                                {
+                                        for(unsigned int i = node.first; i < node.first + node.count; ++i)
+                                                visit(mOrder[i]);
+                                }
+                                else
+                                {
+                                        // The left child follows its parent
+                                        stack[top++] = node.right;
+                                        stack[top++] = index + 1;
+                                }
+                        }
+                }
+
+                Box const& bounds() const { return mNodes.front().box; }
+                size_t nodeCount() const { return mNodes.size(); }
+
+        private:
+                struct Node
+                {
+                        Box box;
+                        unsigned int first;     // Into mOrder, for leaves
+                        unsigned int count;     // Zero for inner nodes
+                        unsigned int right;     // Right child of inner nodes
+                };
+
+                unsigned int buildNode(std::vector<Vec3> const& centroids,
+                                unsigned int begin, unsigned int end, int depth);
+
+                // Depth first order, so a node's children always come after
+                // it and refit can run backwards over the array
+                std::vector<Node> mNodes;
+                std::vector<unsigned int> mOrder;       // Triangles in leaf order
+                std::vector<unsigned int> mTriangles;
+};
+
+#endif//__BVH_HPP
@@ -19,6 +19,9 @@ class Camera : public atlas::utils::Camera
 
                 atlas::math::Matrix4 getCameraMatrix() override;
 
+                // World space position of the eye, for distance based detail
+                atlas::math::Point getEyePosition();
+
         private:
 
                 struct CameraImpl;
@@ -0,0 +1,68 @@
+#ifndef __CHECKSUM_HPP
+#define __CHECKSUM_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// FNV-1a style hash of the exact bits of the particle positions and
+// velocities, taken a value at a time rather than a byte at a time so it
+// costs about as much as one pass over the state. Runs that agree bit for
+// bit have the same checksum; a change in the last bit of one coordinate
+// changes it.
+template <typename T>
+void hashValues(std::vector<T> const& values, std::uint64_t& hash)
+{
+        static_assert(sizeof(T) <= sizeof(std::uint64_t), "values wider than the hash");
+        for(T const& value : values)
+        {
+                std::uint64_t bits = 0;
+                std::memcpy(&bits, &value, sizeof(T));
+                hash ^= bits;
+                hash *= 1099511628211ull;
+        }
+}
+
+template <typename Particles>
+std::uint64_t stateChecksum(Particles const& p)
+{
+        std::uint64_t hash = 14695981039346656037ull;
+        hashValues(p.x, hash);
+        hashValues(p.y, hash);
+        hashValues(p.z, hash);
+        hashValues(p.vx, hash);
+        hashValues(p.vy, hash);
+        hashValues(p.vz, hash);
+        return hash;
+}
+
+// The checksum of every step of a run. Comparing the logs of two runs
+// gives the first step at which they went apart, which narrows a
+// reproducibility bug down to the one step that needs looking at.
+class ChecksumLog
+{
+        public:
+                void clear() { mValues.clear(); }
+                void record(std::uint64_t checksum) { mValues.push_back(checksum); }
+
+                template <typename Particles>
+                void record(Particles const& particles) { record(stateChecksum(particles)); }
+
+                std::vector<std::uint64_t> const& values() const { return mValues; }
+                size_t size() const { return mValues.size(); }
+
+                // Number of the first step (counting from one) whose
+                // checksums differ, zero if they agree over the steps both
+                // logs have
+                size_t firstDivergence(ChecksumLog const& other) const;
+
+                // One "step checksum" line per step, the checksum in hex
+                bool write(std::string const& path) const;
+                bool read(std::string const& path);
+
+        private:
+                std::vector<std::uint64_t> mValues;
+};
+
+#endif//__CHECKSUM_HPP
@@ -0,0 +1,165 @@
+#ifndef __CHUNKED_SYSTEM_HPP
+#define __CHUNKED_SYSTEM_HPP
+
+#include "SpringSystem.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Out of core stepping for spring networks larger than memory. The network
+// is split into spatial chunks that are stored one after another in a
+// file, which is memory mapped and streamed through chunk by chunk, so
+// only a window of chunks is resident at any time.
+//
+// A chunk holds its own particles, copies of the particles its springs
+// reach in other chunks (the halo), and every spring touching one of its
+// own particles. Springs across a chunk border are stored, and evaluated,
+// on both sides. Halo values come from a boundary table kept in memory,
+// with a slot for every particle that is a halo anywhere. The table is
+// double buffered: chunks read the state at the start of the step and
+// write the new state of their border particles to the other half, so the
+// result does not depend on the order the chunks are stepped in.
+//
+// While a chunk is stepped, the next ones are requested with
+// MADV_WILLNEED so their reads are under way before they are touched, and
+// stepped chunks have their writeback started and are dropped from the
+// process and, a window later, from the page cache. The disk sees long
+// sequential reads and writes instead of a fault per page.
+
+// One chunk as it is handed to the writer. Particles are the owned ones
+// followed by the halo.
+struct ChunkData
+{
+        void clear();
+        size_t addParticle(float px, float py, float pz, float vx, float vy, float vz, float invMass);
+
+        std::vector<float> x, y, z, vx, vy, vz, invMass;
+        std::vector<std::uint64_t> ids;         // Global index of each owned particle
+        std::vector<std::uint32_t> importSlot;  // Boundary slot of each halo particle
+
+        // Springs between local particle indices
+        std::vector<std::uint32_t> a, b;
+        std::vector<float> rest, k, damping;
+
+        // Owned particles that are halos elsewhere, and their slots
+        std::vector<std::uint32_t> exportLocal;
+        std::vector<std::uint32_t> exportSlot;
+};
+
+// Where a chunk is in the file and what it holds
+struct ChunkEntry
+{
+        std::uint64_t offset;
+        std::uint64_t bytes;
+        std::uint32_t owned, halo, springs, exports;
+};
+
+// Writes a chunk file one chunk at a time, so a network can be generated
+// straight to disk without ever being in memory as a whole
+class ChunkWriter
+{
+        public:
+                ChunkWriter();
+                ~ChunkWriter();
+
+                bool open(std::string const& path, float gx, float gy, float gz, float damping);
+
+                // The ids of owned particles must be unique over all chunks.
+                // A spring is counted by the chunk that owns its a end, so
+                // one across a border keeps its ends in the same order on
+                // both sides.
+                bool add(ChunkData const& chunk);
+                bool finish();
+
+        private:
+                FILE* mFile;
+                std::uint64_t mOffset;
+                std::uint64_t mParticles;
+                std::uint64_t mSprings;
+                std::uint32_t mBoundary;
+                float mGravity[3];
+                float mDamping;
+                std::vector<ChunkEntry> mEntries;
+};
+
+class ChunkedSpringSystem
+{
+        public:
+                struct Stats
+                {
+                        double seconds;                 // Spent in step()
+                        std::uint64_t steps;
+                        std::uint64_t bytes;            // Chunk data streamed through
+                        long majorFaults;               // Page faults that waited on the disk
+                };
+
+                ChunkedSpringSystem();
+                ~ChunkedSpringSystem();
+
+                // Partition an in-memory system into cells of the given
+                // size, ordered along a Z curve so neighbouring cells are
+                // near each other in the file. The system's colliders and
+                // extra force models are not carried over.
+                static bool create(std::string const& path, SpringSystem const& system, float cellSize);
+
+                // Maps the file and fills the boundary table with one pass
+                // over the chunks. window is how many chunks are read ahead
+                // and kept in the page cache behind the current one; without
+                // dropChunks, stepped chunks are left to the kernel.
+                bool open(std::string const& path, unsigned int window = 4, bool dropChunks = true);
+                void close();
+
+                void step(float dt);
+
+                // Writes the positions and velocities into a system with
+                // the particles in their global order
+                void copyTo(SpringSystem& system) const;
+
+                size_t chunkCount() const { return mEntries.size(); }
+                std::uint64_t particleCount() const { return mParticles; }
+                std::uint64_t springCount() const { return mSprings; }
+                std::uint64_t fileBytes() const { return mSize; }
+                Stats const& stats() const { return mStats; }
+
+        private:
+                // Pointers into one mapped chunk
+                struct View
+                {
+                        float *x, *y, *z, *vx, *vy, *vz, *invMass;
+                        std::uint32_t *a, *b;
+                        float *rest, *k, *damping;
+                        std::uint64_t* ids;
+                        std::uint32_t* importSlot;
+                        std::uint32_t *exportLocal, *exportSlot;
+                };
+
+                View view(size_t c) const;
+                void prefetch(size_t c);
+                void release(size_t c);
+                void evict(size_t c);
+                void exportBorder(View const& v, ChunkEntry const& e, float* boundary) const;
+                void stepChunk(size_t c, float dt);
+
+                int mFd;
+                unsigned char* mData;
+                std::uint64_t mSize;
+                unsigned int mWindow;
+                bool mRelease;
+
+                std::vector<ChunkEntry> mEntries;
+                std::uint64_t mParticles;
+                std::uint64_t mSprings;
+                float mGravity[3];
+                float mDamping;
+
+                // Six values (position and velocity) per slot, two halves
+                std::vector<float> mBoundary[2];
+                int mCurrent;
+
+                std::vector<float> mFx, mFy, mFz;
+                Stats mStats;
+};
+
+#endif//__CHUNKED_SYSTEM_HPP
@@ -0,0 +1,250 @@
+#ifndef __COLLISION_HPP
+#define __COLLISION_HPP
+
+#include "Bvh.hpp"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+// Continuous collision detection of particles against moving rigid
+// colliders. Instead of testing where a particle ends up, each test sweeps
+// it along the path it took during the step, so a fast particle cannot
+// pass through thin geometry between two steps and the step size is free
+// to be as large as the integrator allows.
+//
+// Colliders move between two poses over a step. A particle's path is
+// taken into the collider's frame with the start pose at its start and the
+// end pose at its end, which is exact for moving colliders and a close
+// approximation for turning ones.
+
+// Rotation and translation of a rigid collider
+struct RigidPose
+{
+        RigidPose();
+
+        // Rotation by angle radians about the unit axis, then translation
+        static RigidPose axisAngle(Vec3 const& axis, float angle, Vec3 const& position);
+
+        Vec3 apply(Vec3 const& p) const;        // Collider to world
+        Vec3 rotate(Vec3 const& d) const;
+        Vec3 inverse(Vec3 const& p) const;      // World to collider
+
+        std::array<float, 9> rotation;          // Row major
+        Vec3 translation;
+};
+
+struct CollisionHit
+{
+        float t;                // Fraction of the swept segment
+        Vec3 point;             // Centre of the particle at contact
+        Vec3 normal;            // Out of the collider, towards the particle
+        Vec3 motion;            // How far the surface deforms over the step
+};
+
+class Collider
+{
+        public:
+                virtual ~Collider() { }
+
+                // Call once per step on an animated collider; the old pose
+                // becomes the pose at the start of the step. Once it stops,
+                // move it to its last pose once more so that it no longer
+                // counts as moving.
+                void moveTo(RigidPose const& pose);
+
+                RigidPose const& pose() const { return mPose; }
+                RigidPose const& previousPose() const { return mPrevious; }
+
+                // Whether it moves or deforms over the current step
+                virtual bool isMoving() const;
+
+                // World box over both poses, for the broad phase
+                Box const& bounds() const { return mBounds; }
+
+                // Swept test in the collider's frame for a sphere of the
+                // given radius going from a, at the fraction `start` of the
+                // step, to b at its end. A particle that starts out inside
+                // is pushed out with a hit at t = 0.
+                virtual bool sweep(Vec3 const& a, Vec3 const& b, float start, float radius,
+                                CollisionHit& hit) const = 0;
+
+                // Pairs of world space points outlining the collider at its
+                // current pose, for drawing
+                virtual void outline(std::vector<Vec3>& lines) const = 0;
+
+        protected:
+                // Derived constructors call this once their shape is set
+                void updateBounds();
+                virtual Box localBounds() const = 0;
+
+        private:
+                RigidPose mPrevious;
+                RigidPose mPose;
+                Box mBounds;
+};
+
+// One sided rectangle in the collider's xz plane facing +y, like the Grid.
+// Half sizes of zero make it infinite. Particles coming from below pass.
+class PlaneCollider : public Collider
+{
+        public:
+                PlaneCollider(float halfWidth = 0.f, float halfDepth = 0.f);
+
+                bool sweep(Vec3 const& a, Vec3 const& b, float start, float radius,
+                                CollisionHit& hit) const override;
+                void outline(std::vector<Vec3>& lines) const override;
+
+        private:
+                Box localBounds() const override;
+                bool inside(Vec3 const& p) const;
+
+                float mHalfWidth;
+                float mHalfDepth;
+};
+
+// The swept sphere is tested against the box grown by its radius, which
+// is exact on the faces and a little early on the edges and corners
+class BoxCollider : public Collider
+{
+        public:
+                BoxCollider(float halfX, float halfY, float halfZ);
+
+                bool sweep(Vec3 const& a, Vec3 const& b, float start, float radius,
+                                CollisionHit& hit) const override;
+                void outline(std::vector<Vec3>& lines) const override;
+
+        private:
+                Box localBounds() const override;
+
+                Vec3 mHalf;
+};
+
+// Capsule around the collider's y axis from -halfLength to halfLength
+class CapsuleCollider : public Collider
+{
+        public:
+                CapsuleCollider(float halfLength, float radius);
+
+                bool sweep(Vec3 const& a, Vec3 const& b, float start, float radius,
+                                CollisionHit& hit) const override;
+                void outline(std::vector<Vec3>& lines) const override;
+
+        private:
+                Box localBounds() const override;
+
+                float mHalfLength;
+                float mRadius;
+};
+
+// Triangle mesh behind a BVH. Particles are swept as points against the
+// triangles, from either side. The mesh may also deform: setVertices moves
+// the vertices over the next step and refits the tree, and the test then
+// solves for the time the point and the moving triangle become coplanar.
+class MeshCollider : public Collider
+{
+        public:
+                MeshCollider(std::vector<Vec3> const& vertices,
+                                std::vector<unsigned int> const& triangles);
+
+                // Same count and order as the constructor's. Like moveTo,
+                // call once per step while it deforms.
+                void setVertices(std::vector<Vec3> const& vertices);
+
+                bool isMoving() const override { return mDeforming || Collider::isMoving(); }
+                bool sweep(Vec3 const& a, Vec3 const& b, float start, float radius,
+                                CollisionHit& hit) const override;
+                void outline(std::vector<Vec3>& lines) const override;
+
+                TriangleBvh const& bvh() const { return mBvh; }
+
+        private:
+                Box localBounds() const override;
+                bool sweepTriangle(unsigned int t, Vec3 const& a, Vec3 const& b, float start,
+                                CollisionHit& hit) const;
+
+                std::vector<Vec3> mPrevious;
+                std::vector<Vec3> mVertices;
+                std::vector<unsigned int> mTriangles;
+                bool mDeforming;
+                TriangleBvh mBvh;
+};
+
+// The colliders a particle system collides with, and the contact response
+class CollisionWorld
+{
+        public:
+                CollisionWorld();
+
+                void add(std::shared_ptr<Collider> collider) { mColliders.push_back(collider); }
+                std::vector<std::shared_ptr<Collider>> const& colliders() const { return mColliders; }
+
+                void setRadius(float radius) { mRadius = radius; }
+                void setRestitution(float e) { mRestitution = e; }
+                void setFriction(float mu) { mFriction = mu; }
+
+                // A particle went from start to end during a step of dt. It
+                // is stopped at the first contact on the way, its velocity
+                // relative to the collider loses the normal part (or bounces
+                // it back) and some of the tangential part, and it moves on
+                // for the rest of the step. Returns true on contact.
+                bool collide(Vec3 const& start, Vec3& end, Vec3& velocity, float dt) const;
+
+                // Whether a moving collider runs into a particle resting at
+                // the point during the step, for waking particles that are
+                // asleep and not being swept. Still colliders are left out,
+                // the particles came to rest against them.
+                bool sweptBy(Vec3 const& point) const;
+
+                // The boxes of the colliders moving this step, grown by the
+                // particle radius; the broad phase for groups of resting
+                // particles. Empty while everything is still.
+                void movingBounds(std::vector<Box>& boxes) const;
+
+                // After a semi-implicit Euler step, which started at x - dt v.
+                // Pinned particles are left alone. Returns the contacts.
+                template <typename Particles>
+                size_t collide(Particles& particles, float dt, size_t begin, size_t end) const
+                {
+                        size_t contacts = 0;
+                        for(size_t i = begin; i < end; ++i)
+                                contacts += collideParticle(particles, i, dt) ? 1 : 0;
+                        return contacts;
+                }
+
+                template <typename Particles>
+                size_t collide(Particles& particles, float dt,
+                                std::vector<unsigned int> const& indices) const
+                {
+                        size_t contacts = 0;
+                        for(unsigned int i : indices)
+                                contacts += collideParticle(particles, i, dt) ? 1 : 0;
+                        return contacts;
+                }
+
+        private:
+                template <typename Particles>
+                bool collideParticle(Particles& p, size_t i, float dt) const
+                {
+                        if(p.invMass[i] <= 0) return false;
+                        Vec3 end(static_cast<float>(p.x[i]), static_cast<float>(p.y[i]),
+                                        static_cast<float>(p.z[i]));
+                        Vec3 velocity(static_cast<float>(p.vx[i]), static_cast<float>(p.vy[i]),
+                                        static_cast<float>(p.vz[i]));
+                        if(!collide(end - velocity * dt, end, velocity, dt)) return false;
+                        p.x[i] = end.x;
+                        p.y[i] = end.y;
+                        p.z[i] = end.z;
+                        p.vx[i] = velocity.x;
+                        p.vy[i] = velocity.y;
+                        p.vz[i] = velocity.z;
+                        return true;
+                }
+
+                std::vector<std::shared_ptr<Collider>> mColliders;
+                float mRadius;
+                float mRestitution;
+                float mFriction;
+};
+
+#endif//__COLLISION_HPP
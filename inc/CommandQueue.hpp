@@ -0,0 +1,87 @@
+#ifndef __COMMAND_QUEUE_HPP
+#define __COMMAND_QUEUE_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Bounded lock-free queue of commands to run on the simulation thread.
+// Any number of threads may post, one thread runs them. Each slot carries
+// a sequence number that tells producers and the consumer whose turn it is
+// (after Dmitry Vyukov's bounded MPMC queue).
+class CommandQueue
+{
+        public:
+                typedef std::function<void()> Command;
+
+                // capacity must be a power of two
+                CommandQueue(size_t capacity = 256) :
+                        mMask(capacity - 1),
+                        mSlots(new Slot[capacity]),
+                        mHead(0),
+                        mTail(0)
+                {
+                        for(size_t i = 0; i < capacity; ++i)
+                                mSlots[i].sequence.store(i, std::memory_order_relaxed);
+                }
+
+                // Returns false when the queue is full
+                bool push(Command command)
+                {
+                        size_t position = mTail.load(std::memory_order_relaxed);
+                        for(;;)
+                        {
+                                Slot& slot = mSlots[position & mMask];
+                                const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                                const long difference = static_cast<long>(sequence) -
+                                        static_cast<long>(position);
+                                if(difference == 0)
+                                {
+                                        if(mTail.compare_exchange_weak(position, position + 1,
+                                                                std::memory_order_relaxed))
+                                        {
+                                                slot.command = std::move(command);
+                                                slot.sequence.store(position + 1, std::memory_order_release);
+                                                return true;
+                                        }
+                                }
+                                else if(difference < 0) return false;
+                                else position = mTail.load(std::memory_order_relaxed);
+                        }
+                }
+
+                // Consumer only. Runs every command posted so far, returns
+                // how many ran.
+                size_t drain()
+                {
+                        size_t count = 0;
+                        for(;;)
+                        {
+                                Slot& slot = mSlots[mHead & mMask];
+                                const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                                if(sequence != mHead + 1) return count;
+
+                                Command command = std::move(slot.command);
+                                slot.command = nullptr;
+                                slot.sequence.store(mHead + mMask + 1, std::memory_order_release);
+                                ++mHead;
+
+                                command();
+                                ++count;
+                        }
+                }
+
+        private:
+                struct Slot
+                {
+                        std::atomic<size_t> sequence;
+                        Command command;
+                };
+
+                const size_t mMask;
+                std::unique_ptr<Slot[]> mSlots;
+                size_t mHead;                   // Consumer only
+                std::atomic<size_t> mTail;
+};
+
+#endif//__COMMAND_QUEUE_HPP
@@ -0,0 +1,97 @@
+#ifndef __CONTROL_SERVER_HPP
+#define __CONTROL_SERVER_HPP
+
+#include "CommandQueue.hpp"
+#include "RingBuffer.hpp"
+#include "SimulationThread.hpp"
+#include "Tunable.hpp"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+
+// Remote control of a running simulation over a Unix domain socket. The
+// protocol is one command per line, and every command gets one reply line:
+//
+//     set k=2.5 damping=0.1   all values are applied between the same two steps
+//     pause | resume
+//     step [n]                runs n steps, also while paused
+//     reset
+//     get                     state k=2.5 damping=0.1 ... energy=... steps=...
+//     history                 history every=n step:kinetic:potential:strain ...
+//     subscribe [n]           telemetry for every n-th step
+//     unsubscribe
+//
+// Telemetry lines read "t <step> <time> <energy> <step microseconds>
+// <kinetic energy> <strain> <largest strain so far>".
+//
+// The server runs on a thread of its own. Edits reach the simulation as
+// commands posted to the SimulationThread, so the physics thread never
+// takes a lock, and replies that need simulation state come back through
+// a queue of their own. Telemetry is written by the physics thread into a
+// ring buffer, only while someone is subscribed, and sent out in batches.
+class ControlServer
+{
+        public:
+                ControlServer(std::string const& path, SimulationThread& simulation,
+                                Tunable& target);
+                ~ControlServer();
+
+                // Installs the telemetry observer on success. Start before
+                // the simulation thread and stop after it, since the
+                // observer is only swapped while nothing is stepping.
+                bool start();
+                void stop();
+
+                std::string const& path() const { return mPath; }
+
+        private:
+                struct Client
+                {
+                        int fd;
+                        std::string input;
+                        std::string output;
+                        unsigned long long every;       // 0 when not subscribed
+                };
+
+                struct Sample
+                {
+                        unsigned long long step;
+                        float energy;
+                        float seconds;
+                        float kinetic;
+                        float strain;
+                        float maxStrain;
+                };
+
+                void run();
+                void accept();
+                bool receive(Client& client);
+                bool flush(Client& client);
+                // Returns true if a reply will come from the physics thread
+                bool execute(int id, std::string const& line);
+                void reply(int id, std::string const& text);
+                void sendTelemetry();
+
+                // Physics thread
+                void observe(unsigned long long step, double seconds);
+
+                std::string mPath;
+                SimulationThread& mSimulation;
+                Tunable& mTarget;
+
+                int mListen;
+                int mWake[2];           // Pipe that interrupts poll on stop
+                std::thread mThread;
+                std::atomic<bool> mRunning;
+
+                std::map<int, Client> mClients;     // By id, server thread only
+                int mNextId;
+
+                CommandQueue mReplies;
+                RingBuffer<Sample> mTelemetry;
+                std::atomic<int> mSubscribers;
+};
+
+#endif//__CONTROL_SERVER_HPP
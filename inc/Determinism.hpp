@@ -0,0 +1,35 @@
+#ifndef __DETERMINISM_HPP
+#define __DETERMINISM_HPP
+
+#include <string>
+
+// Options for the reproducibility report. A cloth falling onto the floor
+// is stepped serially and with the ParallelStepper in both modes for 1, 2,
+// 4, ... threads, recording a checksum of the state after every step, and
+// the report lists the throughput of each run and the first step where it
+// differs from the single threaded one.
+//
+//     Springs --determinism 2000 --lattice 128 --threads 8
+//
+// --checksums writes the deterministic run's checksums to a file and
+// --golden compares them against such a file, for golden tests between
+// builds. The exit code is non-zero if the deterministic runs disagree.
+struct DeterminismOptions
+{
+        DeterminismOptions();
+
+        int steps;
+        int lattice;            // Particles along each side of the cloth
+        float dt;
+        int threads;            // Largest thread count, zero for one per core
+        std::string checksums;
+        std::string golden;
+};
+
+// Returns true if the arguments ask for the report
+bool parseDeterminismOptions(int argc, char** argv, DeterminismOptions& options);
+
+// Runs the report, returns the exit code
+int runDeterminism(DeterminismOptions const& options);
+
+#endif//__DETERMINISM_HPP
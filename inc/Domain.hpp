@@ -0,0 +1,63 @@
+#ifndef __DOMAIN_HPP
+#define __DOMAIN_HPP
+
+#include "HaloTransport.hpp"
+#include "SpringSystem.hpp"
+
+#include <vector>
+
+// One rank's share of a spring network split into domains, each stepped by
+// its own process. The domain is a SpringSystem of its own holding the
+// particles it owns, followed by ghost copies of the particles its springs
+// reach in other domains, and every spring touching an owned particle.
+// Springs across a border are evaluated on both sides. After every step
+// the new positions and velocities of border particles are sent to the
+// domains that hold them as ghosts; the velocities are needed by the
+// spring damping.
+//
+// The springs keep their order in the full network, so every owned
+// particle sums its forces in the same order as a serial step and the
+// result is bitwise identical for any number of domains. Extra force
+// models are not carried over.
+class SpringDomain
+{
+        public:
+                // Every rank builds its domain from the same full system and
+                // partition, which gives all of them the same send and
+                // receive lists without any setup messages
+                SpringDomain(SpringSystem const& global, std::vector<unsigned int> const& partOf,
+                                HaloTransport& transport);
+
+                void step(float dt);
+
+                // Copies the owned state of every rank into the particles of
+                // the full system on rank zero. Collective.
+                void gather(SpringSystem& global);
+
+                SpringSystem& system() { return mSystem; }
+                size_t ownedCount() const { return mOwned.size(); }
+                size_t ghostCount() const { return mSystem.particles().size() - mOwned.size(); }
+
+                // Floats this rank sends per step
+                size_t haloFloats() const;
+
+        private:
+                struct Neighbour
+                {
+                        int rank;
+                        std::vector<unsigned int> send;         // Local indices of owned particles
+                        size_t ghostBegin, ghostEnd;            // Local indices of its ghosts
+                        std::vector<float> sendBuffer, receiveBuffer;
+                };
+
+                void exchangeHalo();
+
+                SpringSystem mSystem;
+                HaloTransport& mTransport;
+                std::vector<unsigned int> mOwned;               // Global index of each owned particle
+                std::vector<unsigned int> mPartOf;
+                std::vector<Neighbour> mNeighbours;
+                std::vector<HaloTransport::Buffer> mSends, mReceives;
+};
+
+#endif//__DOMAIN_HPP
@@ -0,0 +1,26 @@
+#ifndef __DRIFT_HPP
+#define __DRIFT_HPP
+
+// Options for the precision report. The same free floating spring lattice
+// is stepped in float, double and mixed precision, and the drift of its
+// energy and momentum is printed next to the throughput of each mode.
+//
+//     Springs --drift 100000 --lattice 8 --dt 0.001
+struct DriftOptions
+{
+        DriftOptions();
+
+        int steps;
+        int lattice;            // Particles along each side of the cube
+        float dt;
+        float k;
+        int reports;            // Drift lines printed over the run
+};
+
+// Returns true if the arguments ask for the report
+bool parseDriftOptions(int argc, char** argv, DriftOptions& options);
+
+// Runs all three modes, returns the exit code
+int runDrift(DriftOptions const& options);
+
+#endif//__DRIFT_HPP
@@ -0,0 +1,200 @@
+#ifndef __FORCE_FIELD_HPP
+#define __FORCE_FIELD_HPP
+
+#include "SpringSystem.hpp"
+
+#include <memory>
+#include <vector>
+
+// An air velocity field. Fields are sampled for a whole batch of points at
+// once and add their velocity into u, v and w, so several fields can be
+// layered over the same arrays.
+class VelocityField
+{
+        public:
+                virtual ~VelocityField() { }
+                virtual void sample(float time, size_t n,
+                                const float* x, const float* y, const float* z,
+                                float* u, float* v, float* w) = 0;
+};
+
+class UniformWind : public VelocityField
+{
+        public:
+                UniformWind(float u, float v, float w);
+
+                void sample(float time, size_t n,
+                                const float* x, const float* y, const float* z,
+                                float* u, float* v, float* w) override;
+
+                void setVelocity(float u, float v, float w);
+
+        private:
+                float mU, mV, mW;
+};
+
+// Blows away from the centre (towards it for a negative strength). The
+// speed peaks at `strength` on the sphere of the given radius and falls off
+// on both sides.
+class RadialWind : public VelocityField
+{
+        public:
+                RadialWind(float cx, float cy, float cz, float strength, float radius);
+
+                void sample(float time, size_t n,
+                                const float* x, const float* y, const float* z,
+                                float* u, float* v, float* w) override;
+
+        private:
+                float mCx, mCy, mCz;
+                float mStrength;
+                float mRadius;
+};
+
+// Swirls around an axis through the centre, with the same speed profile as
+// RadialWind measured from the axis
+class VortexWind : public VelocityField
+{
+        public:
+                VortexWind(float cx, float cy, float cz,
+                                float ax, float ay, float az,
+                                float strength, float radius);
+
+                void sample(float time, size_t n,
+                                const float* x, const float* y, const float* z,
+                                float* u, float* v, float* w) override;
+
+        private:
+                float mCx, mCy, mCz;
+                float mAx, mAy, mAz;    // Unit length
+                float mStrength;
+                float mRadius;
+};
+
+// Turbulence from a few octaves of value noise, animated over time.
+//
+// The noise is never evaluated per particle. It is computed on the nodes of
+// a coarse lattice covering the points, for two time slices, and the points
+// trilinearly sample the blend of the two. The lattice is only recomputed
+// when the points leave it or time moves on to the next slice.
+class NoiseWind : public VelocityField
+{
+        public:
+                // scale is the size of the largest noise feature, cellSize
+                // the lattice spacing and rate the number of new slices per
+                // second
+                NoiseWind(float amplitude, float scale, float cellSize,
+                                int octaves = 3, float rate = 1.f, unsigned int seed = 0);
+
+                void sample(float time, size_t n,
+                                const float* x, const float* y, const float* z,
+                                float* u, float* v, float* w) override;
+
+                // Drops the cached lattice
+                void setAmplitude(float amplitude) { mAmplitude = amplitude; mValid = false; }
+
+                size_t latticeSize() const { return mNx * mNy * mNz; }
+
+        private:
+                void fitLattice(size_t n, const float* x, const float* y, const float* z);
+                void updateSlices(float time);
+                void computeSlice(long slice, std::vector<float> (&out)[3]) const;
+                float noise(float x, float y, float z, long slice, unsigned int channel) const;
+
+                float mAmplitude;
+                float mScale;
+                float mCell;
+                int mOctaves;
+                float mRate;
+                unsigned int mSeed;
+
+                // Lattice origin in world space and node counts
+                float mOx, mOy, mOz;
+                size_t mNx, mNy, mNz;
+
+                long mSlice;            // Slice held in mFrom, mTo holds the next
+                float mBlendTime;
+                bool mValid;
+                std::vector<float> mFrom[3];
+                std::vector<float> mTo[3];
+                std::vector<float> mBlend[3];
+};
+
+// Applies the air to a particle set: a linear drag pulling each particle
+// towards the local air velocity, and pressure drag and lift on triangles
+// so that a sheet catches the wind in proportion to the area it shows.
+//
+// The fields are sampled into per particle air velocity arrays first, then
+// the drag terms are evaluated from those. The full pass runs over the
+// whole particle and triangle arrays; given lists of particles and
+// triangles, only those particles and the corners of those triangles are
+// sampled.
+class WindForce : public ForceModel
+{
+        public:
+                WindForce(float airDensity = 1.2f);
+
+                void addField(std::shared_ptr<VelocityField> field);
+
+                // Time used to animate the fields
+                void setTime(float time) { mTime = time; }
+                void advance(float dt) { mTime += dt; }
+
+                void setParticleDrag(float c) { mParticleDrag = c; }
+                void setCoefficients(float drag, float lift);
+
+                void addTriangle(unsigned int a, unsigned int b, unsigned int c);
+
+                // Two triangles per cell of a row major grid of particles
+                // starting at `first`
+                void addGrid(size_t width, size_t height, size_t first = 0);
+
+                void addForces(ParticleSet& particles) override;
+
+                // The elements are the triangles; particle drag applies to
+                // the active particles
+                size_t elementCount() const override { return mA.size(); }
+                void elementParticles(size_t t, std::vector<unsigned int>& out) const override;
+                void addForces(ParticleSet& particles, std::vector<unsigned int> const& active,
+                                std::vector<unsigned int> const& triangles) override;
+
+                size_t triangleCount() const { return mA.size(); }
+
+                // Air velocity at each particle from the last addForces, only
+                // valid for the particles it sampled
+                std::vector<float> const& airU() const { return mU; }
+                std::vector<float> const& airV() const { return mV; }
+                std::vector<float> const& airW() const { return mW; }
+
+        private:
+                void sampleFields(ParticleSet const& particles);
+                void sampleFields(ParticleSet const& particles, std::vector<unsigned int> const& active,
+                                std::vector<unsigned int> const& triangles);
+
+                // A null list means every particle or triangle
+                void applyParticleDrag(ParticleSet& particles, unsigned int const* list, size_t count);
+                void applyTriangleDrag(ParticleSet& particles, unsigned int const* list, size_t count);
+
+                float mDensity;
+                float mDrag;
+                float mLift;
+                float mParticleDrag;
+                float mTime;
+
+                std::vector<std::shared_ptr<VelocityField>> mFields;
+
+                std::vector<unsigned int> mA, mB, mC;
+
+                std::vector<float> mU, mV, mW;
+                // Force on each triangle, spread over its corners afterwards
+                std::vector<float> mFx, mFy, mFz;
+
+                // Particles sampled by a partial pass, their positions and
+                // air velocities packed, and a mark to list each only once
+                std::vector<unsigned int> mSampled;
+                std::vector<float> mSx, mSy, mSz;
+                std::vector<float> mSu, mSv, mSw;
+                std::vector<unsigned char> mMark;
+};
+
+#endif//__FORCE_FIELD_HPP
@@ -0,0 +1,42 @@
+#ifndef __HALO_TRANSPORT_HPP
+#define __HALO_TRANSPORT_HPP
+
+#include <cstddef>
+#include <vector>
+
+// How the domains of a decomposed simulation talk to each other. A domain
+// only ever exchanges whole arrays with its neighbours, once per step, so
+// the interface is a single collective exchange plus a barrier. Posting
+// all sends and receives together lets a backend progress them in any
+// order, which keeps two neighbours sending to each other at the same
+// time from waiting on one another. An MPI backend maps exchange onto
+// MPI_Isend, MPI_Irecv and MPI_Waitall.
+class HaloTransport
+{
+        public:
+                struct Buffer
+                {
+                        Buffer(int peer, float* data, size_t count) :
+                                peer(peer), data(data), count(count)
+                        { }
+
+                        int peer;
+                        float* data;
+                        size_t count;
+                };
+
+                virtual ~HaloTransport() { }
+
+                virtual int rank() const = 0;
+                virtual int size() const = 0;
+
+                // Returns once every send has been handed over and every
+                // receive has been filled. Messages between two ranks arrive
+                // in the order they were sent.
+                virtual void exchange(std::vector<Buffer> const& sends,
+                                std::vector<Buffer> const& receives) = 0;
+
+                virtual void barrier() = 0;
+};
+
+#endif//__HALO_TRANSPORT_HPP
@@ -0,0 +1,135 @@
+#ifndef __ISLANDS_HPP
+#define __ISLANDS_HPP
+
+#include "Bvh.hpp"
+#include "SpringSystem.hpp"
+
+#include <vector>
+
+// Splits a spring network into islands (connected components of moving
+// particles) and lets islands that have come to rest fall asleep.
+// Sleeping islands are skipped entirely by step, and the per step work
+// only ever walks the list of awake islands. The elements of force models
+// that report them are split over the islands like the springs; models
+// without elements are evaluated in full.
+//
+// Spring edits logged by the system are followed in place: an inserted
+// spring merges the islands at its ends, the smaller into the larger, and
+// a removed one queues its island for a split that only walks that
+// island. Only compaction, new particles or new force models rebuild
+// everything.
+//
+// Fixed particles do not join islands together; moving one wakes every
+// island attached to it. A moving collider that runs into a sleeping
+// island wakes it too; only the sleeping islands are tested, and only
+// while a collider moves.
+class IslandManager
+{
+        public:
+                // An island falls asleep once its kinetic energy per unit of
+                // mass has stayed below sleepEnergy for sleepSteps steps
+                IslandManager(float sleepEnergy = 1e-4f, int sleepSteps = 120);
+
+                // extraEdges are pairs of particles joined by something other
+                // than a spring or a force model element
+                void build(SpringSystem const& system,
+                                std::vector<unsigned int> const& extraEdges = std::vector<unsigned int>());
+
+                // Forces and integration for the awake islands only.
+                // When the system is observing, sleeping islands count with
+                // the potential energy they fell asleep with and add no
+                // strain.
+                void step(SpringSystem& system, float dt);
+
+                void wakeParticle(size_t particle);
+                void wakeAll();
+
+                size_t islandCount() const { return mIslands.size() - mFreeIslands.size(); }
+                size_t awakeCount() const { return mAwake.size(); }
+                size_t activeParticleCount() const;
+
+                // The springs of the awake islands, the only ones that can
+                // have stretched since they were last checked
+                void awakeSprings(std::vector<unsigned int>& springs) const;
+
+        private:
+                static const unsigned int kNone = static_cast<unsigned int>(-1);
+
+                struct Island
+                {
+                        std::vector<unsigned int> particles;
+                        std::vector<unsigned int> springs;
+                        std::vector<std::vector<unsigned int>> elements;        // Per force model
+                        std::vector<unsigned int> extras;       // Pair index into mExtraEdges
+                        std::vector<unsigned int> anchors;      // Fixed particles it hangs from
+                        int stillSteps;
+                        bool awake;
+                        bool splitQueued;
+                        size_t slot;    // Position in mAwake or mAsleep
+                        Box bounds;     // Taken when it falls asleep
+                        double potential;       // Of its last observed step
+                };
+
+                // New islands start out awake
+                unsigned int newIsland();
+                void releaseIsland(unsigned int island);
+                void unlist(unsigned int island);
+
+                // Hand an edge, spring or element to the island of its
+                // moving particles, anchoring it to the fixed ones
+                unsigned int attach(unsigned int i, unsigned int j, ParticleSet const& particles);
+                void placeSpring(unsigned int island, unsigned int spring);
+                void placeElement(size_t model, unsigned int element, SpringSystem const& system);
+                void anchor(unsigned int island, unsigned int particle);
+
+                void followEdits(SpringSystem& system);
+                unsigned int merge(unsigned int a, unsigned int b);
+                void queueSplit(unsigned int island);
+                void split(unsigned int island, SpringSystem const& system);
+
+                void wake(unsigned int island);
+                void sleep(unsigned int island, ParticleSet& particles);
+                void wakeOnContact(SpringSystem const& system);
+
+                float mSleepEnergy;
+                int mSleepSteps;
+
+                std::vector<Island> mIslands;
+                std::vector<unsigned int> mFreeIslands;
+                std::vector<unsigned int> mAwake;
+                std::vector<unsigned int> mAsleep;
+                std::vector<unsigned int> mSplits;
+                double mSleepingPotential;
+
+                // A moving particle belongs to one island, a fixed particle
+                // lists every island it anchors
+                std::vector<unsigned int> mIslandOf;
+                std::vector<std::vector<unsigned int>> mAnchored;
+
+                // Island of every spring slot and its position in the
+                // island's list, for removal in place
+                std::vector<unsigned int> mSpringIsland;
+                std::vector<unsigned int> mSpringSlot;
+
+                std::vector<unsigned int> mExtraEdges;
+                std::vector<unsigned int> mTouched;
+                std::vector<SpringSystem::SpringEdit> mEdits;
+                size_t mParticleCount;
+                size_t mModelCount;
+                unsigned int mLayoutVersion;
+
+                // Scratch for splits: local index per particle, the local
+                // union find and element nodes
+                std::vector<unsigned int> mLocal;
+                std::vector<unsigned int> mParent;
+                std::vector<unsigned int> mNodes;
+
+                // Colliders moving this step, grown by the particle radius
+                std::vector<Box> mMoving;
+
+                // Particles and elements of the awake islands, per step
+                std::vector<unsigned int> mActive;
+                std::vector<std::vector<unsigned int>> mActiveElements;
+};
+
+#endif//__ISLANDS_HPP
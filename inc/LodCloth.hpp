@@ -0,0 +1,116 @@
+#ifndef __LOD_CLOTH_HPP
+#define __LOD_CLOTH_HPP
+
+#include "SpringSystem.hpp"
+
+#include <vector>
+
+// A rectangular cloth simulated at two resolutions. A coarse proxy with
+// one node every `ratio` fine particles is always stepped. The cloth is
+// split into tiles, one per coarse cell; tiles near the viewer are
+// refined and run the fine springs, the rest have their fine particles
+// interpolated from the proxy. Refined regions write their state back to
+// the proxy nodes they cover, so both levels stay in agreement.
+//
+// Fine particles on the border between a refined and a coarse tile are
+// driven by the proxy and act as a moving boundary for the refined tile.
+//
+// The elements of force models on the fine system are handed out to the
+// tiles like the springs, so a model only runs over the refined tiles.
+// Models that report no elements run over the whole fine sheet.
+class LodCloth
+{
+        public:
+                // width and height are fine particle counts, (width - 1) and
+                // (height - 1) must be multiples of ratio. The cloth lies in
+                // the xz plane with its first row pinned.
+                LodCloth(size_t width, size_t height, size_t ratio,
+                                float originX, float originY, float originZ,
+                                float spacing, float mass, float k, float damping);
+
+                // Refine tiles closer than the refine distance to the eye,
+                // coarsen them again a little further out
+                void updateRefinement(float eyeX, float eyeY, float eyeZ);
+                void setRefineDistance(float d) { mRefineDistance = d; }
+
+                void step(float dt);
+
+                // Fill in the fine particles of coarse tiles, only needed for
+                // drawing the whole cloth at full resolution
+                void interpolateCoarseTiles();
+
+                // Force models added to the fine system are applied to the
+                // refined tiles, those on the coarse system to the proxy.
+                // Fine models may be added at any time.
+                ParticleSet const& particles() const { return mFine.particles(); }
+                SpringSystem& fine() { return mFine; }
+                SpringSystem& coarse() { return mCoarse; }
+
+                // Structural and shear edges of the fine cloth
+                std::vector<unsigned int> edges() const;
+
+                size_t width() const { return mWidth; }
+                size_t height() const { return mHeight; }
+                size_t coarseWidth() const { return mCoarseWidth; }
+                size_t coarseHeight() const { return mCoarseHeight; }
+
+                size_t tileCount() const { return mTiles.size(); }
+                size_t refinedTileCount() const { return mRefinedTiles.size(); }
+                size_t simulatedParticleCount() const { return mSimulated.size(); }
+
+        private:
+                struct Tile
+                {
+                        size_t tx, ty;
+                        std::vector<unsigned int> springs;      // Fine springs owned by the tile
+                        std::vector<std::vector<unsigned int>> elements;        // Per fine force model
+                        bool refined;
+                };
+
+                size_t fineIndex(size_t i, size_t j) const { return i + mWidth * j; }
+                size_t coarseIndex(size_t i, size_t j) const { return i + mCoarseWidth * j; }
+
+                void setRefined(Tile& tile, bool refined);
+                void assignElements();
+                void rebuildActiveLists();
+                void interpolate(size_t i, size_t j);
+
+                // Apply f to every tile touching fine particle (i, j)
+                template <typename F>
+                void forTilesTouching(size_t i, size_t j, F f);
+
+                size_t mWidth;
+                size_t mHeight;
+                size_t mRatio;
+                size_t mCoarseWidth;
+                size_t mCoarseHeight;
+                size_t mTilesX;
+                size_t mTilesY;
+
+                float mRefineDistance;
+                bool mDirty;
+
+                SpringSystem mFine;
+                SpringSystem mCoarse;
+
+                std::vector<Tile> mTiles;
+                std::vector<unsigned int> mRefinedTiles;
+
+                // Per fine particle: how many tiles touch it and how many of
+                // those are refined. It is simulated when the two agree.
+                std::vector<unsigned char> mTouching;
+                std::vector<unsigned char> mRefinedTouching;
+
+                std::vector<unsigned int> mSimulated;
+                std::vector<unsigned int> mDriven;
+                std::vector<unsigned int> mSprings;
+                std::vector<unsigned int> mRestricted;  // Proxy nodes copied from fine
+                std::vector<unsigned char> mMark;
+
+                // Element count of each fine force model when the elements
+                // were handed out, and the elements of the refined tiles
+                std::vector<size_t> mElementCounts;
+                std::vector<std::vector<unsigned int>> mElements;
+};
+
+#endif//__LOD_CLOTH_HPP
@@ -0,0 +1,145 @@
+#ifndef __OBSERVABLES_HPP
+#define __OBSERVABLES_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// What a simulation measured about itself during its last step. The values
+// are taken from the force and integrate passes as they go, so keeping
+// them up to date costs a few multiply-adds per particle and no extra pass
+// over the state. Kinetic energy is measured after the velocity update and
+// potential energy before the position update, so the total wobbles by
+// O(dt) even for a perfectly conservative step.
+struct Observables
+{
+        Observables() { reset(); }
+
+        void reset()
+        {
+                beginStep();
+                maxStrain = 0.0;
+                steps = 0;
+        }
+
+        // Clears the per step fields, for passes that add into them
+        void beginStep()
+        {
+                kinetic = potential = 0.0;
+                momentum.fill(0.0);
+                angularMomentum.fill(0.0);
+                strain = 0.0;
+        }
+
+        // Called once per step after the other fields are filled in
+        void finishStep()
+        {
+                maxStrain = strain > maxStrain ? strain : maxStrain;
+                ++steps;
+        }
+
+        double energy() const { return kinetic + potential; }
+
+        double kinetic;
+        double potential;                       // Springs and gravity
+        std::array<double, 3> momentum;
+        std::array<double, 3> angularMomentum;
+        double strain;                          // Largest |length - rest| / rest
+        double maxStrain;                       // Largest strain since the reset
+        unsigned long long steps;
+};
+
+// A bounded history of observables covering the whole run. Once full,
+// every other sample is dropped and the recording interval doubles, so a
+// long run keeps its start as well as its end.
+class ObservableSeries
+{
+        public:
+                struct Sample
+                {
+                        unsigned long long step;
+                        float kinetic;
+                        float potential;
+                        float strain;
+                };
+
+                ObservableSeries(size_t capacity = 512) :
+                        mCapacity(capacity < 2 ? 2 : capacity),
+                        mEvery(1)
+                {
+                        mSamples.reserve(mCapacity);
+                }
+
+                void clear()
+                {
+                        mSamples.clear();
+                        mEvery = 1;
+                }
+
+                void record(Observables const& observables)
+                {
+                        if(observables.steps % mEvery != 0) return;
+                        if(mSamples.size() == mCapacity)
+                        {
+                                mEvery *= 2;
+                                size_t kept = 0;
+                                for(Sample const& sample : mSamples)
+                                        if(sample.step % mEvery == 0) mSamples[kept++] = sample;
+                                mSamples.resize(kept);
+                                if(observables.steps % mEvery != 0) return;
+                        }
+                        Sample sample;
+                        sample.step = observables.steps;
+                        sample.kinetic = static_cast<float>(observables.kinetic);
+                        sample.potential = static_cast<float>(observables.potential);
+                        sample.strain = static_cast<float>(observables.strain);
+                        mSamples.push_back(sample);
+                }
+
+                std::vector<Sample> const& samples() const { return mSamples; }
+                unsigned long long every() const { return mEvery; }
+
+        private:
+                size_t mCapacity;
+                unsigned long long mEvery;
+                std::vector<Sample> mSamples;
+};
+
+// Flags a run whose energy has blown up. Without a driving force a damped
+// system can only lose energy, and a conservative one keeps it up to the
+// integrator's error, so rising by more than `tolerance` times the
+// system's energy scale above the start means the step is unstable.
+// Non-finite energies count as diverged.
+class EnergyGuard
+{
+        public:
+                EnergyGuard(double tolerance = 1.0) :
+                        mTolerance(tolerance),
+                        mInitial(0.0),
+                        mLimit(0.0)
+                { }
+
+                // The scale is the energy the system could exchange in
+                // normal running, e.g. the potential it starts out with
+                void reset(double energy, double scale)
+                {
+                        mInitial = energy;
+                        mLimit = mTolerance * std::fmax(std::fabs(energy), scale);
+                }
+
+                bool diverged(double energy) const
+                {
+                        // Written so that NaN fails the comparison
+                        return !(energy - mInitial <= mLimit);
+                }
+
+                bool enabled() const { return mTolerance > 0.0; }
+
+        private:
+                double mTolerance;
+                double mInitial;
+                double mLimit;
+};
+
+#endif//__OBSERVABLES_HPP
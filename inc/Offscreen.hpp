@@ -0,0 +1,67 @@
+#ifndef __OFFSCREEN_HPP
+#define __OFFSCREEN_HPP
+
+#include <atlas/gl/GL.hpp>
+
+#include <memory>
+#include <string>
+
+// Options for rendering a scene without a display. Filled in from the
+// command line by parseOffscreenOptions.
+struct OffscreenOptions
+{
+        OffscreenOptions();
+
+        enum class Format
+        {
+                PNG,            // One PNG image per frame (needs libpng)
+                PPM,            // One binary PPM image per frame
+                RAWVIDEO        // Raw RGBA frames appended to one stream
+        };
+
+        int width;
+        int height;
+        int frames;
+        double fps;
+        std::string scene;      // "linear", "angular", "softbody" or "cloth"
+        std::string output;     // Directory, or a file/"-" for RAWVIDEO
+        Format format;
+};
+
+// Renders into a framebuffer object on an EGL surfaceless context.
+// Readback goes through a ring of pixel buffer objects so that the copy
+// of frame N overlaps with rendering frame N + 1, and the encoding and
+// writing of images happens on a background thread.
+class OffscreenRenderer
+{
+        public:
+                OffscreenRenderer(OffscreenOptions const& options);
+                ~OffscreenRenderer();
+
+                // Creates the EGL context, loads GL and builds the FBO.
+                // Must be called before any scene is constructed.
+                bool createContext();
+
+                void beginFrame();
+                void endFrame();
+
+                // Drain every outstanding readback and wait for the encoder
+                void finish();
+
+                // True once a frame could not be written
+                bool failed() const;
+                int framesWritten() const;
+                double framesPerSecond() const;
+
+        private:
+                struct OffscreenImpl;
+                std::unique_ptr<OffscreenImpl> mImpl;
+};
+
+// Returns true if the arguments ask for offscreen rendering
+bool parseOffscreenOptions(int argc, char** argv, OffscreenOptions& options);
+
+// Render options.frames frames of the requested scene, returns the exit code
+int renderOffscreen(OffscreenOptions const& options);
+
+#endif//__OFFSCREEN_HPP
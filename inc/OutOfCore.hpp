@@ -0,0 +1,35 @@
+#ifndef __OUT_OF_CORE_HPP
+#define __OUT_OF_CORE_HPP
+
+#include <string>
+
+// Options for the out of core benchmark. A square cloth is generated tile
+// by tile straight into a chunk file, never held in memory as a whole,
+// and then stepped with the ChunkedSpringSystem while the throughput, the
+// disk bandwidth and the page faults that waited on the disk are reported.
+//
+//     Springs --outofcore 100 --cloth 5000 --tile 256 --file /data/cloth.chunks
+//
+// A 5000 x 5000 cloth has 10^8 springs.
+struct OutOfCoreOptions
+{
+        OutOfCoreOptions();
+
+        int steps;
+        int cloth;              // Particles along each side
+        int tile;               // Particles along each side of a chunk
+        float dt;
+        int window;             // Chunks read ahead
+        bool cache;             // Leave stepped chunks in the page cache
+        bool reuse;             // Step an existing file instead of writing one
+        std::string file;
+        int reports;
+};
+
+// Returns true if the arguments ask for the benchmark
+bool parseOutOfCoreOptions(int argc, char** argv, OutOfCoreOptions& options);
+
+// Runs the benchmark, returns the exit code
+int runOutOfCore(OutOfCoreOptions const& options);
+
+#endif//__OUT_OF_CORE_HPP
@@ -0,0 +1,81 @@
+#ifndef __PARALLEL_STEPPER_HPP
+#define __PARALLEL_STEPPER_HPP
+
+#include "SpringSystem.hpp"
+#include "WorkerPool.hpp"
+
+#include <vector>
+
+// Steps a SpringSystem with its spring and integration passes split over
+// a pool of threads. Both modes first evaluate every spring once, in
+// parallel over spring ranges, and differ in how the forces reach the
+// particles:
+//
+//  - Fast: every thread scatters its springs into a force buffer of its
+//    own and the buffers are summed per particle. The order of the sums
+//    depends on how the springs are split, so results are repeatable for
+//    one thread count but change with it.
+//  - Deterministic: every particle gathers its springs from a precomputed
+//    incidence list in ascending spring order, the order the serial step
+//    uses. Results are bitwise identical for any number of threads.
+//
+// Extra force models run serially on the calling thread after the springs.
+// Collisions run in the integration pass and are per particle, so they do
+// not affect reproducibility.
+//
+// Observing systems are not supported, since the workers would all add
+// into the same observables; the stepper logs an error and turns
+// observing off.
+class ParallelStepper
+{
+        public:
+                enum class Mode
+                {
+                        Fast,
+                        Deterministic
+                };
+
+                // Zero threads means one per core
+                ParallelStepper(SpringSystem& system, unsigned int threads = 0,
+                                Mode mode = Mode::Deterministic);
+
+                // Same as SpringSystem::step
+                void step(float dt);
+
+                void setMode(Mode mode) { mMode = mode; }
+                Mode mode() const { return mMode; }
+                unsigned int threads() const { return mPool.size(); }
+
+        private:
+                void refuseObserving();
+                // Redone whenever the springs or particles change
+                void prepare();
+                void computeSprings(unsigned int worker);
+                void scatter(unsigned int worker);
+                void reduce(size_t begin, size_t end);
+                void gather(size_t begin, size_t end);
+
+                SpringSystem& mSystem;
+                Mode mMode;
+                WorkerPool mPool;
+
+                unsigned int mVersion;
+                size_t mSpringCount;
+                size_t mParticleCount;
+
+                // Force on the a end of every spring
+                std::vector<float> mSpringFx, mSpringFy, mSpringFz;
+
+                // Springs of each particle in ascending order, as twice the
+                // spring index plus one on its b end
+                std::vector<unsigned int> mFirst;
+                std::vector<unsigned int> mIncident;
+
+                // Fast mode, x, y and z forces of every particle per worker
+                std::vector<float> mPartial;
+
+                std::vector<unsigned int> mTouched;
+                std::vector<SpringSystem::SpringEdit> mEdits;
+};
+
+#endif//__PARALLEL_STEPPER_HPP
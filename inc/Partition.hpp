@@ -0,0 +1,17 @@
+#ifndef __PARTITION_HPP
+#define __PARTITION_HPP
+
+#include "SpringSystem.hpp"
+
+#include <vector>
+
+// Recursive coordinate bisection: the particles are split in two along the
+// widest extent of their bounding box, in proportion to the number of
+// parts on each side, and both halves are split again until there is one
+// part per domain. Parts get equal particle counts to within one, and
+// compact shapes that keep the springs cut by part borders few.
+//
+// Returns the part of every particle, in [0, parts).
+std::vector<unsigned int> recursiveBisection(ParticleSet const& particles, unsigned int parts);
+
+#endif//__PARTITION_HPP
@@ -0,0 +1,49 @@
+#ifndef __RING_BUFFER_HPP
+#define __RING_BUFFER_HPP
+
+#include <atomic>
+#include <memory>
+
+// Bounded lock-free queue from one producer thread to one consumer thread.
+// Unlike the TripleBuffer every item is kept, until the queue is full, at
+// which point the producer drops new items rather than wait.
+template <typename T>
+class RingBuffer
+{
+        public:
+                // capacity must be a power of two
+                RingBuffer(size_t capacity = 4096) :
+                        mMask(capacity - 1),
+                        mItems(new T[capacity]),
+                        mHead(0),
+                        mTail(0)
+                { }
+
+                // Producer side, returns false if the item was dropped
+                bool push(T const& item)
+                {
+                        const size_t tail = mTail.load(std::memory_order_relaxed);
+                        if(tail - mHead.load(std::memory_order_acquire) > mMask) return false;
+                        mItems[tail & mMask] = item;
+                        mTail.store(tail + 1, std::memory_order_release);
+                        return true;
+                }
+
+                // Consumer side
+                bool pop(T& item)
+                {
+                        const size_t head = mHead.load(std::memory_order_relaxed);
+                        if(head == mTail.load(std::memory_order_acquire)) return false;
+                        item = mItems[head & mMask];
+                        mHead.store(head + 1, std::memory_order_release);
+                        return true;
+                }
+
+        private:
+                const size_t mMask;
+                std::unique_ptr<T[]> mItems;
+                std::atomic<size_t> mHead;
+                std::atomic<size_t> mTail;
+};
+
+#endif//__RING_BUFFER_HPP
@@ -0,0 +1,32 @@
+#ifndef __SCALING_HPP
+#define __SCALING_HPP
+
+// Options for the domain decomposition benchmark. A cloth falling onto the
+// floor is split into 1, 2, 4, ... domains by recursive coordinate
+// bisection, each domain is stepped by a process of its own, forked from
+// this one, and halos are exchanged through shared memory after every
+// step. The report lists the throughput, the speedup and parallel
+// efficiency over one process, and the halo traffic of each run, and
+// checks that the final state is bitwise the serial one.
+//
+//     Springs --domains 500 --lattice 512 --processes 16
+//
+// The exit code is non-zero if a run differs from the serial step.
+struct ScalingOptions
+{
+        ScalingOptions();
+
+        int steps;
+        int lattice;            // Particles along each side of the cloth
+        float dt;
+        int processes;          // Largest process count
+        int ring;               // Kilobytes per shared memory ring
+};
+
+// Returns true if the arguments ask for the benchmark
+bool parseScalingOptions(int argc, char** argv, ScalingOptions& options);
+
+// Runs the benchmark, returns the exit code
+int runScaling(ScalingOptions const& options);
+
+#endif//__SCALING_HPP
@@ -5,13 +5,30 @@
 #include <atlas/core/Log.hpp>
 
 #include "Camera.hpp"
+#include "Collision.hpp"
+#include "ControlServer.hpp"
 #include "Grid.hpp"
+#include "ForceField.hpp"
+#include "Islands.hpp"
+#include "LodCloth.hpp"
+#include "SimulationThread.hpp"
 #include "Spring.hpp"
+#include "SpringMesh.hpp"
+#include "SpringSystem.hpp"
+#include "TetMesh.hpp"
+#include "Topology.hpp"
+#include "TripleBuffer.hpp"
 
+#include <memory>
+
+// The spring scenes step their physics on a SimulationThread at 1 kHz and
+// draw the latest published snapshot. Unthreaded, the physics is stepped
+// from updateScene instead, which offscreen rendering uses to get the same
+// frames on every run.
 class LinearScene : public atlas::utils::Scene
 {
         public:
-                LinearScene();
+                LinearScene(bool threaded = true, std::string const& control = "");
                 ~LinearScene();
 
                 // Event Handlers
@@ -25,21 +42,31 @@ class LinearScene : public atlas::utils::Scene
                 void renderScene() override;
 
         private:
+                void publish();
 
                 bool mDragging;
                 bool mPaused;
-                bool mPrevTime;
+                bool mThreaded;
+                bool mColliding;
+                double mPrevTime;
 
                 Camera mCamera;
                 Grid mGrid;
                 Spring mSpring;
 
+                // The floor under the grid, shared with the physics thread
+                std::shared_ptr<CollisionWorld> mColliders;
+
+                TripleBuffer<SpringPoints> mSnapshots;
+                // Last, so that it stops before anything it steps goes away
+                SimulationThread mSimulation;
+                std::unique_ptr<ControlServer> mControl;
 };
 
 class AngularScene : public atlas::utils::Scene
 {
         public:
-                AngularScene();
+                AngularScene(bool threaded = true, std::string const& control = "");
                 ~AngularScene();
 
                 // Events
@@ -52,13 +79,123 @@ class AngularScene : public atlas::utils::Scene
                 void updateScene(double time) override;
                 void renderScene() override;
         private:
+                void publish();
+
                 bool mDragging;
                 bool mPaused;
-                bool mPrevTime;
+                bool mThreaded;
+                double mPrevTime;
 
                 Camera mCamera;
                 Grid mGrid;
                 AngularSpring mSpring;
+
+                TripleBuffer<SpringPoints> mSnapshots;
+                SimulationThread mSimulation;
+                std::unique_ptr<ControlServer> mControl;
+};
+
+class SoftBodyScene : public atlas::utils::Scene
+{
+        public:
+                SoftBodyScene();
+                ~SoftBodyScene();
+
+                // Events
+                void mousePressEvent(int b, int a, int m, double x, double y) override;
+                void mouseMoveEvent(double x, double y) override;
+                void scrollEvent(double x, double y) override;
+                void keyPressEvent(int key, int scancode, int action, int modes) override;
+
+                // Rendering
+                void updateScene(double time) override;
+                void renderScene() override;
+        private:
+                void buildSystem();
+                void uploadSprings();
+                void checkEnergy();
+
+                bool mDragging;
+                bool mPaused;
+                float mAccumulator;
+                TetMesh::Mode mMode;
+
+                // Pauses the beam if it blows up. Rearmed after edits that
+                // change its energy.
+                EnergyGuard mGuard;
+                double mGuardScale;
+                bool mGuardArmed;
+
+                size_t mTip;
+                size_t mWeight;
+                size_t mWeightSpring;   // The only spring, so compaction keeps it in place
+                size_t mTetIndexCount;
+
+                Camera mCamera;
+                Grid mGrid;
+                SpringMesh mMesh;
+
+                std::unique_ptr<SpringSystem> mSystem;
+                std::shared_ptr<TetMesh> mTets;
+                std::unique_ptr<SpringTopology> mTopology;
+                IslandManager mIslands;
+                std::vector<unsigned int> mAwakeSprings;
+};
+
+class ClothScene : public atlas::utils::Scene
+{
+        public:
+                ClothScene();
+                ~ClothScene();
+
+                // Events
+                void mousePressEvent(int b, int a, int m, double x, double y) override;
+                void mouseMoveEvent(double x, double y) override;
+                void scrollEvent(double x, double y) override;
+                void keyPressEvent(int key, int scancode, int action, int modes) override;
+
+                // Rendering
+                void updateScene(double time) override;
+                void renderScene() override;
+        private:
+                void buildCloth();
+                void buildColliders();
+                void moveColliders(float dt);
+                void uploadOutlines();
+                void checkEnergy();
+
+                bool mDragging;
+                bool mPaused;
+                bool mWindy;
+                bool mColliding;
+                float mAccumulator;
+                float mColliderTime;
+
+                // Watches the proxy, which is always stepped in full
+                EnergyGuard mGuard;
+                double mGuardScale;
+                bool mGuardArmed;
+
+                Camera mCamera;
+                Grid mGrid;
+                SpringMesh mMesh;
+                SpringMesh mOutlines;
+
+                // A floor, a swinging bar and a turning pyramid, shared by
+                // both levels of the cloth
+                std::shared_ptr<CollisionWorld> mColliders;
+                std::shared_ptr<CapsuleCollider> mBar;
+                std::shared_ptr<MeshCollider> mPyramid;
+                std::vector<Vec3> mOutlineLines;
+                std::vector<float> mOutlinePositions;
+
+                std::unique_ptr<LodCloth> mCloth;
+
+                // Both levels of the cloth share the same fields
+                std::shared_ptr<UniformWind> mBreeze;
+                std::shared_ptr<NoiseWind> mGusts;
+                std::shared_ptr<WindForce> mCoarseWind;
+                std::shared_ptr<WindForce> mFineWind;
 };
 
 #endif//__SCENE_HPP
@@ -0,0 +1,77 @@
+#ifndef __SHARED_MEMORY_TRANSPORT_HPP
+#define __SHARED_MEMORY_TRANSPORT_HPP
+
+#include "HaloTransport.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Halo exchange between processes on one host through a POSIX shared
+// memory segment. The segment holds a barrier and a single producer,
+// single consumer byte ring for every ordered pair of ranks, so a message
+// is one copy into the ring and one copy out, with no system call on the
+// way. Messages longer than a ring are streamed through it. Waiting spins
+// with a yield, which suits ranks that each have a core to themselves.
+// A rank that finds a peer gone aborts the segment, which ends the waits
+// of every rank.
+//
+// The segment is either created before forking the ranks, which then call
+// setRank, or created by one process and attached to by name by the rest.
+class SharedMemoryTransport : public HaloTransport
+{
+        public:
+                SharedMemoryTransport();
+                ~SharedMemoryTransport();
+
+                // Creates the segment for size ranks with rings of capacity
+                // bytes and takes rank zero. The name starts with a slash.
+                bool create(std::string const& name, int size, size_t capacity);
+                bool attach(std::string const& name, int rank);
+
+                // Removes the name; mappings already made stay valid
+                void unlink();
+
+                void setRank(int rank) { mRank = rank; }
+
+                // Asked every so often while this rank waits; once it
+                // returns false the transport aborts
+                void setLiveness(std::function<bool()> alive) { mAlive = alive; }
+
+                // Once any rank aborts, exchange and barrier return at once
+                // on every rank, whether they are done or not
+                void abort();
+                bool aborted() const;
+
+                int rank() const override { return mRank; }
+                int size() const override { return mSize; }
+                void exchange(std::vector<Buffer> const& sends,
+                                std::vector<Buffer> const& receives) override;
+                void barrier() override;
+
+                // Bytes this rank has sent since it was set up
+                std::uint64_t bytesSent() const { return mBytesSent; }
+
+        private:
+                struct Header;
+                struct Ring;
+
+                bool map(int fd, size_t bytes);
+                bool keepWaiting();
+                Ring& ring(int from, int to) const;
+                unsigned char* ringData(Ring& ring) const;
+
+                std::string mName;
+                unsigned char* mBase;
+                size_t mBytes;
+                Header* mHeader;
+                int mRank;
+                int mSize;
+                size_t mCapacity;
+                size_t mStride;
+                std::uint64_t mBytesSent;
+                std::function<bool()> mAlive;
+                unsigned int mIdle;
+};
+
+#endif//__SHARED_MEMORY_TRANSPORT_HPP
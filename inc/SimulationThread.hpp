@@ -0,0 +1,79 @@
+#ifndef __SIMULATION_THREAD_HPP
+#define __SIMULATION_THREAD_HPP
+
+#include "CommandQueue.hpp"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// Steps a simulation at a fixed rate, normally on a thread of its own so
+// that stalls in rendering or buffer swaps do not hold physics back.
+//
+// Edits from other threads are posted as commands and run between steps.
+// After every step, and after commands when paused, the publish callback
+// runs so the owner can hand a snapshot to the renderer, typically through
+// a TripleBuffer.
+//
+// Without start() nothing runs by itself and the owner drives the steps
+// from advance() on its own thread, which keeps batch and offscreen runs
+// deterministic.
+class SimulationThread
+{
+        public:
+                typedef std::function<void(float)> StepFunction;
+                typedef std::function<void()> PublishFunction;
+                // Called after every step with the step count and the time
+                // the step took, on the stepping thread
+                typedef std::function<void(unsigned long long, double)> StepObserver;
+
+                SimulationThread(StepFunction step, PublishFunction publish,
+                                double rate = 1000.0);
+                ~SimulationThread();
+
+                void start();
+                void stop();
+                bool isRunning() const { return mThread.joinable(); }
+
+                // Run the steps covering the given span of time on the calling
+                // thread. Only valid while the thread is not running.
+                void advance(double seconds);
+
+                // Returns false if the queue is full
+                bool post(CommandQueue::Command command);
+
+                void setPaused(bool paused) { mPaused.store(paused); }
+                bool isPaused() const { return mPaused.load(); }
+
+                // Run this many extra steps at the next opportunity, also
+                // while paused
+                void requestSteps(unsigned int steps) { mRequested.fetch_add(steps); }
+
+                // Only while the thread is not running, steps are only timed
+                // when set
+                void setObserver(StepObserver observer) { mObserver = observer; }
+
+                double rate() const { return mRate; }
+                unsigned long long steps() const { return mSteps.load(std::memory_order_relaxed); }
+
+        private:
+                void run();
+                bool runCommands();
+                void stepOnce(float dt);
+                bool runRequested(float dt);
+
+                StepFunction mStep;
+                PublishFunction mPublish;
+                StepObserver mObserver;
+                double mRate;
+                double mCarry;
+
+                CommandQueue mCommands;
+                std::thread mThread;
+                std::atomic<bool> mRunning;
+                std::atomic<bool> mPaused;
+                std::atomic<unsigned long long> mSteps;
+                std::atomic<unsigned int> mRequested;
+};
+
+#endif//__SIMULATION_THREAD_HPP
@@ -6,12 +6,23 @@
 #include <glm/vec2.hpp>
 
 #include <array>
+#include <memory>
 #include <vector>
 #include <cmath>
 
 #include "ShaderPaths.hpp"
+#include "Tunable.hpp"
 
-class Spring : public atlas::utils::Geometry
+class CollisionWorld;
+
+// End points of a spring as they are sent to the GPU
+typedef std::array<atlas::math::Vector, 2> SpringPoints;
+
+// The physics and the drawing of the springs are kept apart so that the
+// physics can run on a simulation thread: simulate, reset and the change
+// functions never touch GL, uploadPoints and the Geometry overrides are
+// for the render thread only.
+class Spring : public atlas::utils::Geometry, public Tunable
 {
         public:
                 Spring();
@@ -23,10 +34,31 @@ class Spring : public atlas::utils::Geometry
 
                 void resetGeometry() override;
 
+                void simulate(float dt);
+                void reset() override;
+                SpringPoints const& points() const { return mPoints; }
+                void uploadPoints(SpringPoints const& points);
+
                 void moveFixed(atlas::math::Vector);
 
-                void changeLength(float l) { mLength *= l; }
-                void changeMass(float m) { mMass[1] += m; }
+                // The bob is swept against these after every step, null
+                // lets it swing through everything
+                void setColliders(std::shared_ptr<CollisionWorld> colliders) { mColliders = colliders; wake(); }
+
+                void changeLength(float l) { mLength *= l; wake(); }
+                void changeMass(float m) { mMass[1] += m; wake(); }
+
+                // k, damping, mass and length
+                bool setParameter(std::string const& name, float value) override;
+                void parameters(std::vector<Parameter>& out) const override;
+                double energy() const override;
+
+                Observables const& observables() const override { return mObservables; }
+                ObservableSeries const& series() const override { return mSeries; }
+
+                // Sleeps once the mass has come to rest, any change wakes it
+                void wake() override { mAsleep = false; mStillSteps = 0; }
+                bool isAsleep() const { return mAsleep; }
 
         private:
 
@@ -40,13 +72,20 @@ class Spring : public atlas::utils::Geometry
                 float mK;
 
                 bool mPaused;
+                bool mAsleep;
+                int mStillSteps;
+
+                std::shared_ptr<CollisionWorld> mColliders;
+
+                Observables mObservables;
+                ObservableSeries mSeries;
 
                 GLuint mVao;
                 GLuint mVbo;
 };
 
 
-class AngularSpring : public atlas::utils::Geometry
+class AngularSpring : public atlas::utils::Geometry, public Tunable
 {
         public:
                 AngularSpring();
@@ -56,17 +95,37 @@ class AngularSpring : public atlas::utils::Geometry
                 void renderGeometry(atlas::math::Matrix4 proj,
                                 atlas::math::Matrix4 view) override;
 
-                void stepGeometry(atlas::utils::Time const& t);
-
                 void resetGeometry() override;
 
+                // The rod's angles in time units where 0.5 is one frame
+                void simulate(float dt);
+                void reset() override;
+                SpringPoints points() const;
+                void uploadPoints(SpringPoints const& points);
+
                 // The vector is in degrees
                 void changeRest(glm::vec3 d);
-                void changeMass(float mass) { mMass += mass; }
-                void changeK(float k) { mK += k; }
+                void changeMass(float mass) { mMass += mass; wake(); }
+                void changeK(float k) { mK += k; wake(); }
+
+                // k, damping, mass, length, and the rest angles theta and
+                // phi in degrees
+                bool setParameter(std::string const& name, float value) override;
+                void parameters(std::vector<Parameter>& out) const override;
+                double energy() const override;
+
+                // Energy, momenta and strain are those of the two angles,
+                // the strain being the angle to the rest position
+                Observables const& observables() const override { return mObservables; }
+                ObservableSeries const& series() const override { return mSeries; }
+
+                void wake() override { mAsleep = false; mStillSteps = 0; }
+                bool isAsleep() const { return mAsleep; }
 
         private:
                 bool mPaused;
+                bool mAsleep;
+                int mStillSteps;
                 float mLength;  // Length of the stick
                 float mDampen;
                 float mK;
@@ -77,6 +136,9 @@ class AngularSpring : public atlas::utils::Geometry
                 glm::vec2 mVelocity;
                 glm::vec2 mPosition;
 
+                Observables mObservables;
+                ObservableSeries mSeries;
+
                 GLuint mVao;
                 GLuint mVbo;
 };
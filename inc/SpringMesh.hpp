@@ -0,0 +1,47 @@
+#ifndef __SPRING_MESH_HPP
+#define __SPRING_MESH_HPP
+
+#include <atlas/utils/Geometry.hpp>
+
+#include <vector>
+
+#include "ShaderPaths.hpp"
+#include "SpringSystem.hpp"
+
+// Draws the edges of a particle network (springs, element edges) as lines
+class SpringMesh : public atlas::utils::Geometry
+{
+        public:
+                SpringMesh();
+                ~SpringMesh();
+
+                // Pairs of particle indices
+                void setEdges(std::vector<unsigned int> const& edges);
+
+                // Overwrite count indices starting at offset, growing the
+                // buffer if needed, and set how many indices are drawn
+                void updateEdges(size_t offset, unsigned int const* edges, size_t count);
+                void setEdgeCount(size_t count);
+                void updatePositions(ParticleSet const& particles);
+
+                // Interleaved xyz positions
+                void updatePositions(std::vector<float> const& positions);
+
+                void renderGeometry(atlas::math::Matrix4 proj,
+                                atlas::math::Matrix4 view) override;
+
+        private:
+                void uploadPositions();
+
+                GLuint mVao;
+                GLuint mVbo;
+                GLuint mEbo;
+
+                size_t mIndexCount;
+                size_t mIndexCapacity;
+                size_t mVertexCapacity;
+                std::vector<float> mVertices;
+                std::vector<unsigned int> mIndices;
+};
+
+#endif//__SPRING_MESH_HPP
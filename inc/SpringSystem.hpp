@@ -0,0 +1,238 @@
+#ifndef __SPRING_SYSTEM_HPP
+#define __SPRING_SYSTEM_HPP
+
+#include "Observables.hpp"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class CollisionWorld;
+
+// The engine is templated on two scalar types: Real for the stored state
+// (velocities, masses, spring parameters) and Accum for the quantities
+// that are summed over and over (positions and forces), where rounding
+// builds up. The instantiations are
+//
+//     float, float     SpringSystem        real time, widest SIMD
+//     double, double   SpringSystemDouble  long runs
+//     float, double    SpringSystemMixed   float storage, double sums
+//
+// BasicTetMesh follows the same scheme. The wind, islands, the LOD cloth
+// and the single spring models are float only. Collisions work with any
+// of the particle sets, but the sweep itself is done in float.
+
+// Particle state stored as a structure of arrays so that the force and
+// integration passes stream through contiguous memory.
+template <typename Real, typename Accum = Real>
+struct BasicParticleSet
+{
+        typedef Real RealType;
+        typedef Accum AccumType;
+
+        std::vector<Accum> x, y, z;
+        std::vector<Real> vx, vy, vz;
+        std::vector<Accum> fx, fy, fz;
+        std::vector<Real> invMass;      // Zero for fixed particles
+
+        size_t size() const { return x.size(); }
+
+        // A mass of zero pins the particle in place
+        size_t add(Accum px, Accum py, Accum pz, Real mass);
+        void setMass(size_t i, Real mass);
+        void clearForces();
+};
+
+// Anything that contributes forces to a particle set. Element types share
+// the particle storage and the integrator of the SpringSystem they are
+// attached to.
+template <typename Real, typename Accum = Real>
+class BasicForceModel
+{
+        public:
+                virtual ~BasicForceModel() { }
+                virtual void addForces(BasicParticleSet<Real, Accum>& particles) = 0;
+
+                // Models made of small elements (tetrahedra, triangles) can
+                // be evaluated on part of a network, so that stepping a few
+                // particles costs only their share. Models that report no
+                // elements are always evaluated in full.
+                virtual size_t elementCount() const { return 0; }
+                virtual void elementParticles(size_t, std::vector<unsigned int>& out) const { out.clear(); }
+
+                // Per particle terms on the active particles, and the listed
+                // elements. Forces also land on the other particles of those
+                // elements.
+                virtual void addForces(BasicParticleSet<Real, Accum>& particles,
+                                std::vector<unsigned int> const& /* active */,
+                                std::vector<unsigned int> const& /* elements */)
+                { addForces(particles); }
+};
+
+// Damped Hookean springs, also stored as a structure of arrays
+template <typename Real, typename Accum = Real>
+struct BasicSpringSet : public BasicForceModel<Real, Accum>
+{
+        typedef BasicParticleSet<Real, Accum> Particles;
+
+        std::vector<unsigned int> a, b;
+        std::vector<Real> rest;
+        std::vector<Real> k;
+        std::vector<Real> damping;
+
+        size_t size() const { return a.size(); }
+        size_t add(unsigned int i, unsigned int j, Real rest, Real k, Real damping);
+        void resize(size_t n);
+
+        void addForces(Particles& particles) override;
+        void addForces(Particles& particles, size_t begin, size_t end);
+        void addForces(Particles& particles, std::vector<unsigned int> const& springs);
+
+        // Also add the energy stored in the springs to the potential of
+        // observables, and raise its strain to the largest among them
+        void addForces(Particles& particles, size_t begin, size_t end, Observables& observables);
+        void addForces(Particles& particles, std::vector<unsigned int> const& springs,
+                        Observables& observables);
+
+        // Writes the force on the a end of each spring in [begin, end) to
+        // index s of fx, fy and fz instead of accumulating it; the b end
+        // takes the opposite
+        void springForces(Particles const& particles, size_t begin, size_t end,
+                        Accum* fx, Accum* fy, Accum* fz) const;
+};
+
+template <typename Real, typename Accum = Real>
+class BasicSpringSystem
+{
+        public:
+                typedef BasicParticleSet<Real, Accum> Particles;
+                typedef BasicSpringSet<Real, Accum> Springs;
+                typedef BasicForceModel<Real, Accum> Model;
+
+                BasicSpringSystem();
+
+                size_t addParticle(Accum x, Accum y, Accum z, Real mass);
+
+                // The rest length is the current distance between the two
+                size_t addSpring(size_t i, size_t j, Real k, Real damping);
+
+                void addForceModel(std::shared_ptr<Model> model);
+                std::vector<std::shared_ptr<Model>> const& forceModels() const
+                { return mModels; }
+
+                // Parameter edits. The particles they touch are recorded so
+                // that sleeping parts of the network can be woken up.
+                void moveParticle(size_t i, Accum dx, Accum dy, Accum dz);
+                void setRestLength(size_t s, Real rest);
+                void setStiffness(size_t s, Real k);
+                void touch(size_t particle) { mTouched.push_back(static_cast<unsigned int>(particle)); }
+
+                // Hands over the particles touched since the last call
+                void takeTouched(std::vector<unsigned int>& touched);
+
+                // Code that inserts or removes springs at runtime, leaving
+                // the others in their slots, logs each edit with the ends
+                // the spring had, for caches that can follow it in place.
+                // Log a removal before the slot is cleared.
+                struct SpringEdit
+                {
+                        unsigned int spring;
+                        unsigned int a, b;
+                        bool inserted;
+                };
+                void springInserted(size_t s);
+                void springRemoved(size_t s);
+                void takeSpringEdits(std::vector<SpringEdit>& edits);
+
+                // The topology version is bumped by every spring edit, so
+                // that cached spring lists can be dropped. topologyChanged
+                // is for anything else, like moving springs between slots:
+                // it also bumps the layout version and drops the log, and
+                // caches following the log rebuild.
+                void topologyChanged();
+                unsigned int topologyVersion() const { return mTopologyVersion; }
+                unsigned int layoutVersion() const { return mLayoutVersion; }
+
+                void setGravity(Real x, Real y, Real z) { mGravity = {{x, y, z}}; }
+                void setDamping(Real d) { mDamping = d; }
+
+                // Integrated particles are swept against the colliders at
+                // the end of every step. Null turns collisions off.
+                void setColliders(std::shared_ptr<CollisionWorld> colliders) { mColliders = colliders; }
+                std::shared_ptr<CollisionWorld> const& colliders() const { return mColliders; }
+
+                // Semi-implicit Euler over every particle
+                void step(Real dt);
+
+                void computeForces();
+                void integrate(Real dt, size_t begin, size_t end);
+                void integrate(Real dt, std::vector<unsigned int> const& particles);
+
+                // While observing, the spring pass of computeForces and
+                // both integrate passes add what they measure along the way
+                // to observables(), and step starts and finishes it. Code
+                // that calls the passes itself does the same. Off by
+                // default.
+                void setObserving(bool observing) { mObserving = observing; }
+                bool observing() const { return mObserving; }
+                Observables& observables() { return mObservables; }
+                Observables const& observables() const { return mObservables; }
+
+                // Diagnostics, always summed in double. The energy counts
+                // the kinetic energy, the springs and gravity, but not any
+                // extra force models. Fixed particles are left out of the
+                // momentum. Each is a separate pass over the state; the
+                // observables above cover the same terms for free.
+                double kineticEnergy() const;
+                double potentialEnergy() const;
+                double energy() const { return kineticEnergy() + potentialEnergy(); }
+                std::array<double, 3> momentum() const;
+
+                Particles& particles() { return mParticles; }
+                Particles const& particles() const { return mParticles; }
+                Springs& springs() { return mSprings; }
+                Springs const& springs() const { return mSprings; }
+
+                std::array<Real, 3> const& gravity() const { return mGravity; }
+                Real damping() const { return mDamping; }
+
+        private:
+                Particles mParticles;
+                Springs mSprings;
+                std::vector<std::shared_ptr<Model>> mModels;
+                std::vector<unsigned int> mTouched;
+                std::vector<SpringEdit> mSpringEdits;
+                std::shared_ptr<CollisionWorld> mColliders;
+
+                std::array<Real, 3> mGravity;
+                Real mDamping;
+                unsigned int mTopologyVersion;
+                unsigned int mLayoutVersion;
+
+                bool mObserving;
+                Observables mObservables;
+};
+
+typedef BasicParticleSet<float> ParticleSet;
+typedef BasicForceModel<float> ForceModel;
+typedef BasicSpringSet<float> SpringSet;
+typedef BasicSpringSystem<float> SpringSystem;
+
+typedef BasicSpringSystem<double> SpringSystemDouble;
+typedef BasicSpringSystem<float, double> SpringSystemMixed;
+
+// The cloth scene's material, for the command line modes that drop a cloth
+const float kClothSpacing = 0.125f;
+const float kClothMass = 0.005f;
+const float kClothStiffness = 200.f;
+const float kClothDamping = 0.05f;
+
+// An n x n cloth lying flat at clothHeight(n), pinned along its first row
+// so that it swings down and drapes over a floor at zero. Particles are
+// laid out i fastest, then j; every particle has springs to its right and
+// lower neighbours and crossed springs over each square.
+inline float clothHeight(int n) { return 0.5f * kClothSpacing * (n - 1); }
+void buildCloth(SpringSystem& system, int n);
+
+#endif//__SPRING_SYSTEM_HPP
@@ -0,0 +1,350 @@
+#ifndef __STATIC_SPRING_SYSTEM_HPP
+#define __STATIC_SPRING_SYSTEM_HPP
+
+#include "SpringSystem.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+// Added to every squared spring length. A zero length spring then has
+// d = 0 and so no force, as in the generic kernel, without a branch that
+// would keep the loops from vectorizing.
+static const float kLengthEpsilon = 1e-30f;
+
+// A spring system whose size is fixed at compile time. It follows the same
+// model as SpringSystem (damped Hookean springs, semi-implicit Euler,
+// gravity only on free particles), but every loop has a constant trip count
+// and the state lives in fixed arrays, so the compiler unrolls the step and
+// a system of a few particles needs no heap memory at all. Meant for large
+// parameter sweeps over small systems such as a single spring or a short
+// chain.
+template <size_t NParticles, size_t NSprings>
+struct StaticSpringSystem
+{
+        typedef std::array<float, NParticles> ParticleArray;
+        typedef std::array<float, NSprings> SpringArray;
+
+        static constexpr size_t particleCount() { return NParticles; }
+        static constexpr size_t springCount() { return NSprings; }
+
+        StaticSpringSystem() :
+                gx(0.f), gy(-9.81f), gz(0.f),
+                drag(0.f)
+        {
+                x.fill(0.f); y.fill(0.f); z.fill(0.f);
+                vx.fill(0.f); vy.fill(0.f); vz.fill(0.f);
+                invMass.fill(0.f);
+                a.fill(0); b.fill(0);
+                rest.fill(0.f); k.fill(0.f); damping.fill(0.f);
+        }
+
+        // A mass of zero pins the particle in place
+        void setParticle(size_t i, float px, float py, float pz, float mass)
+        {
+                x[i] = px;
+                y[i] = py;
+                z[i] = pz;
+                vx[i] = vy[i] = vz[i] = 0.f;
+                invMass[i] = mass > 0.f ? 1.f / mass : 0.f;
+        }
+
+        // The rest length is the current distance between the two
+        void setSpring(size_t s, unsigned int i, unsigned int j, float stiffness, float d)
+        {
+                const float dx = x[j] - x[i];
+                const float dy = y[j] - y[i];
+                const float dz = z[j] - z[i];
+                a[s] = i;
+                b[s] = j;
+                rest[s] = std::sqrt(dx * dx + dy * dy + dz * dz);
+                k[s] = stiffness;
+                damping[s] = d;
+        }
+
+        void setGravity(float ux, float uy, float uz) { gx = ux; gy = uy; gz = uz; }
+        void setDamping(float d) { drag = d; }
+
+        void computeForces(ParticleArray& fx, ParticleArray& fy, ParticleArray& fz) const
+        {
+                fx.fill(0.f);
+                fy.fill(0.f);
+                fz.fill(0.f);
+                for(size_t s = 0; s < NSprings; ++s)
+                {
+                        const unsigned int i = a[s];
+                        const unsigned int j = b[s];
+                        const float dx = x[j] - x[i];
+                        const float dy = y[j] - y[i];
+                        const float dz = z[j] - z[i];
+                        const float length = std::sqrt(dx * dx + dy * dy + dz * dz + kLengthEpsilon);
+                        const float inv = 1.f / length;
+                        const float nx = dx * inv;
+                        const float ny = dy * inv;
+                        const float nz = dz * inv;
+                        const float dv = (vx[j] - vx[i]) * nx +
+                                (vy[j] - vy[i]) * ny +
+                                (vz[j] - vz[i]) * nz;
+                        const float f = k[s] * (length - rest[s]) + damping[s] * dv;
+                        fx[i] += f * nx;
+                        fy[i] += f * ny;
+                        fz[i] += f * nz;
+                        fx[j] -= f * nx;
+                        fy[j] -= f * ny;
+                        fz[j] -= f * nz;
+                }
+        }
+
+        void step(float dt)
+        {
+                // Forces are scratch, kept on the stack rather than in the
+                // system so sweeps only store the state
+                ParticleArray fx, fy, fz;
+                computeForces(fx, fy, fz);
+                for(size_t i = 0; i < NParticles; ++i)
+                {
+                        const float w = invMass[i];
+                        const float g = w > 0.f ? 1.f : 0.f;
+                        vx[i] += dt * (w * (fx[i] - drag * vx[i]) + g * gx);
+                        vy[i] += dt * (w * (fy[i] - drag * vy[i]) + g * gy);
+                        vz[i] += dt * (w * (fz[i] - drag * vz[i]) + g * gz);
+                        x[i] += dt * vx[i];
+                        y[i] += dt * vy[i];
+                        z[i] += dt * vz[i];
+                }
+        }
+
+        // The equivalent generic system, for checking and comparison
+        void copyTo(SpringSystem& system) const
+        {
+                for(size_t i = 0; i < NParticles; ++i)
+                {
+                        const size_t p = system.addParticle(x[i], y[i], z[i], 0.f);
+                        ParticleSet& particles = system.particles();
+                        particles.invMass[p] = invMass[i];
+                        particles.vx[p] = vx[i];
+                        particles.vy[p] = vy[i];
+                        particles.vz[p] = vz[i];
+                }
+                for(size_t s = 0; s < NSprings; ++s)
+                        system.springs().add(a[s], b[s], rest[s], k[s], damping[s]);
+                system.setGravity(gx, gy, gz);
+                system.setDamping(drag);
+        }
+
+        ParticleArray x, y, z;
+        ParticleArray vx, vy, vz;
+        ParticleArray invMass;
+
+        std::array<unsigned int, NSprings> a, b;
+        SpringArray rest;
+        SpringArray k;
+        SpringArray damping;
+
+        float gx, gy, gz;
+        float drag;
+};
+
+// Lanes copies of a system with the same topology stepped in lockstep, one
+// lane per system. Every array is indexed [particle or spring][lane], so the
+// innermost loops run across the lanes with unit stride and vectorize, and
+// the independent lanes hide the latency of the square root and divide
+// that a single small system waits on every step. The parameters may
+// differ per lane, which is what a sweep needs.
+template <size_t NParticles, size_t NSprings, size_t Lanes>
+struct StaticSpringBatch
+{
+        typedef std::array<float, Lanes> Lane;
+        typedef StaticSpringSystem<NParticles, NSprings> System;
+
+        // Per lane counterpart of Observables, filled in by step
+        struct LaneObservables
+        {
+                Lane kinetic;
+                Lane potential;         // Springs and gravity
+                Lane px, py, pz;        // Momentum
+                Lane lx, ly, lz;        // Angular momentum about the origin
+                Lane strain;            // Largest |length - rest| / rest
+        };
+
+        StaticSpringBatch() :
+                gx(0.f), gy(-9.81f), gz(0.f),
+                drag(0.f)
+        { }
+
+        // Copies one system into a lane. The topology, gravity and drag
+        // are taken from the system loaded into lane 0.
+        void load(size_t lane, System const& system)
+        {
+                for(size_t i = 0; i < NParticles; ++i)
+                {
+                        x[i][lane] = system.x[i];
+                        y[i][lane] = system.y[i];
+                        z[i][lane] = system.z[i];
+                        vx[i][lane] = system.vx[i];
+                        vy[i][lane] = system.vy[i];
+                        vz[i][lane] = system.vz[i];
+                        invMass[i][lane] = system.invMass[i];
+                        mass[i][lane] = system.invMass[i] > 0.f ? 1.f / system.invMass[i] : 0.f;
+                }
+                for(size_t s = 0; s < NSprings; ++s)
+                {
+                        rest[s][lane] = system.rest[s];
+                        invRest[s][lane] = system.rest[s] > 0.f ? 1.f / system.rest[s] : 0.f;
+                        k[s][lane] = system.k[s];
+                        damping[s][lane] = system.damping[s];
+                }
+                if(lane != 0) return;
+                a = system.a;
+                b = system.b;
+                gx = system.gx;
+                gy = system.gy;
+                gz = system.gz;
+                drag = system.drag;
+        }
+
+        void step(float dt)
+        {
+                advance<false>(dt, nullptr);
+        }
+
+        // Also measures every lane while stepping. Pinned particles count
+        // as having no mass, so they carry no energy or momentum.
+        void step(float dt, LaneObservables& observables)
+        {
+                advance<true>(dt, &observables);
+        }
+
+        template <bool Observe>
+        void advance(float dt, LaneObservables* observables)
+        {
+                // Only written when observing, the compiler drops the rest
+                Lane kinetic, potential, px, py, pz, lx, ly, lz, strain;
+                if(Observe)
+                {
+                        kinetic.fill(0.f); potential.fill(0.f); strain.fill(0.f);
+                        px.fill(0.f); py.fill(0.f); pz.fill(0.f);
+                        lx.fill(0.f); ly.fill(0.f); lz.fill(0.f);
+                }
+
+                std::array<Lane, NParticles> fx, fy, fz;
+                for(size_t i = 0; i < NParticles; ++i)
+                {
+                        fx[i].fill(0.f);
+                        fy[i].fill(0.f);
+                        fz[i].fill(0.f);
+                }
+
+                for(size_t s = 0; s < NSprings; ++s)
+                {
+                        const unsigned int i = a[s];
+                        const unsigned int j = b[s];
+                        for(size_t l = 0; l < Lanes; ++l)
+                        {
+                                const float dx = x[j][l] - x[i][l];
+                                const float dy = y[j][l] - y[i][l];
+                                const float dz = z[j][l] - z[i][l];
+                                const float length = std::sqrt(dx * dx + dy * dy + dz * dz +
+                                                kLengthEpsilon);
+                                const float inv = 1.f / length;
+                                const float nx = dx * inv;
+                                const float ny = dy * inv;
+                                const float nz = dz * inv;
+                                const float dv = (vx[j][l] - vx[i][l]) * nx +
+                                        (vy[j][l] - vy[i][l]) * ny +
+                                        (vz[j][l] - vz[i][l]) * nz;
+                                const float stretch = length - rest[s][l];
+                                const float f = k[s][l] * stretch + damping[s][l] * dv;
+                                fx[i][l] += f * nx;
+                                fy[i][l] += f * ny;
+                                fz[i][l] += f * nz;
+                                fx[j][l] -= f * nx;
+                                fy[j][l] -= f * ny;
+                                fz[j][l] -= f * nz;
+                                if(Observe)
+                                {
+                                        potential[l] += 0.5f * k[s][l] * stretch * stretch;
+                                        const float e = std::fabs(stretch) * invRest[s][l];
+                                        strain[l] = e > strain[l] ? e : strain[l];
+                                }
+                        }
+                }
+
+                for(size_t i = 0; i < NParticles; ++i)
+                {
+                        for(size_t l = 0; l < Lanes; ++l)
+                        {
+                                const float w = invMass[i][l];
+                                const float g = w > 0.f ? 1.f : 0.f;
+                                vx[i][l] += dt * (w * (fx[i][l] - drag * vx[i][l]) + g * gx);
+                                vy[i][l] += dt * (w * (fy[i][l] - drag * vy[i][l]) + g * gy);
+                                vz[i][l] += dt * (w * (fz[i][l] - drag * vz[i][l]) + g * gz);
+                                if(Observe)
+                                {
+                                        // Gravity's potential before the move,
+                                        // the momenta after the kick
+                                        const float m = mass[i][l];
+                                        const float mx = m * vx[i][l];
+                                        const float my = m * vy[i][l];
+                                        const float mz = m * vz[i][l];
+                                        potential[l] -= m * (gx * x[i][l] + gy * y[i][l] + gz * z[i][l]);
+                                        kinetic[l] += 0.5f * (mx * vx[i][l] + my * vy[i][l] + mz * vz[i][l]);
+                                        px[l] += mx;
+                                        py[l] += my;
+                                        pz[l] += mz;
+                                        lx[l] += y[i][l] * mz - z[i][l] * my;
+                                        ly[l] += z[i][l] * mx - x[i][l] * mz;
+                                        lz[l] += x[i][l] * my - y[i][l] * mx;
+                                }
+                                x[i][l] += dt * vx[i][l];
+                                y[i][l] += dt * vy[i][l];
+                                z[i][l] += dt * vz[i][l];
+                        }
+                }
+
+                if(Observe)
+                {
+                        observables->kinetic = kinetic;
+                        observables->potential = potential;
+                        observables->px = px;
+                        observables->py = py;
+                        observables->pz = pz;
+                        observables->lx = lx;
+                        observables->ly = ly;
+                        observables->lz = lz;
+                        observables->strain = strain;
+                }
+        }
+
+        std::array<Lane, NParticles> x, y, z;
+        std::array<Lane, NParticles> vx, vy, vz;
+        std::array<Lane, NParticles> invMass;
+        std::array<Lane, NParticles> mass;      // Zero when pinned
+
+        std::array<unsigned int, NSprings> a, b;
+        std::array<Lane, NSprings> rest;
+        std::array<Lane, NSprings> invRest;
+        std::array<Lane, NSprings> k;
+        std::array<Lane, NSprings> damping;
+
+        float gx, gy, gz;
+        float drag;
+};
+
+// A chain of `Links` springs hanging from a pinned first particle, laid out
+// along x. Links = 1 is the linear spring scene.
+template <size_t Links>
+StaticSpringSystem<Links + 1, Links> makeChain(float length, float mass,
+                float k, float damping)
+{
+        StaticSpringSystem<Links + 1, Links> chain;
+        const float spacing = length / Links;
+        for(size_t i = 0; i <= Links; ++i)
+                chain.setParticle(i, i * spacing, 0.f, 0.f, i == 0 ? 0.f : mass);
+        for(size_t s = 0; s < Links; ++s)
+                chain.setSpring(s, static_cast<unsigned int>(s),
+                                static_cast<unsigned int>(s + 1), k, damping);
+        return chain;
+}
+
+#endif//__STATIC_SPRING_SYSTEM_HPP
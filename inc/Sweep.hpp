@@ -0,0 +1,33 @@
+#ifndef __SWEEP_HPP
+#define __SWEEP_HPP
+
+#include <string>
+
+// Options for a parameter sweep over many small spring chains without any
+// rendering. Filled in from the command line by parseSweepOptions.
+//
+//     Springs --sweep 1000000 --links 4 --steps 2000 --stiffness 10:1000
+struct SweepOptions
+{
+        SweepOptions();
+
+        long systems;           // Chains in the sweep, laid out on a k x damping grid
+        int links;              // Springs per chain: 1, 2, 4, 8 or 16
+        int steps;
+        float dt;
+        float kMin, kMax;
+        float dampingMin, dampingMax;
+        float mass;
+        int threads;            // 0 picks one per core
+        float abort;            // Energy rise that stops a chain as diverged, 0 never
+        bool compare;           // Also time the generic SpringSystem
+        std::string output;     // CSV of the results, empty for none
+};
+
+// Returns true if the arguments ask for a sweep
+bool parseSweepOptions(int argc, char** argv, SweepOptions& options);
+
+// Runs the sweep and prints the throughput, returns the exit code
+int runSweep(SweepOptions const& options);
+
+#endif//__SWEEP_HPP
@@ -0,0 +1,105 @@
+#ifndef __TET_MESH_HPP
+#define __TET_MESH_HPP
+
+#include "SpringSystem.hpp"
+
+#include <array>
+#include <vector>
+
+// Linear or co-rotational tetrahedral finite elements. The particles are
+// shared with the spring network; only the elements live here.
+//
+// Like the engine the elements are templated on Real and Accum. The rest
+// shapes and the per element pass are in Real: the edge vectors are
+// differences of nearby Accum positions, so they lose little when
+// rounded, and the pass keeps the SIMD width of Real. Forces are summed
+// into the particles in Accum.
+//
+// The stress pass is split into a gather, a per element evaluation over
+// structure of arrays and a scatter, so the middle pass has no indirect
+// accesses and can be vectorized. When only some elements are evaluated
+// the gather also packs their rest shapes, so the middle pass stays the
+// same.
+template <typename Real, typename Accum = Real>
+class BasicTetMesh : public BasicForceModel<Real, Accum>
+{
+        public:
+                typedef BasicParticleSet<Real, Accum> Particles;
+
+                enum class Mode
+                {
+                        LINEAR,         // Cheap, but balloons under rotation
+                        COROTATIONAL    // Strain is measured in the rotated frame
+                };
+
+                BasicTetMesh(Real youngsModulus, Real poissonRatio, Mode mode = Mode::COROTATIONAL);
+
+                // The rest shape is taken from the current particle positions
+                size_t addTetrahedron(Particles const& particles,
+                                unsigned int a, unsigned int b,
+                                unsigned int c, unsigned int d);
+
+                void addForces(Particles& particles) override;
+
+                // The elements are tetrahedra; there are no per particle terms
+                size_t elementCount() const override { return size(); }
+                void elementParticles(size_t e, std::vector<unsigned int>& out) const override;
+                void addForces(Particles& particles, std::vector<unsigned int> const& active,
+                                std::vector<unsigned int> const& elements) override;
+
+                size_t size() const { return mVolume.size(); }
+                Real restVolume(size_t e) const { return mVolume[e]; }
+
+                // Each tetrahedron contributes its six edges, for rendering
+                void appendEdges(std::vector<unsigned int>& edges) const;
+
+                void setMode(Mode mode) { mMode = mode; }
+
+        private:
+                // A null list means every element
+                void evaluate(Particles& particles, unsigned int const* elements, size_t count);
+                void gather(Particles const& particles, unsigned int const* elements, size_t count);
+                void evaluateLinear(size_t count);
+                void evaluateCorotational(size_t count);
+                void scatter(Particles& particles, unsigned int const* elements, size_t count);
+
+                Real mMu;
+                Real mLambda;
+                Mode mMode;
+
+                std::array<std::vector<unsigned int>, 4> mNodes;
+
+                // Inverse of the rest shape matrix Dm, row major, one array
+                // per entry
+                std::array<std::vector<Real>, 9> mRestInverse;
+                std::vector<Real> mVolume;
+
+                // Per pass scratch: deformed shape Ds, then the forces on
+                // nodes 1-3 (node 0 gets the negated sum)
+                std::array<std::vector<Real>, 9> mShape;
+                std::array<std::vector<Real>, 9> mForce;
+
+                // Rest data the middle pass reads, either the arrays above
+                // or their packed copies for a subset of the elements
+                std::array<Real const*, 9> mB;
+                Real const* mV;
+                std::array<std::vector<Real>, 9> mPackedRest;
+                std::vector<Real> mPackedVolume;
+};
+
+typedef BasicTetMesh<float> TetMesh;
+
+// Fill an axis aligned box with nx * ny * nz cubes, each split into five
+// tetrahedra. Particle masses are lumped from the element volumes.
+// Returns the index of the first particle created; particles are laid out
+// x fastest, then y, then z.
+template <typename Real, typename Accum>
+size_t addTetBox(BasicSpringSystem<Real, Accum>& system, BasicTetMesh<Real, Accum>& mesh,
+                typename BasicParticleSet<Real, Accum>::AccumType originX,
+                typename BasicParticleSet<Real, Accum>::AccumType originY,
+                typename BasicParticleSet<Real, Accum>::AccumType originZ,
+                size_t nx, size_t ny, size_t nz,
+                typename BasicParticleSet<Real, Accum>::AccumType spacing,
+                typename BasicParticleSet<Real, Accum>::RealType density);
+
+#endif//__TET_MESH_HPP
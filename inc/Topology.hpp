@@ -0,0 +1,73 @@
+#ifndef __TOPOLOGY_HPP
+#define __TOPOLOGY_HPP
+
+#include "SpringSystem.hpp"
+
+#include <vector>
+
+// Runtime edits of the springs of a SpringSystem: insertion and removal
+// cost O(1), tearing O(springs checked) and cutting O(slots).
+//
+// Removed springs become tombstones: they are collapsed onto a single
+// particle with zero stiffness, so the force loops skip them without a
+// branch on a separate flag, and their slots go on a free list for the
+// next insertion. Compaction fills holes from the end of the arrays once
+// enough tombstones pile up. Insertions and removals are logged with the
+// system, so islands follow them in place; only a compaction, which moves
+// springs between slots, makes them rebuild.
+//
+// Alongside the slots the topology keeps a mirror of the line index
+// buffer with the range changed since the last upload.
+class SpringTopology
+{
+        public:
+                SpringTopology(SpringSystem& system);
+
+                // The rest length is the current distance
+                size_t addSpring(size_t i, size_t j, float k, float damping);
+                void removeSpring(size_t s);
+
+                // Remove the given springs that are stretched beyond
+                // (1 + maxStrain) times their rest length, returns how many
+                // tore. Only springs that moved can tear, so the awake
+                // islands' springs are enough.
+                size_t tear(float maxStrain, std::vector<unsigned int> const& springs);
+
+                // Remove springs that cross the plane through p with normal n,
+                // within radius of p. Scans every slot, once per cut.
+                size_t cut(float px, float py, float pz,
+                                float nx, float ny, float nz, float radius);
+
+                // Fill tombstones with live springs from the end of the
+                // arrays. Runs by itself when over a quarter are dead.
+                void compact();
+
+                // False for slots that compaction cut off as well
+                bool isAlive(size_t s) const { return s < mAlive.size() && mAlive[s] != 0; }
+                size_t liveCount() const { return mAlive.size() - mFree.size(); }
+
+                // Two indices per spring slot, tombstones are degenerate lines
+                std::vector<unsigned int> const& indices() const { return mIndices; }
+
+                // Slot range [begin, end) whose indices changed since the
+                // last call; returns false if nothing changed
+                bool takeDirtyRange(size_t& begin, size_t& end);
+
+        private:
+                void markDirty(size_t s);
+                void setIndices(size_t s);
+                void moveSlot(size_t from, size_t to);
+
+                SpringSystem& mSystem;
+
+                std::vector<unsigned char> mAlive;
+                std::vector<unsigned int> mFree;
+
+                std::vector<unsigned int> mIndices;
+                size_t mDirtyBegin;
+                size_t mDirtyEnd;
+
+                std::vector<unsigned int> mRemoved;
+};
+
+#endif//__TOPOLOGY_HPP
@@ -0,0 +1,54 @@
+#ifndef __TRIPLE_BUFFER_HPP
+#define __TRIPLE_BUFFER_HPP
+
+#include <array>
+#include <atomic>
+
+// Lock-free handoff of the latest state from one producer thread to one
+// consumer thread. The producer always has a buffer to write into and the
+// consumer always has a complete one to read, neither ever waits; states
+// the consumer is too slow to see are simply skipped.
+template <typename T>
+class TripleBuffer
+{
+        public:
+                TripleBuffer() :
+                        mBack(0),
+                        mMiddle(1),
+                        mFront(2)
+                { }
+
+                // Producer side
+                T& writeBuffer() { return mBuffers[mBack]; }
+
+                void publish()
+                {
+                        const unsigned int previous =
+                                mMiddle.exchange(mBack | kFresh, std::memory_order_acq_rel);
+                        mBack = previous & kIndex;
+                }
+
+                // Consumer side. Returns true if a newer state was published
+                // since the last call.
+                bool update()
+                {
+                        if(!(mMiddle.load(std::memory_order_relaxed) & kFresh)) return false;
+                        const unsigned int previous =
+                                mMiddle.exchange(mFront, std::memory_order_acq_rel);
+                        mFront = previous & kIndex;
+                        return true;
+                }
+
+                T const& readBuffer() const { return mBuffers[mFront]; }
+
+        private:
+                static const unsigned int kIndex = 3;
+                static const unsigned int kFresh = 4;
+
+                std::array<T, 3> mBuffers;
+                unsigned int mBack;
+                std::atomic<unsigned int> mMiddle;
+                unsigned int mFront;
+};
+
+#endif//__TRIPLE_BUFFER_HPP
@@ -0,0 +1,34 @@
+#ifndef __TUNABLE_HPP
+#define __TUNABLE_HPP
+
+#include "Observables.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// A simulation whose parameters can be set by name, e.g. from the control
+// socket. Every call is made on the thread that steps the simulation.
+class Tunable
+{
+        public:
+                typedef std::pair<std::string, float> Parameter;
+
+                virtual ~Tunable() { }
+
+                // Returns false for names it does not know
+                virtual bool setParameter(std::string const& name, float value) = 0;
+                virtual void parameters(std::vector<Parameter>& out) const = 0;
+
+                virtual double energy() const = 0;
+                virtual void reset() = 0;
+
+                // Ends a sleep so that requested steps move it again
+                virtual void wake() = 0;
+
+                // Measured during the last step, and their history
+                virtual Observables const& observables() const = 0;
+                virtual ObservableSeries const& series() const = 0;
+};
+
+#endif//__TUNABLE_HPP
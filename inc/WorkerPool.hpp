@@ -0,0 +1,51 @@
+#ifndef __WORKER_POOL_HPP
+#define __WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that run one task at a time, all together, for
+// passes that are split over the threads many times a second. The calling
+// thread takes part as worker 0, so a pool of one runs everything inline.
+class WorkerPool
+{
+        public:
+                typedef std::function<void(unsigned int)> Task;
+
+                // Zero threads means one per core
+                explicit WorkerPool(unsigned int threads = 0);
+                ~WorkerPool();
+
+                // Calls task(worker) for every worker in [0, size()) and
+                // returns once all of them are done
+                void run(Task const& task);
+
+                unsigned int size() const { return mSize; }
+
+                // Index range of part `worker` when count items are split
+                // into size() contiguous parts
+                void range(unsigned int worker, size_t count, size_t& begin, size_t& end) const
+                {
+                        begin = count * worker / mSize;
+                        end = count * (worker + 1) / mSize;
+                }
+
+        private:
+                void work(unsigned int worker);
+
+                unsigned int mSize;
+                std::vector<std::thread> mThreads;
+
+                std::mutex mMutex;
+                std::condition_variable mStart;
+                std::condition_variable mDone;
+                Task const* mTask;
+                unsigned long long mGeneration;
+                unsigned int mPending;
+                bool mStopping;
+};
+
+#endif//__WORKER_POOL_HPP
@@ -0,0 +1,88 @@
+#include "Bvh.hpp"
+
+#include <algorithm>
+
+namespace
+{
+        // Triangles per leaf. Small leaves keep the exact tests few, a
+        // handful per leaf keeps the tree shallow.
+        const unsigned int kLeafSize = 4;
+
+        // The query stack holds at most one entry per level and side
+        const int kMaxDepth = 30;
+}
+
+void TriangleBvh::build(std::vector<Vec3> const& vertices,
+                std::vector<unsigned int> const& triangles)
+{
+        mTriangles = triangles;
+        const unsigned int count = static_cast<unsigned int>(triangles.size() / 3);
+
+        std::vector<Vec3> centroids(count);
+        mOrder.resize(count);
+        for(unsigned int t = 0; t < count; ++t)
+        {
+                centroids[t] = (vertices[triangles[3 * t]] + vertices[triangles[3 * t + 1]] +
+                                vertices[triangles[3 * t + 2]]) * (1.f / 3.f);
+                mOrder[t] = t;
+        }
+
+        mNodes.clear();
+        mNodes.reserve(2 * count / kLeafSize + 1);
+        if(count > 0) buildNode(centroids, 0, count, 0);
+        refit(vertices, vertices);
+}
+
+unsigned int TriangleBvh::buildNode(std::vector<Vec3> const& centroids,
+                unsigned int begin, unsigned int end, int depth)
+{
+        const unsigned int index = static_cast<unsigned int>(mNodes.size());
+        mNodes.push_back(Node());
+        Node& node = mNodes.back();
+        node.first = begin;
+        node.count = end - begin;
+        node.right = 0;
+        if(end - begin <= kLeafSize || depth >= kMaxDepth) return index;
+
+        // Median split along the widest spread of the centroids
+        Box spread;
+        for(unsigned int i = begin; i < end; ++i) spread.add(centroids[mOrder[i]]);
+        const Vec3 extent = spread.hi - spread.lo;
+        const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        const unsigned int middle = begin + (end - begin) / 2;
+        std::nth_element(mOrder.begin() + begin, mOrder.begin() + middle, mOrder.begin() + end,
+                        [&centroids, axis](unsigned int a, unsigned int b)
+                        {
+                                return centroids[a][axis] < centroids[b][axis];
+                        });
+
+        mNodes[index].count = 0;
+        buildNode(centroids, begin, middle, depth + 1);
+        const unsigned int right = buildNode(centroids, middle, end, depth + 1);
+        mNodes[index].right = right;
+        return index;
+}
+
+void TriangleBvh::refit(std::vector<Vec3> const& previous, std::vector<Vec3> const& current)
+{
+        for(size_t n = mNodes.size(); n-- > 0;)
+        {
+                Node& node = mNodes[n];
+                node.box = Box();
+                if(node.count == 0)
+                {
+                        node.box.add(mNodes[n + 1].box);
+                        node.box.add(mNodes[node.right].box);
+                        continue;
+                }
+                for(unsigned int i = node.first; i < node.first + node.count; ++i)
+                {
+                        const unsigned int t = mOrder[i];
+                        for(int c = 0; c < 3; ++c)
+                        {
+                                node.box.add(previous[mTriangles[3 * t + c]]);
+                                node.box.add(current[mTriangles[3 * t + c]]);
+                        }
+                }
+        }
+}
@@ -104,3 +104,10 @@ atlas::math::Matrix4 Camera::getCameraMatrix()
 {
         return mImpl->dollyMatrix * mImpl->trackMatrix * mImpl->tumbleMatrix;
 }
+
+atlas::math::Point Camera::getEyePosition()
+{
+        USING_ATLAS_MATH_NS;
+        const Matrix4 inverse = glm::inverse(getCameraMatrix());
+        return Point(inverse[3][0], inverse[3][1], inverse[3][2]);
+}
@@ -0,0 +1,40 @@
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+size_t ChecksumLog::firstDivergence(ChecksumLog const& other) const
+{
+        const size_t steps = std::min(mValues.size(), other.mValues.size());
+        for(size_t s = 0; s < steps; ++s)
+                if(mValues[s] != other.mValues[s]) return s + 1;
+        return 0;
+}
+
+bool ChecksumLog::write(std::string const& path) const
+{
+        FILE* file = std::fopen(path.c_str(), "w");
+        if(!file) return false;
+        for(size_t s = 0; s < mValues.size(); ++s)
+                std::fprintf(file, "%zu %016" PRIx64 "\n", s + 1, mValues[s]);
+        return std::fclose(file) == 0;
+}
+
+bool ChecksumLog::read(std::string const& path)
+{
+        FILE* file = std::fopen(path.c_str(), "r");
+        if(!file) return false;
+        mValues.clear();
+        size_t step;
+        std::uint64_t checksum;
+        while(std::fscanf(file, "%zu %" SCNx64, &step, &checksum) == 2)
+        {
+                // Lines are numbered so that a hand edited file is caught
+                if(step != mValues.size() + 1) break;
+                mValues.push_back(checksum);
+        }
+        const bool ok = std::feof(file) != 0;
+        std::fclose(file);
+        return ok;
+}
@@ -0,0 +1,600 @@
+#include "ChunkedSystem.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+        const char kMagic[8] = {'S', 'P', 'R', 'C', 'H', 'N', 'K', '1'};
+
+        // Chunks start on page boundaries so that they can be advised and
+        // dropped on their own; arrays within a chunk on cache lines
+        const std::uint64_t kPage = 4096;
+        const std::uint64_t kLine = 64;
+
+        struct FileHeader
+        {
+                char magic[8];
+                std::uint64_t chunks;
+                std::uint64_t particles;
+                std::uint64_t springs;
+                std::uint64_t table;            // Offset of the chunk entries
+                std::uint32_t boundary;         // Slots in the boundary table
+                float gravity[3];
+                float damping;
+        };
+
+        std::uint64_t alignUp(std::uint64_t value, std::uint64_t alignment)
+        {
+                return (value + alignment - 1) / alignment * alignment;
+        }
+
+        // Offsets of the arrays of a chunk from its start
+        struct Layout
+        {
+                Layout(ChunkEntry const& e)
+                {
+                        const std::uint64_t n = e.owned + e.halo;
+                        std::uint64_t at = 0;
+                        auto place = [&at](std::uint64_t count, std::uint64_t size)
+                        {
+                                const std::uint64_t offset = at;
+                                at = alignUp(at + count * size, kLine);
+                                return offset;
+                        };
+                        x = place(n, 4);
+                        y = place(n, 4);
+                        z = place(n, 4);
+                        vx = place(n, 4);
+                        vy = place(n, 4);
+                        vz = place(n, 4);
+                        invMass = place(n, 4);
+                        a = place(e.springs, 4);
+                        b = place(e.springs, 4);
+                        rest = place(e.springs, 4);
+                        k = place(e.springs, 4);
+                        damping = place(e.springs, 4);
+                        ids = place(e.owned, 8);
+                        importSlot = place(e.halo, 4);
+                        exportLocal = place(e.exports, 4);
+                        exportSlot = place(e.exports, 4);
+                        bytes = at;
+                }
+
+                std::uint64_t x, y, z, vx, vy, vz, invMass;
+                std::uint64_t a, b, rest, k, damping;
+                std::uint64_t ids, importSlot, exportLocal, exportSlot;
+                std::uint64_t bytes;
+        };
+
+        template <typename T>
+        void put(std::vector<unsigned char>& buffer, std::uint64_t offset, std::vector<T> const& values)
+        {
+                if(!values.empty()) std::memcpy(buffer.data() + offset, values.data(), values.size() * sizeof(T));
+        }
+
+        // Interleaves the low 21 bits of v with two zero bits each
+        std::uint64_t spread(std::uint64_t v)
+        {
+                v &= 0x1fffff;
+                v = (v | v << 32) & 0x1f00000000ffffull;
+                v = (v | v << 16) & 0x1f0000ff0000ffull;
+                v = (v | v << 8) & 0x100f00f00f00f00full;
+                v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+                v = (v | v << 2) & 0x1249249249249249ull;
+                return v;
+        }
+
+        long majorFaults()
+        {
+                struct rusage usage;
+                getrusage(RUSAGE_SELF, &usage);
+                return usage.ru_majflt;
+        }
+}
+
+// Chunk Data
+
+void ChunkData::clear()
+{
+        for(auto* v : { &x, &y, &z, &vx, &vy, &vz, &invMass, &rest, &k, &damping }) v->clear();
+        for(auto* v : { &importSlot, &a, &b, &exportLocal, &exportSlot }) v->clear();
+        ids.clear();
+}
+
+size_t ChunkData::addParticle(float px, float py, float pz, float pvx, float pvy, float pvz, float w)
+{
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+        vx.push_back(pvx);
+        vy.push_back(pvy);
+        vz.push_back(pvz);
+        invMass.push_back(w);
+        return x.size() - 1;
+}
+
+// Chunk Writer
+
+ChunkWriter::ChunkWriter() :
+        mFile(nullptr),
+        mOffset(0),
+        mParticles(0),
+        mSprings(0),
+        mBoundary(0),
+        mGravity{0.f, 0.f, 0.f},
+        mDamping(0.f)
+{ }
+
+ChunkWriter::~ChunkWriter()
+{
+        if(mFile) std::fclose(mFile);
+}
+
+bool ChunkWriter::open(std::string const& path, float gx, float gy, float gz, float damping)
+{
+        mFile = std::fopen(path.c_str(), "wb");
+        if(!mFile) return false;
+        mGravity[0] = gx;
+        mGravity[1] = gy;
+        mGravity[2] = gz;
+        mDamping = damping;
+
+        // The header is written last, its page is kept free until then
+        const std::vector<unsigned char> page(kPage, 0);
+        mOffset = kPage;
+        return std::fwrite(page.data(), 1, page.size(), mFile) == page.size();
+}
+
+bool ChunkWriter::add(ChunkData const& chunk)
+{
+        if(!mFile) return false;
+
+        ChunkEntry entry;
+        entry.offset = mOffset;
+        entry.owned = static_cast<std::uint32_t>(chunk.ids.size());
+        entry.halo = static_cast<std::uint32_t>(chunk.importSlot.size());
+        entry.springs = static_cast<std::uint32_t>(chunk.a.size());
+        entry.exports = static_cast<std::uint32_t>(chunk.exportLocal.size());
+        if(chunk.x.size() != entry.owned + entry.halo) return false;
+
+        const Layout layout(entry);
+        entry.bytes = layout.bytes;
+        std::vector<unsigned char> buffer(alignUp(layout.bytes, kPage), 0);
+        put(buffer, layout.x, chunk.x);
+        put(buffer, layout.y, chunk.y);
+        put(buffer, layout.z, chunk.z);
+        put(buffer, layout.vx, chunk.vx);
+        put(buffer, layout.vy, chunk.vy);
+        put(buffer, layout.vz, chunk.vz);
+        put(buffer, layout.invMass, chunk.invMass);
+        put(buffer, layout.a, chunk.a);
+        put(buffer, layout.b, chunk.b);
+        put(buffer, layout.rest, chunk.rest);
+        put(buffer, layout.k, chunk.k);
+        put(buffer, layout.damping, chunk.damping);
+        put(buffer, layout.ids, chunk.ids);
+        put(buffer, layout.importSlot, chunk.importSlot);
+        put(buffer, layout.exportLocal, chunk.exportLocal);
+        put(buffer, layout.exportSlot, chunk.exportSlot);
+        if(std::fwrite(buffer.data(), 1, buffer.size(), mFile) != buffer.size()) return false;
+
+        for(std::uint32_t slot : chunk.importSlot) mBoundary = std::max(mBoundary, slot + 1);
+        for(std::uint32_t slot : chunk.exportSlot) mBoundary = std::max(mBoundary, slot + 1);
+        mOffset += buffer.size();
+        mParticles += entry.owned;
+        for(std::uint32_t a : chunk.a) mSprings += a < entry.owned ? 1 : 0;
+        mEntries.push_back(entry);
+        return true;
+}
+
+bool ChunkWriter::finish()
+{
+        if(!mFile) return false;
+
+        FileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.chunks = mEntries.size();
+        header.particles = mParticles;
+        header.springs = mSprings;
+        header.table = mOffset;
+        header.boundary = mBoundary;
+        std::copy(mGravity, mGravity + 3, header.gravity);
+        header.damping = mDamping;
+
+        bool ok = mEntries.empty() ||
+                std::fwrite(mEntries.data(), sizeof(ChunkEntry), mEntries.size(), mFile) == mEntries.size();
+        ok = ok && std::fseek(mFile, 0, SEEK_SET) == 0 &&
+                std::fwrite(&header, sizeof(header), 1, mFile) == 1;
+        ok = std::fclose(mFile) == 0 && ok;
+        mFile = nullptr;
+        return ok;
+}
+
+// Chunked Spring System
+
+ChunkedSpringSystem::ChunkedSpringSystem() :
+        mFd(-1),
+        mData(nullptr),
+        mSize(0),
+        mWindow(4),
+        mRelease(true),
+        mParticles(0),
+        mSprings(0),
+        mGravity{0.f, 0.f, 0.f},
+        mDamping(0.f),
+        mCurrent(0)
+{
+        mStats.seconds = 0.0;
+        mStats.steps = 0;
+        mStats.bytes = 0;
+        mStats.majorFaults = 0;
+}
+
+ChunkedSpringSystem::~ChunkedSpringSystem()
+{
+        close();
+}
+
+bool ChunkedSpringSystem::create(std::string const& path, SpringSystem const& system, float cellSize)
+{
+        ParticleSet const& p = system.particles();
+        SpringSet const& springs = system.springs();
+        const size_t n = p.size();
+        if(n == 0 || !(cellSize > 0.f)) return false;
+
+        // Cells along a Z curve, a chunk per occupied cell
+        float lo[3] = {p.x[0], p.y[0], p.z[0]};
+        for(size_t i = 1; i < n; ++i)
+        {
+                lo[0] = std::min(lo[0], p.x[i]);
+                lo[1] = std::min(lo[1], p.y[i]);
+                lo[2] = std::min(lo[2], p.z[i]);
+        }
+        std::vector<std::uint64_t> keys(n);
+        for(size_t i = 0; i < n; ++i)
+        {
+                const std::uint64_t cx = static_cast<std::uint64_t>((p.x[i] - lo[0]) / cellSize);
+                const std::uint64_t cy = static_cast<std::uint64_t>((p.y[i] - lo[1]) / cellSize);
+                const std::uint64_t cz = static_cast<std::uint64_t>((p.z[i] - lo[2]) / cellSize);
+                keys[i] = spread(cx) | spread(cy) << 1 | spread(cz) << 2;
+        }
+        std::vector<unsigned int> order(n);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(),
+                        [&keys](unsigned int i, unsigned int j) { return keys[i] < keys[j]; });
+
+        std::vector<unsigned int> chunkOf(n), localOf(n);
+        std::vector<size_t> chunkStart;
+        for(size_t r = 0; r < n; ++r)
+        {
+                if(r == 0 || keys[order[r]] != keys[order[r - 1]]) chunkStart.push_back(r);
+                chunkOf[order[r]] = static_cast<unsigned int>(chunkStart.size() - 1);
+                localOf[order[r]] = static_cast<unsigned int>(r - chunkStart.back());
+        }
+        const size_t chunks = chunkStart.size();
+        chunkStart.push_back(n);
+
+        // Springs go to the chunks of both ends, and the ends of springs
+        // across a border get a boundary slot
+        std::vector<std::vector<unsigned int>> chunkSprings(chunks);
+        std::vector<std::int64_t> slot(n, -1);
+        std::uint32_t slots = 0;
+        for(size_t s = 0; s < springs.size(); ++s)
+        {
+                const unsigned int i = springs.a[s];
+                const unsigned int j = springs.b[s];
+                chunkSprings[chunkOf[i]].push_back(static_cast<unsigned int>(s));
+                if(chunkOf[j] == chunkOf[i]) continue;
+                chunkSprings[chunkOf[j]].push_back(static_cast<unsigned int>(s));
+                if(slot[i] < 0) slot[i] = slots++;
+                if(slot[j] < 0) slot[j] = slots++;
+        }
+
+        ChunkWriter writer;
+        std::array<float, 3> const& g = system.gravity();
+        if(!writer.open(path, g[0], g[1], g[2], system.damping())) return false;
+
+        ChunkData chunk;
+        std::unordered_map<unsigned int, std::uint32_t> halo;
+        for(size_t c = 0; c < chunks; ++c)
+        {
+                chunk.clear();
+                halo.clear();
+                for(size_t r = chunkStart[c]; r < chunkStart[c + 1]; ++r)
+                {
+                        const unsigned int i = order[r];
+                        const size_t local = chunk.addParticle(p.x[i], p.y[i], p.z[i],
+                                        p.vx[i], p.vy[i], p.vz[i], p.invMass[i]);
+                        chunk.ids.push_back(i);
+                        if(slot[i] < 0) continue;
+                        chunk.exportLocal.push_back(static_cast<std::uint32_t>(local));
+                        chunk.exportSlot.push_back(static_cast<std::uint32_t>(slot[i]));
+                }
+
+                auto local = [&](unsigned int i) -> std::uint32_t
+                {
+                        if(chunkOf[i] == c) return static_cast<std::uint32_t>(localOf[i]);
+                        auto found = halo.find(i);
+                        if(found != halo.end()) return found->second;
+                        const std::uint32_t index = static_cast<std::uint32_t>(chunk.addParticle(
+                                                p.x[i], p.y[i], p.z[i], p.vx[i], p.vy[i], p.vz[i], p.invMass[i]));
+                        chunk.importSlot.push_back(static_cast<std::uint32_t>(slot[i]));
+                        halo[i] = index;
+                        return index;
+                };
+                for(unsigned int s : chunkSprings[c])
+                {
+                        chunk.a.push_back(local(springs.a[s]));
+                        chunk.b.push_back(local(springs.b[s]));
+                        chunk.rest.push_back(springs.rest[s]);
+                        chunk.k.push_back(springs.k[s]);
+                        chunk.damping.push_back(springs.damping[s]);
+                }
+                if(!writer.add(chunk)) return false;
+        }
+        return writer.finish();
+}
+
+bool ChunkedSpringSystem::open(std::string const& path, unsigned int window, bool dropChunks)
+{
+        close();
+        mWindow = std::max(1u, window);
+        mRelease = dropChunks;
+
+        mFd = ::open(path.c_str(), O_RDWR);
+        if(mFd < 0) return false;
+        struct stat info;
+        FileHeader header;
+        if(fstat(mFd, &info) != 0 ||
+                        pread(mFd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+                        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+                        header.table + header.chunks * sizeof(ChunkEntry) > static_cast<std::uint64_t>(info.st_size))
+        {
+                close();
+                return false;
+        }
+
+        mEntries.resize(header.chunks);
+        const ssize_t tableBytes = static_cast<ssize_t>(header.chunks * sizeof(ChunkEntry));
+        if(tableBytes > 0 && pread(mFd, mEntries.data(), tableBytes, header.table) != tableBytes)
+        {
+                close();
+                return false;
+        }
+        for(ChunkEntry const& e : mEntries)
+        {
+                if(e.offset + e.bytes > header.table || Layout(e).bytes != e.bytes)
+                {
+                        close();
+                        return false;
+                }
+        }
+
+        mSize = static_cast<std::uint64_t>(info.st_size);
+        void* data = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+        if(data == MAP_FAILED)
+        {
+                close();
+                return false;
+        }
+        mData = static_cast<unsigned char*>(data);
+
+        mParticles = header.particles;
+        mSprings = header.springs;
+        std::copy(header.gravity, header.gravity + 3, mGravity);
+        mDamping = header.damping;
+
+        // The chunks hold the state, the boundary table starts from it
+        mBoundary[0].assign(6 * static_cast<size_t>(header.boundary), 0.f);
+        mBoundary[1].assign(6 * static_cast<size_t>(header.boundary), 0.f);
+        mCurrent = 0;
+        for(size_t ahead = 0; ahead < mWindow; ++ahead) prefetch(ahead);
+        for(size_t c = 0; c < mEntries.size(); ++c)
+        {
+                prefetch(c + mWindow);
+                exportBorder(view(c), mEntries[c], mBoundary[0].data());
+                if(!mRelease) continue;
+                release(c);
+                evict(c);
+        }
+        return true;
+}
+
+void ChunkedSpringSystem::close()
+{
+        if(mData) munmap(mData, mSize);
+        if(mFd >= 0) ::close(mFd);
+        mData = nullptr;
+        mFd = -1;
+        mSize = 0;
+        mEntries.clear();
+}
+
+ChunkedSpringSystem::View ChunkedSpringSystem::view(size_t c) const
+{
+        ChunkEntry const& e = mEntries[c];
+        const Layout l(e);
+        unsigned char* base = mData + e.offset;
+        View v;
+        v.x = reinterpret_cast<float*>(base + l.x);
+        v.y = reinterpret_cast<float*>(base + l.y);
+        v.z = reinterpret_cast<float*>(base + l.z);
+        v.vx = reinterpret_cast<float*>(base + l.vx);
+        v.vy = reinterpret_cast<float*>(base + l.vy);
+        v.vz = reinterpret_cast<float*>(base + l.vz);
+        v.invMass = reinterpret_cast<float*>(base + l.invMass);
+        v.a = reinterpret_cast<std::uint32_t*>(base + l.a);
+        v.b = reinterpret_cast<std::uint32_t*>(base + l.b);
+        v.rest = reinterpret_cast<float*>(base + l.rest);
+        v.k = reinterpret_cast<float*>(base + l.k);
+        v.damping = reinterpret_cast<float*>(base + l.damping);
+        v.ids = reinterpret_cast<std::uint64_t*>(base + l.ids);
+        v.importSlot = reinterpret_cast<std::uint32_t*>(base + l.importSlot);
+        v.exportLocal = reinterpret_cast<std::uint32_t*>(base + l.exportLocal);
+        v.exportSlot = reinterpret_cast<std::uint32_t*>(base + l.exportSlot);
+        return v;
+}
+
+void ChunkedSpringSystem::prefetch(size_t c)
+{
+        if(c >= mEntries.size()) return;
+        madvise(mData + mEntries[c].offset, alignUp(mEntries[c].bytes, kPage), MADV_WILLNEED);
+}
+
+void ChunkedSpringSystem::release(size_t c)
+{
+        // Start writing the chunk back now rather than when the kernel
+        // runs out of clean pages, then drop it from the process
+        ChunkEntry const& e = mEntries[c];
+        const std::uint64_t bytes = alignUp(e.bytes, kPage);
+#ifdef __linux__
+        sync_file_range(mFd, e.offset, bytes, SYNC_FILE_RANGE_WRITE);
+#endif
+        madvise(mData + e.offset, bytes, MADV_DONTNEED);
+}
+
+void ChunkedSpringSystem::evict(size_t c)
+{
+        // Pages still being written stay, the rest leave the page cache
+        ChunkEntry const& e = mEntries[c];
+        posix_fadvise(mFd, e.offset, alignUp(e.bytes, kPage), POSIX_FADV_DONTNEED);
+}
+
+void ChunkedSpringSystem::exportBorder(View const& v, ChunkEntry const& e, float* boundary) const
+{
+        for(std::uint32_t x = 0; x < e.exports; ++x)
+        {
+                const std::uint32_t i = v.exportLocal[x];
+                float* out = boundary + 6 * static_cast<size_t>(v.exportSlot[x]);
+                out[0] = v.x[i];
+                out[1] = v.y[i];
+                out[2] = v.z[i];
+                out[3] = v.vx[i];
+                out[4] = v.vy[i];
+                out[5] = v.vz[i];
+        }
+}
+
+void ChunkedSpringSystem::stepChunk(size_t c, float dt)
+{
+        ChunkEntry const& e = mEntries[c];
+        const View v = view(c);
+        const size_t n = e.owned + e.halo;
+
+        // Halo particles as they were at the start of the step
+        float const* current = mBoundary[mCurrent].data();
+        for(std::uint32_t h = 0; h < e.halo; ++h)
+        {
+                float const* in = current + 6 * static_cast<size_t>(v.importSlot[h]);
+                const size_t i = e.owned + h;
+                v.x[i] = in[0];
+                v.y[i] = in[1];
+                v.z[i] = in[2];
+                v.vx[i] = in[3];
+                v.vy[i] = in[4];
+                v.vz[i] = in[5];
+        }
+
+        // The same spring force and semi-implicit Euler step as the
+        // SpringSystem; forces on halo ends are computed and ignored
+        mFx.assign(n, 0.f);
+        mFy.assign(n, 0.f);
+        mFz.assign(n, 0.f);
+        for(std::uint32_t s = 0; s < e.springs; ++s)
+        {
+                const std::uint32_t i = v.a[s];
+                const std::uint32_t j = v.b[s];
+                const float dx = v.x[j] - v.x[i];
+                const float dy = v.y[j] - v.y[i];
+                const float dz = v.z[j] - v.z[i];
+                const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+                if(length <= 0.f) continue;
+
+                const float nx = dx / length;
+                const float ny = dy / length;
+                const float nz = dz / length;
+                const float dv = (v.vx[j] - v.vx[i]) * nx + (v.vy[j] - v.vy[i]) * ny + (v.vz[j] - v.vz[i]) * nz;
+                const float f = v.k[s] * (length - v.rest[s]) + v.damping[s] * dv;
+                mFx[i] += f * nx;
+                mFy[i] += f * ny;
+                mFz[i] += f * nz;
+                mFx[j] -= f * nx;
+                mFy[j] -= f * ny;
+                mFz[j] -= f * nz;
+        }
+
+        for(std::uint32_t i = 0; i < e.owned; ++i)
+        {
+                const float w = v.invMass[i];
+                const float g = w > 0.f ? 1.f : 0.f;
+                const float vx = v.vx[i] + dt * (w * (mFx[i] - mDamping * v.vx[i]) + g * mGravity[0]);
+                const float vy = v.vy[i] + dt * (w * (mFy[i] - mDamping * v.vy[i]) + g * mGravity[1]);
+                const float vz = v.vz[i] + dt * (w * (mFz[i] - mDamping * v.vz[i]) + g * mGravity[2]);
+                v.x[i] += dt * vx;
+                v.y[i] += dt * vy;
+                v.z[i] += dt * vz;
+                v.vx[i] = vx;
+                v.vy[i] = vy;
+                v.vz[i] = vz;
+        }
+
+        exportBorder(v, e, mBoundary[1 - mCurrent].data());
+}
+
+void ChunkedSpringSystem::step(float dt)
+{
+        if(!mData) return;
+        const auto start = std::chrono::steady_clock::now();
+        const long faults = majorFaults();
+
+        const size_t chunks = mEntries.size();
+        for(size_t ahead = 0; ahead < mWindow; ++ahead) prefetch(ahead);
+        for(size_t c = 0; c < chunks; ++c)
+        {
+                prefetch(c + mWindow);
+                stepChunk(c, dt);
+                mStats.bytes += mEntries[c].bytes;
+                if(!mRelease) continue;
+                release(c);
+                if(c >= mWindow) evict(c - mWindow);
+        }
+        if(mRelease)
+                for(size_t c = chunks > mWindow ? chunks - mWindow : 0; c < chunks; ++c) evict(c);
+        mCurrent = 1 - mCurrent;
+
+        mStats.majorFaults += majorFaults() - faults;
+        mStats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ++mStats.steps;
+}
+
+void ChunkedSpringSystem::copyTo(SpringSystem& system) const
+{
+        ParticleSet& p = system.particles();
+        for(size_t c = 0; c < mEntries.size(); ++c)
+        {
+                const View v = view(c);
+                for(std::uint32_t i = 0; i < mEntries[c].owned; ++i)
+                {
+                        const std::uint64_t id = v.ids[i];
+                        if(id >= p.size()) continue;
+                        p.x[id] = v.x[i];
+                        p.y[id] = v.y[i];
+                        p.z[id] = v.z[i];
+                        p.vx[id] = v.vx[i];
+                        p.vy[id] = v.vy[i];
+                        p.vz[id] = v.vz[i];
+                }
+        }
+}
@@ -0,0 +1,667 @@
+#include "Collision.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+        // Contacts resolved per particle and step, e.g. a corner between a
+        // wall and the floor takes two
+        const int kMaxContacts = 4;
+
+        // Distance a particle is left off a surface, so that the next step
+        // starts on the right side of it
+        const float kSkin = 1e-3f;
+
+        // Slack on the barycentric test, so that a point passing through a
+        // shared edge is caught by one of the two triangles
+        const float kEdgeTolerance = 1e-5f;
+
+        // Stands in for infinity in the bounds of infinite planes
+        const float kFar = 1e6f;
+
+        const float kPi = 3.14159265f;
+
+        float clamp(float x, float lo, float hi) { return std::max(lo, std::min(x, hi)); }
+
+        Vec3 normalize(Vec3 const& v)
+        {
+                const float l = length(v);
+                return l > 0.f ? v * (1.f / l) : Vec3(0.f, 1.f, 0.f);
+        }
+
+        // Roots in [0, 1] of c0 + c1 u + c2 u^2 + c3 u^3, in increasing
+        // order. The interval is split where the derivative vanishes, so
+        // that the cubic is monotonic on every piece, and each piece with a
+        // sign change is bisected.
+        int unitRoots(float c0, float c1, float c2, float c3, float roots[3])
+        {
+                auto f = [=](float u) { return ((c3 * u + c2) * u + c1) * u + c0; };
+
+                float breaks[4];
+                int count = 0;
+                breaks[count++] = 0.f;
+                const float a = 3.f * c3, b = 2.f * c2, c = c1;
+                float turns[2];
+                int turnCount = 0;
+                if(std::fabs(a) > 1e-12f)
+                {
+                        const float disc = b * b - 4.f * a * c;
+                        if(disc > 0.f)
+                        {
+                                const float q = -0.5f * (b + std::copysign(std::sqrt(disc), b));
+                                turns[turnCount++] = q / a;
+                                if(q != 0.f) turns[turnCount++] = c / q;
+                        }
+                }
+                else if(std::fabs(b) > 1e-12f) turns[turnCount++] = -c / b;
+                if(turnCount == 2 && turns[0] > turns[1]) std::swap(turns[0], turns[1]);
+                for(int i = 0; i < turnCount; ++i)
+                        if(turns[i] > 0.f && turns[i] < 1.f) breaks[count++] = turns[i];
+                breaks[count++] = 1.f;
+
+                int found = 0;
+                for(int i = 0; i + 1 < count; ++i)
+                {
+                        float lo = breaks[i], hi = breaks[i + 1];
+                        float flo = f(lo);
+                        const float fhi = f(hi);
+                        if(flo == 0.f)
+                        {
+                                if(found == 0 || roots[found - 1] != lo) roots[found++] = lo;
+                                continue;
+                        }
+                        if((flo < 0.f) == (fhi < 0.f) && fhi != 0.f) continue;
+                        for(int iteration = 0; iteration < 32; ++iteration)
+                        {
+                                const float mid = 0.5f * (lo + hi);
+                                const float fmid = f(mid);
+                                if((fmid < 0.f) == (flo < 0.f) && fmid != 0.f)
+                                {
+                                        lo = mid;
+                                        flo = fmid;
+                                }
+                                else hi = mid;
+                        }
+                        roots[found++] = hi;
+                }
+                return found;
+        }
+}
+
+// RigidPose
+
+RigidPose::RigidPose() :
+        rotation({{1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f}}),
+        translation(0.f, 0.f, 0.f)
+{ }
+
+RigidPose RigidPose::axisAngle(Vec3 const& axis, float angle, Vec3 const& position)
+{
+        const float c = std::cos(angle), s = std::sin(angle), t = 1.f - c;
+        const float x = axis.x, y = axis.y, z = axis.z;
+        RigidPose pose;
+        pose.rotation = {{
+                t * x * x + c,          t * x * y - s * z,      t * x * z + s * y,
+                t * x * y + s * z,      t * y * y + c,          t * y * z - s * x,
+                t * x * z - s * y,      t * y * z + s * x,      t * z * z + c }};
+        pose.translation = position;
+        return pose;
+}
+
+Vec3 RigidPose::rotate(Vec3 const& d) const
+{
+        std::array<float, 9> const& r = rotation;
+        return Vec3(r[0] * d.x + r[1] * d.y + r[2] * d.z,
+                        r[3] * d.x + r[4] * d.y + r[5] * d.z,
+                        r[6] * d.x + r[7] * d.y + r[8] * d.z);
+}
+
+Vec3 RigidPose::apply(Vec3 const& p) const
+{
+        return rotate(p) + translation;
+}
+
+Vec3 RigidPose::inverse(Vec3 const& p) const
+{
+        std::array<float, 9> const& r = rotation;
+        const Vec3 d = p - translation;
+        return Vec3(r[0] * d.x + r[3] * d.y + r[6] * d.z,
+                        r[1] * d.x + r[4] * d.y + r[7] * d.z,
+                        r[2] * d.x + r[5] * d.y + r[8] * d.z);
+}
+
+// Collider
+
+void Collider::moveTo(RigidPose const& pose)
+{
+        mPrevious = mPose;
+        mPose = pose;
+        updateBounds();
+}
+
+bool Collider::isMoving() const
+{
+        return mPrevious.rotation != mPose.rotation || mPrevious.translation != mPose.translation;
+}
+
+void Collider::updateBounds()
+{
+        const Box local = localBounds();
+        mBounds = Box();
+        for(int corner = 0; corner < 8; ++corner)
+        {
+                const Vec3 p((corner & 1) ? local.hi.x : local.lo.x,
+                                (corner & 2) ? local.hi.y : local.lo.y,
+                                (corner & 4) ? local.hi.z : local.lo.z);
+                mBounds.add(mPrevious.apply(p));
+                mBounds.add(mPose.apply(p));
+        }
+}
+
+// PlaneCollider
+
+PlaneCollider::PlaneCollider(float halfWidth, float halfDepth) :
+        mHalfWidth(halfWidth),
+        mHalfDepth(halfDepth)
+{
+        updateBounds();
+}
+
+bool PlaneCollider::inside(Vec3 const& p) const
+{
+        return (mHalfWidth <= 0.f || std::fabs(p.x) <= mHalfWidth) &&
+                (mHalfDepth <= 0.f || std::fabs(p.z) <= mHalfDepth);
+}
+
+bool PlaneCollider::sweep(Vec3 const& a, Vec3 const& b, float, float radius,
+                CollisionHit& hit) const
+{
+        // Behind the plane, or staying clear of it
+        if(a.y < 0.f || b.y >= radius) return false;
+        hit.normal = Vec3(0.f, 1.f, 0.f);
+        if(a.y < radius)
+        {
+                // Started within a radius of the surface and still sinking
+                if(b.y >= a.y || !inside(a)) return false;
+                hit.t = 0.f;
+                hit.point = Vec3(a.x, radius, a.z);
+                return true;
+        }
+        hit.t = (a.y - radius) / (a.y - b.y);
+        hit.point = lerp(a, b, hit.t);
+        return inside(hit.point);
+}
+
+void PlaneCollider::outline(std::vector<Vec3>& lines) const
+{
+        if(mHalfWidth <= 0.f || mHalfDepth <= 0.f) return;
+        const Vec3 corners[4] =
+        {
+                Vec3(-mHalfWidth, 0.f, -mHalfDepth), Vec3(mHalfWidth, 0.f, -mHalfDepth),
+                Vec3(mHalfWidth, 0.f, mHalfDepth), Vec3(-mHalfWidth, 0.f, mHalfDepth)
+        };
+        for(int i = 0; i < 4; ++i)
+        {
+                lines.push_back(pose().apply(corners[i]));
+                lines.push_back(pose().apply(corners[(i + 1) % 4]));
+        }
+}
+
+Box PlaneCollider::localBounds() const
+{
+        Box box;
+        const float w = mHalfWidth > 0.f ? mHalfWidth : kFar;
+        const float d = mHalfDepth > 0.f ? mHalfDepth : kFar;
+        box.add(Vec3(-w, 0.f, -d));
+        box.add(Vec3(w, 0.f, d));
+        return box;
+}
+
+// BoxCollider
+
+BoxCollider::BoxCollider(float halfX, float halfY, float halfZ) :
+        mHalf(halfX, halfY, halfZ)
+{
+        updateBounds();
+}
+
+bool BoxCollider::sweep(Vec3 const& a, Vec3 const& b, float, float radius,
+                CollisionHit& hit) const
+{
+        const Vec3 e = mHalf + Vec3(radius, radius, radius);
+
+        if(std::fabs(a.x) < e.x && std::fabs(a.y) < e.y && std::fabs(a.z) < e.z)
+        {
+                // Out through the nearest face
+                int axis = 0;
+                for(int i = 1; i < 3; ++i)
+                        if(e[i] - std::fabs(a[i]) < e[axis] - std::fabs(a[axis])) axis = i;
+                const float side = a[axis] < 0.f ? -1.f : 1.f;
+                hit.t = 0.f;
+                hit.point = a;
+                hit.point[axis] = side * e[axis];
+                hit.normal = Vec3(0.f, 0.f, 0.f);
+                hit.normal[axis] = side;
+                return true;
+        }
+
+        // Slabs: the last face entered is the one hit
+        const Vec3 d = b - a;
+        float enter = 0.f, exit = 1.f;
+        int axis = -1;
+        float side = 0.f;
+        for(int i = 0; i < 3; ++i)
+        {
+                if(std::fabs(d[i]) < 1e-12f)
+                {
+                        if(std::fabs(a[i]) >= e[i]) return false;
+                        continue;
+                }
+                const float t0 = (-e[i] - a[i]) / d[i];
+                const float t1 = (e[i] - a[i]) / d[i];
+                const float first = std::min(t0, t1), last = std::max(t0, t1);
+                if(first > enter || (axis < 0 && first >= enter))
+                {
+                        enter = first;
+                        axis = i;
+                        side = d[i] > 0.f ? -1.f : 1.f;
+                }
+                exit = std::min(exit, last);
+                if(enter > exit) return false;
+        }
+        if(axis < 0 || enter > 1.f) return false;
+
+        hit.t = enter;
+        hit.point = lerp(a, b, enter);
+        hit.normal = Vec3(0.f, 0.f, 0.f);
+        hit.normal[axis] = side;
+        return true;
+}
+
+void BoxCollider::outline(std::vector<Vec3>& lines) const
+{
+        // Corners that differ in one coordinate share an edge
+        for(int corner = 0; corner < 8; ++corner)
+        {
+                const Vec3 p((corner & 1) ? mHalf.x : -mHalf.x,
+                                (corner & 2) ? mHalf.y : -mHalf.y,
+                                (corner & 4) ? mHalf.z : -mHalf.z);
+                for(int bit = 0; bit < 3; ++bit)
+                {
+                        if(corner & (1 << bit)) continue;
+                        Vec3 q = p;
+                        q[bit] = mHalf[bit];
+                        lines.push_back(pose().apply(p));
+                        lines.push_back(pose().apply(q));
+                }
+        }
+}
+
+Box BoxCollider::localBounds() const
+{
+        Box box;
+        box.add(-mHalf);
+        box.add(mHalf);
+        return box;
+}
+
+// CapsuleCollider
+
+CapsuleCollider::CapsuleCollider(float halfLength, float radius) :
+        mHalfLength(halfLength),
+        mRadius(radius)
+{
+        updateBounds();
+}
+
+bool CapsuleCollider::sweep(Vec3 const& a, Vec3 const& b, float, float radius,
+                CollisionHit& hit) const
+{
+        const float r = mRadius + radius;
+
+        // Already inside: out along the direction from the axis
+        const Vec3 axisPoint(0.f, clamp(a.y, -mHalfLength, mHalfLength), 0.f);
+        const Vec3 offset = a - axisPoint;
+        if(dot(offset, offset) < r * r)
+        {
+                hit.t = 0.f;
+                hit.normal = dot(offset, offset) > 0.f ? normalize(offset) : Vec3(1.f, 0.f, 0.f);
+                hit.point = axisPoint + hit.normal * r;
+                return true;
+        }
+
+        const Vec3 d = b - a;
+        hit.t = 2.f;
+
+        // The side, where it lies between the caps
+        const float qa = d.x * d.x + d.z * d.z;
+        if(qa > 1e-12f)
+        {
+                const float qb = a.x * d.x + a.z * d.z;
+                const float qc = a.x * a.x + a.z * a.z - r * r;
+                const float disc = qb * qb - qa * qc;
+                if(disc >= 0.f)
+                {
+                        const float t = (-qb - std::sqrt(disc)) / qa;
+                        const float y = a.y + t * d.y;
+                        if(t >= 0.f && t <= 1.f && std::fabs(y) <= mHalfLength)
+                        {
+                                hit.t = t;
+                                hit.point = lerp(a, b, t);
+                                hit.normal = normalize(Vec3(hit.point.x, 0.f, hit.point.z));
+                        }
+                }
+        }
+
+        // The two caps. Parts of the spheres inside the side are only
+        // reached after the side, so the earliest hit of all is right.
+        const float dd = dot(d, d);
+        if(dd > 1e-12f)
+        {
+                for(float end : { -mHalfLength, mHalfLength })
+                {
+                        const Vec3 m = a - Vec3(0.f, end, 0.f);
+                        const float mb = dot(m, d);
+                        const float mc = dot(m, m) - r * r;
+                        const float disc = mb * mb - dd * mc;
+                        if(disc < 0.f) continue;
+                        const float t = (-mb - std::sqrt(disc)) / dd;
+                        if(t < 0.f || t > 1.f || t >= hit.t) continue;
+                        hit.t = t;
+                        hit.point = lerp(a, b, t);
+                        hit.normal = normalize(hit.point - Vec3(0.f, end, 0.f));
+                }
+        }
+        return hit.t <= 1.f;
+}
+
+void CapsuleCollider::outline(std::vector<Vec3>& lines) const
+{
+        const int segments = 16;
+        auto add = [&](Vec3 const& p, Vec3 const& q)
+        {
+                lines.push_back(pose().apply(p));
+                lines.push_back(pose().apply(q));
+        };
+        for(int i = 0; i < segments; ++i)
+        {
+                const float a0 = 2.f * kPi * i / segments;
+                const float a1 = 2.f * kPi * (i + 1) / segments;
+                const float c0 = mRadius * std::cos(a0), s0 = mRadius * std::sin(a0);
+                const float c1 = mRadius * std::cos(a1), s1 = mRadius * std::sin(a1);
+                // Rings at both ends of the side
+                add(Vec3(c0, -mHalfLength, s0), Vec3(c1, -mHalfLength, s1));
+                add(Vec3(c0, mHalfLength, s0), Vec3(c1, mHalfLength, s1));
+                // Arcs over the caps in the xy and zy planes
+                const float cap = a0 < kPi ? mHalfLength : -mHalfLength;
+                add(Vec3(c0, cap + s0, 0.f), Vec3(c1, cap + s1, 0.f));
+                add(Vec3(0.f, cap + s0, c0), Vec3(0.f, cap + s1, c1));
+        }
+        for(int i = 0; i < 4; ++i)
+        {
+                const float angle = 0.5f * kPi * i;
+                const float c = mRadius * std::cos(angle), s = mRadius * std::sin(angle);
+                add(Vec3(c, -mHalfLength, s), Vec3(c, mHalfLength, s));
+        }
+}
+
+Box CapsuleCollider::localBounds() const
+{
+        Box box;
+        box.add(Vec3(-mRadius, -mHalfLength - mRadius, -mRadius));
+        box.add(Vec3(mRadius, mHalfLength + mRadius, mRadius));
+        return box;
+}
+
+// MeshCollider
+
+MeshCollider::MeshCollider(std::vector<Vec3> const& vertices,
+                std::vector<unsigned int> const& triangles) :
+        mPrevious(vertices),
+        mVertices(vertices),
+        mTriangles(triangles),
+        mDeforming(false)
+{
+        mBvh.build(mVertices, mTriangles);
+        updateBounds();
+}
+
+void MeshCollider::setVertices(std::vector<Vec3> const& vertices)
+{
+        mPrevious.swap(mVertices);
+        mVertices = vertices;
+        mDeforming = mPrevious != mVertices;
+        mBvh.refit(mPrevious, mVertices);
+        updateBounds();
+}
+
+bool MeshCollider::sweep(Vec3 const& a, Vec3 const& b, float start, float,
+                CollisionHit& hit) const
+{
+        Box path;
+        path.add(a);
+        path.add(b);
+        hit.t = 2.f;
+        mBvh.query(path, [&](unsigned int t)
+        {
+                CollisionHit candidate;
+                candidate.motion = Vec3(0.f, 0.f, 0.f);
+                if(sweepTriangle(t, a, b, start, candidate) && candidate.t < hit.t) hit = candidate;
+        });
+        return hit.t <= 1.f;
+}
+
+bool MeshCollider::sweepTriangle(unsigned int t, Vec3 const& a, Vec3 const& b, float start,
+                CollisionHit& hit) const
+{
+        const unsigned int i0 = mTriangles[3 * t];
+        const unsigned int i1 = mTriangles[3 * t + 1];
+        const unsigned int i2 = mTriangles[3 * t + 2];
+
+        // The triangle at a fraction u of the swept segment
+        auto corners = [&](float u, Vec3& v0, Vec3& v1, Vec3& v2)
+        {
+                if(!mDeforming)
+                {
+                        v0 = mVertices[i0];
+                        v1 = mVertices[i1];
+                        v2 = mVertices[i2];
+                        return;
+                }
+                const float s = start + u * (1.f - start);
+                v0 = lerp(mPrevious[i0], mVertices[i0], s);
+                v1 = lerp(mPrevious[i1], mVertices[i1], s);
+                v2 = lerp(mPrevious[i2], mVertices[i2], s);
+        };
+        // Signed volume of the point and the triangle, zero when coplanar
+        auto volume = [&](float u)
+        {
+                Vec3 v0, v1, v2;
+                corners(u, v0, v1, v2);
+                return dot(lerp(a, b, u) - v0, cross(v1 - v0, v2 - v0));
+        };
+
+        float roots[3];
+        int count = 0;
+        const float f0 = volume(0.f);
+        if(!mDeforming)
+        {
+                // Linear in u for a still triangle
+                const float f1 = volume(1.f);
+                if(f0 == f1 || (f0 < 0.f) == (f1 < 0.f)) return false;
+                roots[count++] = f0 / (f0 - f1);
+        }
+        else
+        {
+                // A cubic, fitted through four samples
+                const float f1 = volume(1.f / 3.f);
+                const float f2 = volume(2.f / 3.f);
+                const float f3 = volume(1.f);
+                const float c3 = 4.5f * (f3 - 3.f * f2 + 3.f * f1 - f0);
+                const float c2 = 4.5f * (-f3 + 4.f * f2 - 5.f * f1 + 2.f * f0);
+                const float c1 = 0.5f * (2.f * f3 - 9.f * f2 + 18.f * f1 - 11.f * f0);
+                count = unitRoots(f0, c1, c2, c3, roots);
+        }
+
+        for(int r = 0; r < count; ++r)
+        {
+                const float u = roots[r];
+                Vec3 v0, v1, v2;
+                corners(u, v0, v1, v2);
+                const Vec3 p = lerp(a, b, u);
+                const Vec3 e0 = v1 - v0, e1 = v2 - v0, w = p - v0;
+                const float d00 = dot(e0, e0), d01 = dot(e0, e1), d11 = dot(e1, e1);
+                const float d20 = dot(w, e0), d21 = dot(w, e1);
+                const float denominator = d00 * d11 - d01 * d01;
+                if(denominator <= 0.f) continue;
+                const float beta = (d11 * d20 - d01 * d21) / denominator;
+                const float gamma = (d00 * d21 - d01 * d20) / denominator;
+                if(beta < -kEdgeTolerance || gamma < -kEdgeTolerance ||
+                                beta + gamma > 1.f + kEdgeTolerance) continue;
+
+                // Facing the side the point came from
+                const Vec3 n = normalize(cross(e0, e1));
+                hit.t = u;
+                hit.point = p;
+                hit.normal = f0 < 0.f ? -n : n;
+                hit.motion = Vec3(0.f, 0.f, 0.f);
+                if(mDeforming)
+                {
+                        const float alpha = 1.f - beta - gamma;
+                        hit.motion = (mVertices[i0] - mPrevious[i0]) * alpha +
+                                (mVertices[i1] - mPrevious[i1]) * beta +
+                                (mVertices[i2] - mPrevious[i2]) * gamma;
+                }
+                return true;
+        }
+        return false;
+}
+
+void MeshCollider::outline(std::vector<Vec3>& lines) const
+{
+        for(size_t t = 0; t + 2 < mTriangles.size(); t += 3)
+        {
+                for(int e = 0; e < 3; ++e)
+                {
+                        lines.push_back(pose().apply(mVertices[mTriangles[t + e]]));
+                        lines.push_back(pose().apply(mVertices[mTriangles[t + (e + 1) % 3]]));
+                }
+        }
+}
+
+Box MeshCollider::localBounds() const
+{
+        return mBvh.nodeCount() > 0 ? mBvh.bounds() : Box();
+}
+
+// CollisionWorld
+
+CollisionWorld::CollisionWorld() :
+        mRadius(0.f),
+        mRestitution(0.f),
+        mFriction(0.3f)
+{ }
+
+void CollisionWorld::movingBounds(std::vector<Box>& boxes) const
+{
+        boxes.clear();
+        for(auto const& collider : mColliders)
+        {
+                if(!collider->isMoving()) continue;
+                boxes.push_back(collider->bounds());
+                boxes.back().inflate(mRadius);
+        }
+}
+
+bool CollisionWorld::sweptBy(Vec3 const& point) const
+{
+        Box box;
+        box.add(point);
+        box.inflate(mRadius);
+        for(auto const& collider : mColliders)
+        {
+                if(!collider->isMoving() || !collider->bounds().overlaps(box)) continue;
+                // In the collider's frame the still point traces the
+                // collider's motion backwards
+                CollisionHit hit;
+                hit.motion = Vec3(0.f, 0.f, 0.f);
+                if(collider->sweep(collider->previousPose().inverse(point), collider->pose().inverse(point),
+                                        0.f, mRadius, hit))
+                        return true;
+        }
+        return false;
+}
+
+bool CollisionWorld::collide(Vec3 const& start, Vec3& end, Vec3& velocity, float dt) const
+{
+        Vec3 a = start;
+        Vec3 b = end;
+        float s0 = 0.f;
+        bool contact = false;
+        for(int c = 0; c < kMaxContacts; ++c)
+        {
+                Box path;
+                path.add(a);
+                path.add(b);
+                path.inflate(mRadius);
+
+                // The earliest contact over all colliders
+                CollisionHit best;
+                best.t = 2.f;
+                Collider const* hitCollider = nullptr;
+                for(auto const& collider : mColliders)
+                {
+                        if(!collider->bounds().overlaps(path)) continue;
+                        RigidPose const& from = collider->previousPose();
+                        RigidPose const& to = collider->pose();
+                        const Vec3 la = lerp(from.inverse(a), to.inverse(a), s0);
+                        const Vec3 lb = to.inverse(b);
+                        CollisionHit hit;
+                        hit.motion = Vec3(0.f, 0.f, 0.f);
+                        if(collider->sweep(la, lb, s0, mRadius, hit) && hit.t < best.t)
+                        {
+                                best = hit;
+                                hitCollider = collider.get();
+                        }
+                }
+                if(!hitCollider)
+                {
+                        end = b;
+                        return contact;
+                }
+                contact = true;
+
+                // Back to world space at the time of contact
+                RigidPose const& from = hitCollider->previousPose();
+                RigidPose const& to = hitCollider->pose();
+                const float s = s0 + best.t * (1.f - s0);
+                const Vec3 p0 = from.apply(best.point), p1 = to.apply(best.point);
+                const Vec3 point = lerp(p0, p1, s);
+                const Vec3 n = normalize(lerp(from.rotate(best.normal), to.rotate(best.normal), s));
+
+                // Response relative to the surface, which may be moving
+                const Vec3 surface = (p1 - p0 + to.rotate(best.motion)) * (1.f / dt);
+                Vec3 relative = velocity - surface;
+                const float vn = dot(relative, n);
+                if(vn < 0.f)
+                {
+                        const Vec3 tangent = relative - n * vn;
+                        const float speed = length(tangent);
+                        const float impulse = (1.f + mRestitution) * -vn;
+                        const float keep = speed > 0.f ?
+                                std::max(0.f, 1.f - mFriction * impulse / speed) : 0.f;
+                        relative = tangent * keep - n * (mRestitution * vn);
+                }
+                velocity = relative + surface;
+
+                // On for the rest of the step from just off the surface
+                a = point + n * kSkin;
+                s0 = s;
+                b = a + velocity * ((1.f - s) * dt);
+        }
+
+        // Out of contacts to resolve; stay at the last one
+        end = a;
+        return true;
+}
@@ -0,0 +1,422 @@
+#include "ControlServer.hpp"
+
+#include <atlas/core/Log.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+        // Poll timeouts in milliseconds: while replies are outstanding, while
+        // telemetry is streaming, and otherwise
+        const int kReplyPoll = 1;
+        const int kTelemetryPoll = 5;
+        const int kIdlePoll = 100;
+
+        // Telemetry for a client that is not reading is dropped past this
+        const size_t kMaxOutput = 1 << 20;
+
+        // Longest command line accepted
+        const size_t kMaxInput = 1 << 16;
+
+        void setNonBlocking(int fd)
+        {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        }
+
+        std::vector<std::string> split(std::string const& line)
+        {
+                std::vector<std::string> words;
+                std::istringstream stream(line);
+                std::string word;
+                while(stream >> word) words.push_back(word);
+                return words;
+        }
+}
+
+ControlServer::ControlServer(std::string const& path, SimulationThread& simulation,
+                Tunable& target) :
+        mPath(path),
+        mSimulation(simulation),
+        mTarget(target),
+        mListen(-1),
+        mRunning(false),
+        mNextId(0),
+        mReplies(1024),
+        mSubscribers(0)
+{
+        mWake[0] = mWake[1] = -1;
+}
+
+ControlServer::~ControlServer()
+{
+        stop();
+        mSimulation.setObserver(nullptr);
+}
+
+bool ControlServer::start()
+{
+        USING_ATLAS_CORE_NS;
+
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if(mPath.size() >= sizeof(address.sun_path))
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Control socket path too long: " + mPath);
+                return false;
+        }
+        std::strncpy(address.sun_path, mPath.c_str(), sizeof(address.sun_path) - 1);
+
+        // A socket left over from an earlier run would make bind fail, but
+        // anything else at the path is left alone
+        struct stat info;
+        if(lstat(mPath.c_str(), &info) == 0)
+        {
+                if(!S_ISSOCK(info.st_mode))
+                {
+                        Log::log(Log::SeverityLevel::ERROR, "Not replacing " + mPath +
+                                        ", it exists and is not a socket");
+                        return false;
+                }
+                unlink(mPath.c_str());
+        }
+
+        mListen = socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool bound = mListen >= 0 &&
+                bind(mListen, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        if(!bound || listen(mListen, 8) < 0 || pipe(mWake) < 0)
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Could not open control socket " + mPath +
+                                ": " + std::strerror(errno));
+                if(mListen >= 0) close(mListen);
+                if(bound) unlink(mPath.c_str());
+                mListen = -1;
+                return false;
+        }
+        setNonBlocking(mListen);
+
+        // Only now, so a server that failed to start is never called from
+        // the physics thread
+        mSimulation.setObserver([this](unsigned long long step, double seconds)
+        {
+                observe(step, seconds);
+        });
+
+        mRunning.store(true);
+        mThread = std::thread(&ControlServer::run, this);
+        Log::log(Log::SeverityLevel::INFO, "Listening for control commands on " + mPath);
+        return true;
+}
+
+void ControlServer::stop()
+{
+        mSimulation.setObserver(nullptr);
+        if(!mThread.joinable()) return;
+        mRunning.store(false);
+        const char byte = 0;
+        if(write(mWake[1], &byte, 1) < 0) { }
+        mThread.join();
+
+        for(auto& entry : mClients) close(entry.second.fd);
+        mClients.clear();
+        close(mListen);
+        close(mWake[0]);
+        close(mWake[1]);
+        mListen = mWake[0] = mWake[1] = -1;
+        unlink(mPath.c_str());
+}
+
+void ControlServer::observe(unsigned long long step, double seconds)
+{
+        if(mSubscribers.load(std::memory_order_relaxed) == 0) return;
+        // Measured by the step itself, so this costs no extra pass
+        Observables const& observables = mTarget.observables();
+        Sample sample;
+        sample.step = step;
+        sample.energy = static_cast<float>(observables.energy());
+        sample.seconds = static_cast<float>(seconds);
+        sample.kinetic = static_cast<float>(observables.kinetic);
+        sample.strain = static_cast<float>(observables.strain);
+        sample.maxStrain = static_cast<float>(observables.maxStrain);
+        mTelemetry.push(sample);
+}
+
+void ControlServer::run()
+{
+        std::vector<pollfd> fds;
+        std::vector<int> ids;
+        int pending = 0;
+
+        while(mRunning.load())
+        {
+                fds.clear();
+                ids.clear();
+                fds.push_back({mWake[0], POLLIN, 0});
+                fds.push_back({mListen, POLLIN, 0});
+                for(auto const& entry : mClients)
+                {
+                        const short events = entry.second.output.empty() ?
+                                POLLIN : static_cast<short>(POLLIN | POLLOUT);
+                        fds.push_back({entry.second.fd, events, 0});
+                        ids.push_back(entry.first);
+                }
+
+                const int timeout = pending > 0 ? kReplyPoll :
+                        mSubscribers.load() > 0 ? kTelemetryPoll : kIdlePoll;
+                if(poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) break;
+                if(fds[0].revents & POLLIN) break;
+                if(fds[1].revents & POLLIN) accept();
+
+                for(size_t i = 0; i < ids.size(); ++i)
+                {
+                        auto it = mClients.find(ids[i]);
+                        Client& client = it->second;
+                        const short revents = fds[i + 2].revents;
+                        bool open = true;
+                        if(revents & (POLLIN | POLLHUP | POLLERR))
+                        {
+                                open = receive(client);
+
+                                // Execute every complete line
+                                size_t start = 0;
+                                for(size_t end = client.input.find('\n');
+                                                end != std::string::npos;
+                                                end = client.input.find('\n', start))
+                                {
+                                        if(execute(it->first, client.input.substr(start, end - start)))
+                                                ++pending;
+                                        start = end + 1;
+                                }
+                                client.input.erase(0, start);
+                                if(client.input.size() > kMaxInput) open = false;
+                        }
+                        if(!open)
+                        {
+                                if(client.every > 0) mSubscribers.fetch_sub(1);
+                                close(client.fd);
+                                mClients.erase(it);
+                        }
+                }
+
+                // Replies from the physics thread, then telemetry
+                pending -= static_cast<int>(mReplies.drain());
+                if(pending < 0) pending = 0;
+                sendTelemetry();
+
+                for(auto it = mClients.begin(); it != mClients.end();)
+                {
+                        if(!flush(it->second))
+                        {
+                                if(it->second.every > 0) mSubscribers.fetch_sub(1);
+                                close(it->second.fd);
+                                it = mClients.erase(it);
+                        }
+                        else ++it;
+                }
+        }
+}
+
+void ControlServer::accept()
+{
+        for(;;)
+        {
+                const int fd = ::accept(mListen, nullptr, nullptr);
+                if(fd < 0) return;
+                setNonBlocking(fd);
+                Client client;
+                client.fd = fd;
+                client.every = 0;
+                mClients[mNextId++] = client;
+        }
+}
+
+bool ControlServer::receive(Client& client)
+{
+        char buffer[4096];
+        for(;;)
+        {
+                const ssize_t count = read(client.fd, buffer, sizeof(buffer));
+                if(count > 0) client.input.append(buffer, count);
+                else if(count == 0) return false;
+                else return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+}
+
+bool ControlServer::flush(Client& client)
+{
+        while(!client.output.empty())
+        {
+                const ssize_t count = send(client.fd, client.output.data(),
+                                client.output.size(), MSG_NOSIGNAL);
+                if(count > 0) client.output.erase(0, count);
+                else return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+        }
+        return true;
+}
+
+void ControlServer::reply(int id, std::string const& text)
+{
+        auto it = mClients.find(id);
+        if(it != mClients.end()) it->second.output += text + "\n";
+}
+
+bool ControlServer::execute(int id, std::string const& line)
+{
+        const std::vector<std::string> words = split(line);
+        // Every reply is produced on the physics thread, so replies keep the
+        // order of the commands
+        bool posted = false;
+        auto post = [this, id, &posted](std::function<std::string()> command)
+        {
+                posted = mSimulation.post([this, id, command]()
+                {
+                        const std::string text = command();
+                        // Queued as a command for the server thread. The
+                        // queue holds more than the simulation's, it only
+                        // fills up if the server has stopped draining it.
+                        mReplies.push([this, id, text]() { reply(id, text); });
+                });
+                if(!posted) reply(id, "error busy");
+        };
+
+        if(words.empty())
+        {
+                post([]() { return std::string("error empty command"); });
+        }
+        else if(words[0] == "set")
+        {
+                std::vector<Tunable::Parameter> values;
+                for(size_t i = 1; i < words.size(); ++i)
+                {
+                        const size_t equals = words[i].find('=');
+                        char* end = nullptr;
+                        const float value = equals == std::string::npos ? 0.f :
+                                std::strtof(words[i].c_str() + equals + 1, &end);
+                        if(equals == std::string::npos || end == words[i].c_str() + equals + 1)
+                        {
+                                const std::string word = words[i];
+                                post([word]() { return "error bad assignment " + word; });
+                                return posted;
+                        }
+                        values.push_back(Tunable::Parameter(words[i].substr(0, equals), value));
+                }
+                post([this, values]()
+                {
+                        mTarget.wake();
+                        std::string unknown;
+                        for(auto const& value : values)
+                                if(!mTarget.setParameter(value.first, value.second))
+                                        unknown += " " + value.first;
+                        return unknown.empty() ? std::string("ok") : "error rejected" + unknown;
+                });
+        }
+        else if(words[0] == "pause" || words[0] == "resume")
+        {
+                const bool paused = words[0] == "pause";
+                post([this, paused]()
+                {
+                        mSimulation.setPaused(paused);
+                        return std::string("ok");
+                });
+        }
+        else if(words[0] == "step")
+        {
+                const long steps = words.size() > 1 ? std::atol(words[1].c_str()) : 1;
+                post([this, steps]()
+                {
+                        if(steps <= 0) return std::string("error bad step count");
+                        mTarget.wake();
+                        mSimulation.requestSteps(static_cast<unsigned int>(steps));
+                        return std::string("ok");
+                });
+        }
+        else if(words[0] == "reset")
+        {
+                post([this]()
+                {
+                        mTarget.reset();
+                        mTarget.wake();
+                        return std::string("ok");
+                });
+        }
+        else if(words[0] == "get")
+        {
+                post([this]()
+                {
+                        std::vector<Tunable::Parameter> values;
+                        mTarget.parameters(values);
+                        std::ostringstream out;
+                        out << "state";
+                        for(auto const& value : values) out << ' ' << value.first << '=' << value.second;
+                        out << " energy=" << mTarget.energy() <<
+                                " steps=" << mSimulation.steps() <<
+                                " paused=" << (mSimulation.isPaused() ? 1 : 0);
+                        return out.str();
+                });
+        }
+        else if(words[0] == "history")
+        {
+                post([this]()
+                {
+                        ObservableSeries const& series = mTarget.series();
+                        std::ostringstream out;
+                        out << "history every=" << series.every();
+                        for(auto const& sample : series.samples())
+                        {
+                                out << ' ' << sample.step << ':' << sample.kinetic << ':' <<
+                                        sample.potential << ':' << sample.strain;
+                        }
+                        return out.str();
+                });
+        }
+        else if(words[0] == "subscribe" || words[0] == "unsubscribe")
+        {
+                Client& client = mClients[id];
+                const long every = words[0] == "unsubscribe" ? 0 :
+                        words.size() > 1 ? std::max(1L, std::atol(words[1].c_str())) : 1;
+                if(client.every == 0 && every > 0) mSubscribers.fetch_add(1);
+                if(client.every > 0 && every == 0) mSubscribers.fetch_sub(1);
+                client.every = static_cast<unsigned long long>(every);
+                post([]() { return std::string("ok"); });
+        }
+        else
+        {
+                const std::string word = words[0];
+                post([word]() { return "error unknown command " + word; });
+        }
+        return posted;
+}
+
+void ControlServer::sendTelemetry()
+{
+        Sample sample;
+        char line[192];
+        const double rate = mSimulation.rate();
+        while(mTelemetry.pop(sample))
+        {
+                const int length = std::snprintf(line, sizeof(line),
+                                "t %llu %.6f %.9g %.3f %.9g %.6g %.6g\n",
+                                sample.step, sample.step / rate, sample.energy,
+                                sample.seconds * 1e6f, sample.kinetic, sample.strain,
+                                sample.maxStrain);
+                for(auto& entry : mClients)
+                {
+                        Client& client = entry.second;
+                        if(client.every == 0 || sample.step % client.every != 0) continue;
+                        if(client.output.size() < kMaxOutput) client.output.append(line, length);
+                }
+        }
+}
@@ -0,0 +1,176 @@
+#include "Determinism.hpp"
+#include "Checksum.hpp"
+#include "Collision.hpp"
+#include "ParallelStepper.hpp"
+#include "SpringSystem.hpp"
+
+#include <atlas/core/Log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+        struct RunResult
+        {
+                double seconds;         // Stepping only
+                double checksumSeconds;
+                ChecksumLog log;
+        };
+
+        // Zero threads steps the system serially
+        RunResult run(DeterminismOptions const& options, unsigned int threads,
+                        ParallelStepper::Mode mode)
+        {
+                auto floor = std::make_shared<CollisionWorld>();
+                floor->add(std::make_shared<PlaneCollider>());
+                SpringSystem system;
+                buildCloth(system, options.lattice);
+                system.setColliders(floor);
+
+                std::unique_ptr<ParallelStepper> stepper;
+                if(threads > 0) stepper.reset(new ParallelStepper(system, threads, mode));
+
+                RunResult result;
+                result.seconds = 0.0;
+                result.checksumSeconds = 0.0;
+                for(int step = 0; step < options.steps; ++step)
+                {
+                        const auto start = std::chrono::steady_clock::now();
+                        if(stepper) stepper->step(options.dt);
+                        else system.step(options.dt);
+                        const auto stepped = std::chrono::steady_clock::now();
+                        result.log.record(system.particles());
+                        const auto summed = std::chrono::steady_clock::now();
+                        result.seconds += std::chrono::duration<double>(stepped - start).count();
+                        result.checksumSeconds += std::chrono::duration<double>(summed - stepped).count();
+                }
+                return result;
+        }
+
+        std::string agreement(ChecksumLog const& log, ChecksumLog const& reference,
+                        std::string const& name)
+        {
+                const size_t step = log.firstDivergence(reference);
+                return step == 0 ? "identical to " + name :
+                        "first differs from " + name + " at step " + std::to_string(step);
+        }
+}
+
+DeterminismOptions::DeterminismOptions() :
+        steps(2000),
+        lattice(96),
+        dt(1.f / 600.f),
+        threads(0)
+{ }
+
+bool parseDeterminismOptions(int argc, char** argv, DeterminismOptions& options)
+{
+        bool determinism = false;
+        for(int i = 1; i < argc; ++i)
+        {
+                const std::string arg = argv[i];
+                const bool hasValue = i + 1 < argc;
+                if(arg == "--determinism" && hasValue)
+                {
+                        determinism = true;
+                        options.steps = std::atoi(argv[++i]);
+                }
+                else if(arg == "--lattice" && hasValue)
+                        options.lattice = std::atoi(argv[++i]);
+                else if(arg == "--dt" && hasValue)
+                        options.dt = static_cast<float>(std::atof(argv[++i]));
+                else if(arg == "--threads" && hasValue)
+                        options.threads = std::atoi(argv[++i]);
+                else if(arg == "--checksums" && hasValue)
+                        options.checksums = argv[++i];
+                else if(arg == "--golden" && hasValue)
+                        options.golden = argv[++i];
+        }
+        return determinism;
+}
+
+int runDeterminism(DeterminismOptions const& options)
+{
+        USING_ATLAS_CORE_NS;
+
+        if(options.steps <= 0 || options.lattice < 2 || options.dt <= 0.f || options.threads < 0)
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Invalid determinism steps, lattice, step or threads");
+                return 1;
+        }
+
+        const unsigned int maxThreads = options.threads > 0 ?
+                static_cast<unsigned int>(options.threads) :
+                std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned int> counts;
+        for(unsigned int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+        counts.push_back(maxThreads);
+
+        const double particleSteps = static_cast<double>(options.lattice) * options.lattice * options.steps;
+        auto throughput = [particleSteps](RunResult const& result)
+        {
+                return std::to_string(particleSteps / result.seconds) + " particle steps/s";
+        };
+
+        const RunResult serial = run(options, 0, ParallelStepper::Mode::Deterministic);
+        Log::log(Log::SeverityLevel::INFO, "serial: " + throughput(serial) + ", checksums " +
+                        std::to_string(1e6 * serial.checksumSeconds / options.steps) + " us per step");
+
+        int status = 0;
+        ChecksumLog reference;
+        ChecksumLog fastReference;
+        for(unsigned int threads : counts)
+        {
+                const RunResult ordered = run(options, threads, ParallelStepper::Mode::Deterministic);
+                const RunResult fast = run(options, threads, ParallelStepper::Mode::Fast);
+                if(threads == 1)
+                {
+                        reference = ordered.log;
+                        fastReference = fast.log;
+                        // The deterministic mode promises the serial result
+                        const bool serialMatch = ordered.log.firstDivergence(serial.log) == 0;
+                        Log::log(serialMatch ? Log::SeverityLevel::INFO : Log::SeverityLevel::ERROR,
+                                        "deterministic, 1 thread: " +
+                                        agreement(ordered.log, serial.log, "the serial step"));
+                        if(!serialMatch) status = 1;
+                }
+                if(ordered.log.firstDivergence(reference) != 0) status = 1;
+
+                const std::string suffix = threads == 1 ? " thread: " : " threads: ";
+                Log::log(Log::SeverityLevel::INFO, "deterministic, " + std::to_string(threads) + suffix +
+                                throughput(ordered) + ", " + agreement(ordered.log, reference, "1 thread"));
+                Log::log(Log::SeverityLevel::INFO, "fast, " + std::to_string(threads) + suffix +
+                                throughput(fast) + ", " + agreement(fast.log, fastReference, "1 thread"));
+        }
+
+        if(!options.checksums.empty() && !reference.write(options.checksums))
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Could not write " + options.checksums);
+                status = 1;
+        }
+        if(!options.golden.empty())
+        {
+                ChecksumLog golden;
+                if(!golden.read(options.golden))
+                {
+                        Log::log(Log::SeverityLevel::ERROR, "Could not read " + options.golden);
+                        status = 1;
+                }
+                else if(golden.size() != reference.size() || golden.firstDivergence(reference) != 0)
+                {
+                        const size_t step = golden.firstDivergence(reference);
+                        Log::log(Log::SeverityLevel::ERROR, step == 0 ?
+                                        "The golden checksums cover " + std::to_string(golden.size()) +
+                                        " steps, this run " + std::to_string(reference.size()) :
+                                        "Differs from the golden checksums at step " + std::to_string(step));
+                        status = 1;
+                }
+                else Log::log(Log::SeverityLevel::INFO, "Matches the golden checksums");
+        }
+        return status;
+}
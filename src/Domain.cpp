@@ -0,0 +1,195 @@
+#include "Domain.hpp"
+
+#include <algorithm>
+#include <map>
+
+namespace
+{
+        // Position and velocity of each halo particle
+        const size_t kHaloFloats = 6;
+
+        void sortUnique(std::vector<unsigned int>& values)
+        {
+                std::sort(values.begin(), values.end());
+                values.erase(std::unique(values.begin(), values.end()), values.end());
+        }
+
+        void pack(ParticleSet const& p, size_t i, float* out)
+        {
+                out[0] = p.x[i];
+                out[1] = p.y[i];
+                out[2] = p.z[i];
+                out[3] = p.vx[i];
+                out[4] = p.vy[i];
+                out[5] = p.vz[i];
+        }
+
+        void unpack(float const* in, ParticleSet& p, size_t i)
+        {
+                p.x[i] = in[0];
+                p.y[i] = in[1];
+                p.z[i] = in[2];
+                p.vx[i] = in[3];
+                p.vy[i] = in[4];
+                p.vz[i] = in[5];
+        }
+
+        size_t copyParticle(ParticleSet const& from, size_t i, ParticleSet& to)
+        {
+                const size_t local = to.add(from.x[i], from.y[i], from.z[i], 0.f);
+                to.vx[local] = from.vx[i];
+                to.vy[local] = from.vy[i];
+                to.vz[local] = from.vz[i];
+                to.invMass[local] = from.invMass[i];
+                return local;
+        }
+}
+
+SpringDomain::SpringDomain(SpringSystem const& global, std::vector<unsigned int> const& partOf,
+                HaloTransport& transport) :
+        mTransport(transport),
+        mPartOf(partOf)
+{
+        const unsigned int rank = static_cast<unsigned int>(transport.rank());
+        ParticleSet const& gp = global.particles();
+        SpringSet const& gs = global.springs();
+        ParticleSet& p = mSystem.particles();
+
+        std::vector<unsigned int> local(gp.size(), 0);
+        for(size_t i = 0; i < gp.size(); ++i)
+        {
+                if(partOf[i] != rank) continue;
+                local[i] = static_cast<unsigned int>(copyParticle(gp, i, p));
+                mOwned.push_back(static_cast<unsigned int>(i));
+        }
+
+        // A particle owned here is sent to every domain one of its springs
+        // reaches, which is exactly the set that domain holds as ghosts
+        // from here; both sides list them in ascending global order
+        std::map<unsigned int, std::pair<std::vector<unsigned int>, std::vector<unsigned int>>> halo;
+        for(size_t s = 0; s < gs.size(); ++s)
+        {
+                const unsigned int a = gs.a[s], b = gs.b[s];
+                const unsigned int pa = partOf[a], pb = partOf[b];
+                if(pa == pb || (pa != rank && pb != rank)) continue;
+                const unsigned int mine = pa == rank ? a : b;
+                const unsigned int theirs = pa == rank ? b : a;
+                auto& lists = halo[pa == rank ? pb : pa];
+                lists.first.push_back(mine);
+                lists.second.push_back(theirs);
+        }
+
+        mNeighbours.reserve(halo.size());
+        for(auto& entry : halo)
+        {
+                sortUnique(entry.second.first);
+                sortUnique(entry.second.second);
+
+                Neighbour neighbour;
+                neighbour.rank = static_cast<int>(entry.first);
+                for(unsigned int i : entry.second.first) neighbour.send.push_back(local[i]);
+                neighbour.ghostBegin = p.size();
+                for(unsigned int i : entry.second.second)
+                        local[i] = static_cast<unsigned int>(copyParticle(gp, i, p));
+                neighbour.ghostEnd = p.size();
+                neighbour.sendBuffer.resize(neighbour.send.size() * kHaloFloats);
+                neighbour.receiveBuffer.resize((neighbour.ghostEnd - neighbour.ghostBegin) * kHaloFloats);
+                mNeighbours.push_back(std::move(neighbour));
+        }
+
+        SpringSet& springs = mSystem.springs();
+        for(size_t s = 0; s < gs.size(); ++s)
+        {
+                if(partOf[gs.a[s]] != rank && partOf[gs.b[s]] != rank) continue;
+                springs.add(local[gs.a[s]], local[gs.b[s]], gs.rest[s], gs.k[s], gs.damping[s]);
+        }
+
+        std::array<float, 3> const& gravity = global.gravity();
+        mSystem.setGravity(gravity[0], gravity[1], gravity[2]);
+        mSystem.setDamping(global.damping());
+        mSystem.setColliders(global.colliders());
+
+        for(Neighbour& neighbour : mNeighbours)
+        {
+                mSends.push_back(HaloTransport::Buffer(neighbour.rank,
+                                        neighbour.sendBuffer.data(), neighbour.sendBuffer.size()));
+                mReceives.push_back(HaloTransport::Buffer(neighbour.rank,
+                                        neighbour.receiveBuffer.data(), neighbour.receiveBuffer.size()));
+        }
+}
+
+void SpringDomain::step(float dt)
+{
+        // Ghosts pick up forces too, but are never integrated here
+        mSystem.computeForces();
+        mSystem.integrate(dt, 0, mOwned.size());
+        exchangeHalo();
+}
+
+void SpringDomain::exchangeHalo()
+{
+        ParticleSet& p = mSystem.particles();
+        for(Neighbour& neighbour : mNeighbours)
+        {
+                float* out = neighbour.sendBuffer.data();
+                for(unsigned int i : neighbour.send)
+                {
+                        pack(p, i, out);
+                        out += kHaloFloats;
+                }
+        }
+
+        mTransport.exchange(mSends, mReceives);
+
+        for(Neighbour& neighbour : mNeighbours)
+        {
+                float const* in = neighbour.receiveBuffer.data();
+                for(size_t i = neighbour.ghostBegin; i < neighbour.ghostEnd; ++i, in += kHaloFloats)
+                        unpack(in, p, i);
+        }
+}
+
+void SpringDomain::gather(SpringSystem& global)
+{
+        ParticleSet const& p = mSystem.particles();
+        if(mTransport.rank() != 0)
+        {
+                std::vector<float> state(mOwned.size() * kHaloFloats);
+                for(size_t i = 0; i < mOwned.size(); ++i) pack(p, i, &state[i * kHaloFloats]);
+                mTransport.exchange({HaloTransport::Buffer(0, state.data(), state.size())}, {});
+                return;
+        }
+
+        ParticleSet& gp = global.particles();
+        for(size_t i = 0; i < mOwned.size(); ++i)
+        {
+                float state[kHaloFloats];
+                pack(p, i, state);
+                unpack(state, gp, mOwned[i]);
+        }
+
+        // Ranks send their particles in ascending global order
+        std::vector<std::vector<unsigned int>> owners(mTransport.size());
+        for(size_t i = 0; i < mPartOf.size(); ++i)
+                if(mPartOf[i] != 0) owners[mPartOf[i]].push_back(static_cast<unsigned int>(i));
+
+        std::vector<std::vector<float>> states(mTransport.size());
+        std::vector<HaloTransport::Buffer> receives;
+        for(int r = 1; r < mTransport.size(); ++r)
+        {
+                states[r].resize(owners[r].size() * kHaloFloats);
+                receives.push_back(HaloTransport::Buffer(r, states[r].data(), states[r].size()));
+        }
+        mTransport.exchange({}, receives);
+
+        for(int r = 1; r < mTransport.size(); ++r)
+                for(size_t i = 0; i < owners[r].size(); ++i)
+                        unpack(&states[r][i * kHaloFloats], gp, owners[r][i]);
+}
+
+size_t SpringDomain::haloFloats() const
+{
+        size_t floats = 0;
+        for(Neighbour const& neighbour : mNeighbours) floats += neighbour.sendBuffer.size();
+        return floats;
+}
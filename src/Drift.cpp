@@ -0,0 +1,231 @@
+#include "Drift.hpp"
+#include "SpringSystem.hpp"
+
+#include <atlas/core/Log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+        struct DriftResult
+        {
+                double seconds;
+                double energyDrift;     // Largest |E - E0| / E0 over the run
+                double momentumDrift;   // Largest |P - P0| over the total |m v|
+                std::vector<double> x, y, z;
+        };
+
+        // Drifts are tiny, std::to_string would print them as zero
+        std::string scientific(double value)
+        {
+                char buffer[32];
+                std::snprintf(buffer, sizeof(buffer), "%.3e", value);
+                return buffer;
+        }
+
+        // A cube of particles with springs along the edges and the face
+        // diagonals, floating free without gravity or damping, so that
+        // energy and momentum are both conserved by the equations
+        template <typename System>
+        void buildLattice(DriftOptions const& options, System& system)
+        {
+                const int n = options.lattice;
+                auto index = [n](int i, int j, int l) { return static_cast<size_t>(i + n * (j + n * l)); };
+
+                // Identical starting state in every mode: generated in double,
+                // spinning, with a jitter that has no net momentum
+                unsigned int seed = 12345u;
+                auto random = [&seed]()
+                {
+                        seed = seed * 1664525u + 1013904223u;
+                        return static_cast<double>(seed >> 8) / 16777216.0 - 0.5;
+                };
+                const double centre = 0.5 * (n - 1);
+                const double spin = 0.3;
+                std::vector<double> jitter(3 * n * n * n);
+                for(double& v : jitter) v = random();
+                double mean[3] = {0.0, 0.0, 0.0};
+                for(size_t p = 0; p < jitter.size(); ++p) mean[p % 3] += jitter[p] / (n * n * n);
+
+                system.setGravity(0, 0, 0);
+                for(int l = 0; l < n; ++l)
+                        for(int j = 0; j < n; ++j)
+                                for(int i = 0; i < n; ++i)
+                                {
+                                        const size_t p = system.addParticle(i, j, l, 1);
+                                        auto& particles = system.particles();
+                                        particles.vx[p] = static_cast<typename System::Particles::RealType>(
+                                                        -spin * (j - centre) + jitter[3 * p] - mean[0]);
+                                        particles.vy[p] = static_cast<typename System::Particles::RealType>(
+                                                        spin * (i - centre) + jitter[3 * p + 1] - mean[1]);
+                                        particles.vz[p] = static_cast<typename System::Particles::RealType>(
+                                                        jitter[3 * p + 2] - mean[2]);
+                                }
+
+                for(int l = 0; l < n; ++l)
+                {
+                        for(int j = 0; j < n; ++j)
+                        {
+                                for(int i = 0; i < n; ++i)
+                                {
+                                        const size_t p = index(i, j, l);
+                                        auto spring = [&](int di, int dj, int dl)
+                                        {
+                                                const int ni = i + di, nj = j + dj, nl = l + dl;
+                                                if(ni < 0 || nj < 0 || nl < 0 || ni >= n || nj >= n || nl >= n) return;
+                                                system.addSpring(p, index(ni, nj, nl), options.k, 0);
+                                        };
+                                        spring(1, 0, 0);
+                                        spring(0, 1, 0);
+                                        spring(0, 0, 1);
+                                        spring(1, 1, 0);
+                                        spring(1, -1, 0);
+                                        spring(1, 0, 1);
+                                        spring(1, 0, -1);
+                                        spring(0, 1, 1);
+                                        spring(0, 1, -1);
+                                }
+                        }
+                }
+        }
+
+        template <typename System>
+        DriftResult run(DriftOptions const& options, std::string const& name)
+        {
+                USING_ATLAS_CORE_NS;
+
+                System system;
+                buildLattice(options, system);
+
+                const double e0 = system.energy();
+                const std::array<double, 3> p0 = system.momentum();
+                double scale = 0.0;
+                auto const& particles = system.particles();
+                for(size_t i = 0; i < particles.size(); ++i)
+                {
+                        scale += std::sqrt(static_cast<double>(particles.vx[i]) * particles.vx[i] +
+                                        static_cast<double>(particles.vy[i]) * particles.vy[i] +
+                                        static_cast<double>(particles.vz[i]) * particles.vz[i]) /
+                                particles.invMass[i];
+                }
+
+                DriftResult result;
+                result.seconds = 0.0;
+                result.energyDrift = 0.0;
+                result.momentumDrift = 0.0;
+
+                const int reports = std::max(options.reports, 1);
+                int done = 0;
+                for(int r = 1; r <= reports; ++r)
+                {
+                        // Only the stepping is timed, not the diagnostics
+                        const int target = static_cast<int>(static_cast<long>(options.steps) * r / reports);
+                        const auto start = std::chrono::steady_clock::now();
+                        for(; done < target; ++done) system.step(options.dt);
+                        result.seconds += std::chrono::duration<double>(
+                                        std::chrono::steady_clock::now() - start).count();
+
+                        const double energy = std::fabs(system.energy() - e0) / std::fabs(e0);
+                        const std::array<double, 3> p = system.momentum();
+                        const double momentum = std::sqrt((p[0] - p0[0]) * (p[0] - p0[0]) +
+                                        (p[1] - p0[1]) * (p[1] - p0[1]) +
+                                        (p[2] - p0[2]) * (p[2] - p0[2])) / scale;
+                        result.energyDrift = std::max(result.energyDrift, energy);
+                        result.momentumDrift = std::max(result.momentumDrift, momentum);
+
+                        Log::log(Log::SeverityLevel::INFO, name + " step " + std::to_string(done) +
+                                        ": energy drift " + scientific(energy) +
+                                        ", momentum drift " + scientific(momentum));
+                }
+
+                for(size_t i = 0; i < particles.size(); ++i)
+                {
+                        result.x.push_back(particles.x[i]);
+                        result.y.push_back(particles.y[i]);
+                        result.z.push_back(particles.z[i]);
+                }
+                return result;
+        }
+
+        // Root mean square distance to the double precision positions
+        double error(DriftResult const& result, DriftResult const& reference)
+        {
+                double sum = 0.0;
+                for(size_t i = 0; i < result.x.size(); ++i)
+                {
+                        const double dx = result.x[i] - reference.x[i];
+                        const double dy = result.y[i] - reference.y[i];
+                        const double dz = result.z[i] - reference.z[i];
+                        sum += dx * dx + dy * dy + dz * dz;
+                }
+                return result.x.empty() ? 0.0 : std::sqrt(sum / result.x.size());
+        }
+}
+
+DriftOptions::DriftOptions() :
+        steps(100000),
+        lattice(6),
+        dt(1.f / 600.f),
+        k(100.f),
+        reports(10)
+{ }
+
+bool parseDriftOptions(int argc, char** argv, DriftOptions& options)
+{
+        bool drift = false;
+        for(int i = 1; i < argc; ++i)
+        {
+                const std::string arg = argv[i];
+                const bool hasValue = i + 1 < argc;
+                if(arg == "--drift" && hasValue)
+                {
+                        drift = true;
+                        options.steps = std::atoi(argv[++i]);
+                }
+                else if(arg == "--lattice" && hasValue)
+                        options.lattice = std::atoi(argv[++i]);
+                else if(arg == "--dt" && hasValue)
+                        options.dt = static_cast<float>(std::atof(argv[++i]));
+                else if(arg == "--stiffness" && hasValue)
+                        options.k = static_cast<float>(std::atof(argv[++i]));
+                else if(arg == "--reports" && hasValue)
+                        options.reports = std::atoi(argv[++i]);
+        }
+        return drift;
+}
+
+int runDrift(DriftOptions const& options)
+{
+        USING_ATLAS_CORE_NS;
+
+        if(options.steps <= 0 || options.lattice < 2 || options.dt <= 0.f || options.k <= 0.f)
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Invalid drift steps, lattice, step or stiffness");
+                return 1;
+        }
+
+        const DriftResult single = run<SpringSystem>(options, "float");
+        const DriftResult mixed = run<SpringSystemMixed>(options, "mixed");
+        const DriftResult full = run<SpringSystemDouble>(options, "double");
+
+        const double particles = std::pow(static_cast<double>(options.lattice), 3.0);
+        auto summary = [&](std::string const& name, DriftResult const& result)
+        {
+                Log::log(Log::SeverityLevel::INFO, name + ": " +
+                                std::to_string(particles * options.steps / result.seconds) +
+                                " particle steps/s, energy drift " +
+                                scientific(result.energyDrift) + ", momentum drift " +
+                                scientific(result.momentumDrift) + ", position error " +
+                                scientific(error(result, full)));
+        };
+        summary("float", single);
+        summary("mixed", mixed);
+        summary("double", full);
+        return 0;
+}
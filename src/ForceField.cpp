@@ -0,0 +1,544 @@
+#include "ForceField.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Uniform Wind
+
+UniformWind::UniformWind(float u, float v, float w) :
+        mU(u), mV(v), mW(w)
+{ }
+
+void UniformWind::setVelocity(float u, float v, float w)
+{
+        mU = u;
+        mV = v;
+        mW = w;
+}
+
+void UniformWind::sample(float, size_t n, const float*, const float*, const float*,
+                float* u, float* v, float* w)
+{
+        for(size_t i = 0; i < n; ++i)
+        {
+                u[i] += mU;
+                v[i] += mV;
+                w[i] += mW;
+        }
+}
+
+// Radial Wind
+
+RadialWind::RadialWind(float cx, float cy, float cz, float strength, float radius) :
+        mCx(cx), mCy(cy), mCz(cz),
+        mStrength(strength),
+        mRadius(radius)
+{ }
+
+void RadialWind::sample(float, size_t n, const float* x, const float* y, const float* z,
+                float* u, float* v, float* w)
+{
+        // |d| * 2sR / (R^2 + |d|^2) reaches s at |d| = R and needs no
+        // normalisation, so the loop has no branches or square roots
+        const float r2 = mRadius * mRadius;
+        const float s = 2.f * mStrength * mRadius;
+        for(size_t i = 0; i < n; ++i)
+        {
+                const float dx = x[i] - mCx;
+                const float dy = y[i] - mCy;
+                const float dz = z[i] - mCz;
+                const float f = s / (r2 + dx * dx + dy * dy + dz * dz);
+                u[i] += f * dx;
+                v[i] += f * dy;
+                w[i] += f * dz;
+        }
+}
+
+// Vortex Wind
+
+VortexWind::VortexWind(float cx, float cy, float cz, float ax, float ay, float az,
+                float strength, float radius) :
+        mCx(cx), mCy(cy), mCz(cz),
+        mStrength(strength),
+        mRadius(radius)
+{
+        const float length = std::sqrt(ax * ax + ay * ay + az * az);
+        mAx = length > 0.f ? ax / length : 0.f;
+        mAy = length > 0.f ? ay / length : 1.f;
+        mAz = length > 0.f ? az / length : 0.f;
+}
+
+void VortexWind::sample(float, size_t n, const float* x, const float* y, const float* z,
+                float* u, float* v, float* w)
+{
+        const float r2 = mRadius * mRadius;
+        const float s = 2.f * mStrength * mRadius;
+        for(size_t i = 0; i < n; ++i)
+        {
+                const float dx = x[i] - mCx;
+                const float dy = y[i] - mCy;
+                const float dz = z[i] - mCz;
+                const float along = dx * mAx + dy * mAy + dz * mAz;
+                const float px = dx - along * mAx;
+                const float py = dy - along * mAy;
+                const float pz = dz - along * mAz;
+                const float f = s / (r2 + px * px + py * py + pz * pz);
+                // axis x p is already as long as the distance to the axis
+                u[i] += f * (mAy * pz - mAz * py);
+                v[i] += f * (mAz * px - mAx * pz);
+                w[i] += f * (mAx * py - mAy * px);
+        }
+}
+
+// Noise Wind
+
+namespace
+{
+        inline unsigned int hash(int x, int y, int z, long t, unsigned int channel)
+        {
+                unsigned int h = channel * 0x9e3779b9u;
+                h ^= static_cast<unsigned int>(x) * 0x85ebca6bu;
+                h = (h << 13) | (h >> 19);
+                h ^= static_cast<unsigned int>(y) * 0xc2b2ae35u;
+                h = (h << 13) | (h >> 19);
+                h ^= static_cast<unsigned int>(z) * 0x27d4eb2fu;
+                h = (h << 13) | (h >> 19);
+                h ^= static_cast<unsigned int>(t) * 0x165667b1u;
+                h ^= h >> 16;
+                h *= 0x7feb352du;
+                h ^= h >> 15;
+                h *= 0x846ca68bu;
+                h ^= h >> 16;
+                return h;
+        }
+
+        // In [-1, 1]
+        inline float lattice(int x, int y, int z, long t, unsigned int channel)
+        {
+                return static_cast<float>(hash(x, y, z, t, channel) >> 8) *
+                        (2.f / 16777215.f) - 1.f;
+        }
+
+        inline float smooth(float t)
+        {
+                return t * t * (3.f - 2.f * t);
+        }
+
+        inline float lerp(float a, float b, float t)
+        {
+                return a + t * (b - a);
+        }
+
+        // Nodes of margin around the points, so small motions do not refit
+        const float kLatticeMargin = 2.f;
+}
+
+NoiseWind::NoiseWind(float amplitude, float scale, float cellSize, int octaves,
+                float rate, unsigned int seed) :
+        mAmplitude(amplitude),
+        mScale(scale),
+        mCell(cellSize),
+        mOctaves(std::max(octaves, 1)),
+        mRate(rate),
+        mSeed(seed),
+        mOx(0.f), mOy(0.f), mOz(0.f),
+        mNx(0), mNy(0), mNz(0),
+        mSlice(0),
+        mBlendTime(0.f),
+        mValid(false)
+{ }
+
+float NoiseWind::noise(float x, float y, float z, long slice, unsigned int channel) const
+{
+        const float fx = std::floor(x);
+        const float fy = std::floor(y);
+        const float fz = std::floor(z);
+        const int ix = static_cast<int>(fx);
+        const int iy = static_cast<int>(fy);
+        const int iz = static_cast<int>(fz);
+        const float tx = smooth(x - fx);
+        const float ty = smooth(y - fy);
+        const float tz = smooth(z - fz);
+
+        const float c00 = lerp(lattice(ix, iy, iz, slice, channel),
+                        lattice(ix + 1, iy, iz, slice, channel), tx);
+        const float c10 = lerp(lattice(ix, iy + 1, iz, slice, channel),
+                        lattice(ix + 1, iy + 1, iz, slice, channel), tx);
+        const float c01 = lerp(lattice(ix, iy, iz + 1, slice, channel),
+                        lattice(ix + 1, iy, iz + 1, slice, channel), tx);
+        const float c11 = lerp(lattice(ix, iy + 1, iz + 1, slice, channel),
+                        lattice(ix + 1, iy + 1, iz + 1, slice, channel), tx);
+        return lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz);
+}
+
+void NoiseWind::computeSlice(long slice, std::vector<float> (&out)[3]) const
+{
+        const size_t count = mNx * mNy * mNz;
+        for(int c = 0; c < 3; ++c) out[c].resize(count);
+
+        size_t node = 0;
+        for(size_t k = 0; k < mNz; ++k)
+        {
+                for(size_t j = 0; j < mNy; ++j)
+                {
+                        for(size_t i = 0; i < mNx; ++i, ++node)
+                        {
+                                const float x = mOx + i * mCell;
+                                const float y = mOy + j * mCell;
+                                const float z = mOz + k * mCell;
+                                for(int c = 0; c < 3; ++c)
+                                {
+                                        float sum = 0.f;
+                                        float weight = 1.f;
+                                        float frequency = 1.f / mScale;
+                                        for(int o = 0; o < mOctaves; ++o)
+                                        {
+                                                const unsigned int channel = mSeed * 64u + o * 3u + c;
+                                                sum += weight * noise(x * frequency, y * frequency,
+                                                                z * frequency, slice, channel);
+                                                weight *= 0.5f;
+                                                frequency *= 2.f;
+                                        }
+                                        out[c][node] = mAmplitude * sum;
+                                }
+                        }
+                }
+        }
+}
+
+void NoiseWind::fitLattice(size_t n, const float* x, const float* y, const float* z)
+{
+        if(n == 0) return;
+
+        float lo[3] = { x[0], y[0], z[0] };
+        float hi[3] = { x[0], y[0], z[0] };
+        for(size_t i = 1; i < n; ++i)
+        {
+                lo[0] = std::min(lo[0], x[i]);
+                lo[1] = std::min(lo[1], y[i]);
+                lo[2] = std::min(lo[2], z[i]);
+                hi[0] = std::max(hi[0], x[i]);
+                hi[1] = std::max(hi[1], y[i]);
+                hi[2] = std::max(hi[2], z[i]);
+        }
+
+        if(mValid &&
+                        lo[0] >= mOx && hi[0] <= mOx + (mNx - 1) * mCell &&
+                        lo[1] >= mOy && hi[1] <= mOy + (mNy - 1) * mCell &&
+                        lo[2] >= mOz && hi[2] <= mOz + (mNz - 1) * mCell)
+                return;
+
+        // Nodes sit on multiples of the cell size, so refitting does not
+        // shift the field under the points
+        const float margin = kLatticeMargin * mCell;
+        float origin[3];
+        size_t count[3];
+        for(int a = 0; a < 3; ++a)
+        {
+                origin[a] = std::floor((lo[a] - margin) / mCell) * mCell;
+                const float top = std::ceil((hi[a] + margin) / mCell) * mCell;
+                count[a] = static_cast<size_t>((top - origin[a]) / mCell + 0.5f) + 1;
+        }
+        mOx = origin[0];
+        mOy = origin[1];
+        mOz = origin[2];
+        mNx = count[0];
+        mNy = count[1];
+        mNz = count[2];
+        mValid = false;
+}
+
+void NoiseWind::updateSlices(float time)
+{
+        const float t = time * mRate;
+        const long slice = static_cast<long>(std::floor(t));
+
+        bool changed = false;
+        if(!mValid || slice != mSlice)
+        {
+                if(mValid && slice == mSlice + 1)
+                {
+                        for(int c = 0; c < 3; ++c) mFrom[c].swap(mTo[c]);
+                }
+                else
+                {
+                        computeSlice(slice, mFrom);
+                }
+                computeSlice(slice + 1, mTo);
+                mSlice = slice;
+                mValid = true;
+                changed = true;
+        }
+
+        if(!changed && time == mBlendTime) return;
+        mBlendTime = time;
+
+        const float b = smooth(t - static_cast<float>(slice));
+        const size_t count = mFrom[0].size();
+        for(int c = 0; c < 3; ++c)
+        {
+                mBlend[c].resize(count);
+                const float* from = mFrom[c].data();
+                const float* to = mTo[c].data();
+                float* out = mBlend[c].data();
+                for(size_t i = 0; i < count; ++i) out[i] = from[i] + b * (to[i] - from[i]);
+        }
+}
+
+void NoiseWind::sample(float time, size_t n, const float* x, const float* y, const float* z,
+                float* u, float* v, float* w)
+{
+        fitLattice(n, x, y, z);
+        updateSlices(time);
+        if(n == 0) return;
+
+        const float inv = 1.f / mCell;
+        const size_t sy = mNx;
+        const size_t sz = mNx * mNy;
+        const float* bu = mBlend[0].data();
+        const float* bv = mBlend[1].data();
+        const float* bw = mBlend[2].data();
+
+        for(size_t i = 0; i < n; ++i)
+        {
+                // The lattice covers every point, the clamp only guards
+                // against rounding on the far faces
+                const float gx = std::min(std::max((x[i] - mOx) * inv, 0.f), mNx - 1.001f);
+                const float gy = std::min(std::max((y[i] - mOy) * inv, 0.f), mNy - 1.001f);
+                const float gz = std::min(std::max((z[i] - mOz) * inv, 0.f), mNz - 1.001f);
+                const size_t ix = static_cast<size_t>(gx);
+                const size_t iy = static_cast<size_t>(gy);
+                const size_t iz = static_cast<size_t>(gz);
+                const float tx = gx - ix;
+                const float ty = gy - iy;
+                const float tz = gz - iz;
+
+                const size_t n000 = ix + sy * iy + sz * iz;
+                const size_t n100 = n000 + 1;
+                const size_t n010 = n000 + sy;
+                const size_t n110 = n010 + 1;
+                const size_t n001 = n000 + sz;
+                const size_t n101 = n001 + 1;
+                const size_t n011 = n001 + sy;
+                const size_t n111 = n011 + 1;
+
+                const float w000 = (1.f - tx) * (1.f - ty) * (1.f - tz);
+                const float w100 = tx * (1.f - ty) * (1.f - tz);
+                const float w010 = (1.f - tx) * ty * (1.f - tz);
+                const float w110 = tx * ty * (1.f - tz);
+                const float w001 = (1.f - tx) * (1.f - ty) * tz;
+                const float w101 = tx * (1.f - ty) * tz;
+                const float w011 = (1.f - tx) * ty * tz;
+                const float w111 = tx * ty * tz;
+
+                u[i] += w000 * bu[n000] + w100 * bu[n100] + w010 * bu[n010] + w110 * bu[n110] +
+                        w001 * bu[n001] + w101 * bu[n101] + w011 * bu[n011] + w111 * bu[n111];
+                v[i] += w000 * bv[n000] + w100 * bv[n100] + w010 * bv[n010] + w110 * bv[n110] +
+                        w001 * bv[n001] + w101 * bv[n101] + w011 * bv[n011] + w111 * bv[n111];
+                w[i] += w000 * bw[n000] + w100 * bw[n100] + w010 * bw[n010] + w110 * bw[n110] +
+                        w001 * bw[n001] + w101 * bw[n101] + w011 * bw[n011] + w111 * bw[n111];
+        }
+}
+
+// Wind Force
+
+WindForce::WindForce(float airDensity) :
+        mDensity(airDensity),
+        mDrag(1.f),
+        mLift(0.2f),
+        mParticleDrag(0.f),
+        mTime(0.f)
+{ }
+
+void WindForce::addField(std::shared_ptr<VelocityField> field)
+{
+        mFields.push_back(field);
+}
+
+void WindForce::setCoefficients(float drag, float lift)
+{
+        mDrag = drag;
+        mLift = lift;
+}
+
+void WindForce::addTriangle(unsigned int a, unsigned int b, unsigned int c)
+{
+        mA.push_back(a);
+        mB.push_back(b);
+        mC.push_back(c);
+}
+
+void WindForce::addGrid(size_t width, size_t height, size_t first)
+{
+        for(size_t j = 0; j + 1 < height; ++j)
+        {
+                for(size_t i = 0; i + 1 < width; ++i)
+                {
+                        const unsigned int n = static_cast<unsigned int>(first + i + width * j);
+                        const unsigned int right = n + 1;
+                        const unsigned int up = n + static_cast<unsigned int>(width);
+                        addTriangle(n, right, up + 1);
+                        addTriangle(n, up + 1, up);
+                }
+        }
+}
+
+void WindForce::elementParticles(size_t t, std::vector<unsigned int>& out) const
+{
+        out.assign({ mA[t], mB[t], mC[t] });
+}
+
+void WindForce::sampleFields(ParticleSet const& p)
+{
+        const size_t n = p.size();
+        mU.assign(n, 0.f);
+        mV.assign(n, 0.f);
+        mW.assign(n, 0.f);
+        for(auto& field : mFields)
+                field->sample(mTime, n, p.x.data(), p.y.data(), p.z.data(),
+                                mU.data(), mV.data(), mW.data());
+}
+
+void WindForce::sampleFields(ParticleSet const& p, std::vector<unsigned int> const& active,
+                std::vector<unsigned int> const& triangles)
+{
+        const size_t n = p.size();
+        mU.resize(n);
+        mV.resize(n);
+        mW.resize(n);
+        mMark.resize(n, 0);
+
+        mSampled.clear();
+        auto use = [&](unsigned int i)
+        {
+                if(mMark[i]) return;
+                mMark[i] = 1;
+                mSampled.push_back(i);
+        };
+        for(unsigned int i : active) use(i);
+        for(unsigned int t : triangles)
+        {
+                use(mA[t]);
+                use(mB[t]);
+                use(mC[t]);
+        }
+
+        // The fields take contiguous arrays, so the positions are packed
+        const size_t count = mSampled.size();
+        mSx.resize(count);
+        mSy.resize(count);
+        mSz.resize(count);
+        for(size_t r = 0; r < count; ++r)
+        {
+                const unsigned int i = mSampled[r];
+                mSx[r] = p.x[i];
+                mSy[r] = p.y[i];
+                mSz[r] = p.z[i];
+                mMark[i] = 0;
+        }
+        mSu.assign(count, 0.f);
+        mSv.assign(count, 0.f);
+        mSw.assign(count, 0.f);
+        for(auto& field : mFields)
+                field->sample(mTime, count, mSx.data(), mSy.data(), mSz.data(),
+                                mSu.data(), mSv.data(), mSw.data());
+
+        for(size_t r = 0; r < count; ++r)
+        {
+                const unsigned int i = mSampled[r];
+                mU[i] = mSu[r];
+                mV[i] = mSv[r];
+                mW[i] = mSw[r];
+        }
+}
+
+void WindForce::applyParticleDrag(ParticleSet& p, unsigned int const* list, size_t count)
+{
+        if(mParticleDrag == 0.f) return;
+
+        const float c = mParticleDrag;
+        for(size_t r = 0; r < count; ++r)
+        {
+                const size_t i = list ? list[r] : r;
+                p.fx[i] += c * (mU[i] - p.vx[i]);
+                p.fy[i] += c * (mV[i] - p.vy[i]);
+                p.fz[i] += c * (mW[i] - p.vz[i]);
+        }
+}
+
+void WindForce::applyTriangleDrag(ParticleSet& p, unsigned int const* list, size_t count)
+{
+        if(count == 0) return;
+        mFx.resize(count);
+        mFy.resize(count);
+        mFz.resize(count);
+
+        // Scratch is indexed by position in the list
+        const float third = 1.f / 3.f;
+        for(size_t r = 0; r < count; ++r)
+        {
+                const size_t t = list ? list[r] : r;
+                const unsigned int a = mA[t];
+                const unsigned int b = mB[t];
+                const unsigned int c = mC[t];
+
+                // Twice the area along the normal
+                const float e1x = p.x[b] - p.x[a], e1y = p.y[b] - p.y[a], e1z = p.z[b] - p.z[a];
+                const float e2x = p.x[c] - p.x[a], e2y = p.y[c] - p.y[a], e2z = p.z[c] - p.z[a];
+                const float nx = e1y * e2z - e1z * e2y;
+                const float ny = e1z * e2x - e1x * e2z;
+                const float nz = e1x * e2y - e1y * e2x;
+                const float n2 = nx * nx + ny * ny + nz * nz;
+
+                // Velocity of the triangle relative to the air
+                const float rx = third * (p.vx[a] + p.vx[b] + p.vx[c] - mU[a] - mU[b] - mU[c]);
+                const float ry = third * (p.vy[a] + p.vy[b] + p.vy[c] - mV[a] - mV[b] - mV[c]);
+                const float rz = third * (p.vz[a] + p.vz[b] + p.vz[c] - mW[a] - mW[b] - mW[c]);
+                const float r2 = rx * rx + ry * ry + rz * rz;
+
+                const float nlength = std::sqrt(n2);
+                const float rlength = std::sqrt(r2);
+                const float invN = nlength > 0.f ? 1.f / nlength : 0.f;
+                const float invR = rlength > 0.f ? 1.f / rlength : 0.f;
+
+                // Unit normal, area and cosine between the flow and normal
+                const float ux = nx * invN, uy = ny * invN, uz = nz * invN;
+                const float area = 0.5f * nlength;
+                const float along = rx * ux + ry * uy + rz * uz;
+
+                // Drag pushes back along the normal, lift acts across the
+                // flow in the plane of flow and normal
+                const float q = 0.5f * mDensity * area;
+                const float drag = -q * mDrag * rlength * along;
+                const float lift = -q * mLift * along * invR;
+                mFx[r] = drag * ux + lift * (r2 * ux - along * rx);
+                mFy[r] = drag * uy + lift * (r2 * uy - along * ry);
+                mFz[r] = drag * uz + lift * (r2 * uz - along * rz);
+        }
+
+        for(size_t r = 0; r < count; ++r)
+        {
+                const size_t t = list ? list[r] : r;
+                const float fx = third * mFx[r];
+                const float fy = third * mFy[r];
+                const float fz = third * mFz[r];
+                p.fx[mA[t]] += fx; p.fy[mA[t]] += fy; p.fz[mA[t]] += fz;
+                p.fx[mB[t]] += fx; p.fy[mB[t]] += fy; p.fz[mB[t]] += fz;
+                p.fx[mC[t]] += fx; p.fy[mC[t]] += fy; p.fz[mC[t]] += fz;
+        }
+}
+
+void WindForce::addForces(ParticleSet& particles)
+{
+        sampleFields(particles);
+        applyParticleDrag(particles, nullptr, particles.size());
+        applyTriangleDrag(particles, nullptr, mA.size());
+}
+
+void WindForce::addForces(ParticleSet& particles, std::vector<unsigned int> const& active,
+                std::vector<unsigned int> const& triangles)
+{
+        sampleFields(particles, active, triangles);
+        applyParticleDrag(particles, active.data(), active.size());
+        applyTriangleDrag(particles, triangles.data(), triangles.size());
+}
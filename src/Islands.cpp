@@ -0,0 +1,532 @@
+#include "Islands.hpp"
+#include "Collision.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+        unsigned int findRoot(std::vector<unsigned int>& parent, unsigned int i)
+        {
+                while(parent[i] != i)
+                {
+                        parent[i] = parent[parent[i]];
+                        i = parent[i];
+                }
+                return i;
+        }
+
+        void unite(std::vector<unsigned int>& parent, unsigned int i, unsigned int j)
+        {
+                i = findRoot(parent, i);
+                j = findRoot(parent, j);
+                if(i != j) parent[std::max(i, j)] = std::min(i, j);
+        }
+
+        void eraseValue(std::vector<unsigned int>& list, unsigned int value)
+        {
+                auto it = std::find(list.begin(), list.end(), value);
+                if(it == list.end()) return;
+                *it = list.back();
+                list.pop_back();
+        }
+}
+
+const unsigned int IslandManager::kNone;
+
+IslandManager::IslandManager(float sleepEnergy, int sleepSteps) :
+        mSleepEnergy(sleepEnergy),
+        mSleepSteps(sleepSteps),
+        mSleepingPotential(0.0),
+        mParticleCount(0),
+        mModelCount(0),
+        mLayoutVersion(0)
+{ }
+
+unsigned int IslandManager::newIsland()
+{
+        unsigned int id;
+        if(!mFreeIslands.empty())
+        {
+                id = mFreeIslands.back();
+                mFreeIslands.pop_back();
+        }
+        else
+        {
+                id = static_cast<unsigned int>(mIslands.size());
+                mIslands.push_back(Island());
+        }
+
+        Island& isle = mIslands[id];
+        isle.elements.resize(mModelCount);
+        isle.stillSteps = 0;
+        isle.splitQueued = false;
+        isle.bounds = Box();
+        isle.potential = 0.0;
+        isle.awake = true;
+        isle.slot = mAwake.size();
+        mAwake.push_back(id);
+        return id;
+}
+
+void IslandManager::releaseIsland(unsigned int id)
+{
+        wake(id);
+        unlist(id);
+        Island& isle = mIslands[id];
+        isle.particles.clear();
+        isle.springs.clear();
+        for(auto& elements : isle.elements) elements.clear();
+        isle.extras.clear();
+        isle.anchors.clear();
+        isle.splitQueued = false;
+        mFreeIslands.push_back(id);
+}
+
+void IslandManager::unlist(unsigned int id)
+{
+        // Swap remove from the awake or the sleeping list
+        Island& isle = mIslands[id];
+        std::vector<unsigned int>& list = isle.awake ? mAwake : mAsleep;
+        const unsigned int last = list.back();
+        list[isle.slot] = last;
+        mIslands[last].slot = isle.slot;
+        list.pop_back();
+}
+
+void IslandManager::anchor(unsigned int id, unsigned int particle)
+{
+        std::vector<unsigned int>& islands = mAnchored[particle];
+        if(std::find(islands.begin(), islands.end(), id) != islands.end()) return;
+        islands.push_back(id);
+        mIslands[id].anchors.push_back(particle);
+}
+
+unsigned int IslandManager::attach(unsigned int i, unsigned int j, ParticleSet const& p)
+{
+        const bool mi = p.invMass[i] > 0.f;
+        const bool mj = p.invMass[j] > 0.f;
+        if(!mi && !mj) return kNone;
+        const unsigned int id = mi ? mIslandOf[i] : mIslandOf[j];
+        if(!mi) anchor(id, i);
+        if(!mj) anchor(id, j);
+        return id;
+}
+
+void IslandManager::placeSpring(unsigned int id, unsigned int spring)
+{
+        std::vector<unsigned int>& springs = mIslands[id].springs;
+        mSpringIsland[spring] = id;
+        mSpringSlot[spring] = static_cast<unsigned int>(springs.size());
+        springs.push_back(spring);
+}
+
+void IslandManager::placeElement(size_t m, unsigned int element, SpringSystem const& system)
+{
+        // An element goes with the island of its moving particles; one
+        // with none only pushes on fixed particles and is never evaluated
+        ParticleSet const& p = system.particles();
+        system.forceModels()[m]->elementParticles(element, mNodes);
+        unsigned int id = kNone;
+        for(unsigned int i : mNodes)
+        {
+                if(p.invMass[i] <= 0.f) continue;
+                id = mIslandOf[i];
+                break;
+        }
+        if(id == kNone) return;
+        mIslands[id].elements[m].push_back(element);
+        for(unsigned int i : mNodes)
+                if(p.invMass[i] <= 0.f) anchor(id, i);
+}
+
+void IslandManager::build(SpringSystem const& system,
+                std::vector<unsigned int> const& extraEdges)
+{
+        ParticleSet const& p = system.particles();
+        SpringSet const& springs = system.springs();
+        const size_t n = p.size();
+
+        mExtraEdges = extraEdges;
+        mParticleCount = n;
+        mModelCount = system.forceModels().size();
+        mLayoutVersion = system.layoutVersion();
+
+        mIslands.clear();
+        mFreeIslands.clear();
+        mAwake.clear();
+        mAsleep.clear();
+        mSplits.clear();
+        mSleepingPotential = 0.0;
+        mIslandOf.assign(n, kNone);
+        mAnchored.assign(n, std::vector<unsigned int>());
+        mSpringIsland.assign(springs.size(), kNone);
+        mSpringSlot.assign(springs.size(), 0);
+        mLocal.resize(n);
+
+        auto moving = [&p](unsigned int i) { return p.invMass[i] > 0.f; };
+
+        std::vector<unsigned int> parent(n);
+        for(size_t i = 0; i < n; ++i) parent[i] = static_cast<unsigned int>(i);
+        for(size_t s = 0; s < springs.size(); ++s)
+                if(moving(springs.a[s]) && moving(springs.b[s]))
+                        unite(parent, springs.a[s], springs.b[s]);
+        for(size_t e = 0; e + 1 < mExtraEdges.size(); e += 2)
+                if(moving(mExtraEdges[e]) && moving(mExtraEdges[e + 1]))
+                        unite(parent, mExtraEdges[e], mExtraEdges[e + 1]);
+
+        // Elements tie their moving particles to the first moving one, so
+        // a pinned node cannot split an element
+        for(size_t m = 0; m < mModelCount; ++m)
+        {
+                ForceModel const& model = *system.forceModels()[m];
+                for(size_t e = 0; e < model.elementCount(); ++e)
+                {
+                        model.elementParticles(e, mNodes);
+                        auto hub = std::find_if(mNodes.begin(), mNodes.end(), moving);
+                        if(hub == mNodes.end()) continue;
+                        for(unsigned int i : mNodes)
+                                if(moving(i)) unite(parent, *hub, i);
+                }
+        }
+
+        // A root is the lowest particle of its set, so it is numbered
+        // before the rest
+        for(size_t i = 0; i < n; ++i)
+        {
+                const unsigned int particle = static_cast<unsigned int>(i);
+                if(!moving(particle)) continue;
+                const unsigned int root = findRoot(parent, particle);
+                mIslandOf[i] = root == particle ? newIsland() : mIslandOf[root];
+                mIslands[mIslandOf[i]].particles.push_back(particle);
+        }
+
+        // Tombstones tie nothing together
+        for(size_t s = 0; s < springs.size(); ++s)
+        {
+                if(springs.a[s] == springs.b[s]) continue;
+                const unsigned int id = attach(springs.a[s], springs.b[s], p);
+                if(id != kNone) placeSpring(id, static_cast<unsigned int>(s));
+        }
+        for(size_t e = 0; e + 1 < mExtraEdges.size(); e += 2)
+        {
+                const unsigned int id = attach(mExtraEdges[e], mExtraEdges[e + 1], p);
+                if(id != kNone) mIslands[id].extras.push_back(static_cast<unsigned int>(e / 2));
+        }
+        for(size_t m = 0; m < mModelCount; ++m)
+                for(size_t e = 0; e < system.forceModels()[m]->elementCount(); ++e)
+                        placeElement(m, static_cast<unsigned int>(e), system);
+}
+
+void IslandManager::followEdits(SpringSystem& system)
+{
+        ParticleSet const& p = system.particles();
+        system.takeSpringEdits(mEdits);
+        for(auto const& edit : mEdits)
+        {
+                const unsigned int s = edit.spring;
+                if(s >= mSpringIsland.size())
+                {
+                        mSpringIsland.resize(s + 1, kNone);
+                        mSpringSlot.resize(s + 1, 0);
+                }
+
+                if(!edit.inserted)
+                {
+                        const unsigned int id = mSpringIsland[s];
+                        if(id == kNone) continue;
+                        std::vector<unsigned int>& springs = mIslands[id].springs;
+                        const unsigned int last = springs.back();
+                        springs[mSpringSlot[s]] = last;
+                        mSpringSlot[last] = mSpringSlot[s];
+                        springs.pop_back();
+                        mSpringIsland[s] = kNone;
+                        queueSplit(id);
+                        continue;
+                }
+
+                // A build after the edit already placed the spring
+                if(mSpringIsland[s] != kNone || edit.a == edit.b) continue;
+                if(p.invMass[edit.a] > 0.f && p.invMass[edit.b] > 0.f &&
+                                mIslandOf[edit.a] != mIslandOf[edit.b])
+                        merge(mIslandOf[edit.a], mIslandOf[edit.b]);
+                const unsigned int id = attach(edit.a, edit.b, p);
+                if(id == kNone) continue;
+                placeSpring(id, s);
+                wake(id);
+        }
+}
+
+unsigned int IslandManager::merge(unsigned int a, unsigned int b)
+{
+        if(mIslands[a].particles.size() < mIslands[b].particles.size()) std::swap(a, b);
+        wake(a);
+        wake(b);
+
+        // Only the smaller island is walked
+        Island& to = mIslands[a];
+        Island& from = mIslands[b];
+        for(unsigned int i : from.particles) mIslandOf[i] = a;
+        to.particles.insert(to.particles.end(), from.particles.begin(), from.particles.end());
+        for(unsigned int s : from.springs) placeSpring(a, s);
+        for(size_t m = 0; m < mModelCount; ++m)
+                to.elements[m].insert(to.elements[m].end(),
+                                from.elements[m].begin(), from.elements[m].end());
+        to.extras.insert(to.extras.end(), from.extras.begin(), from.extras.end());
+        for(unsigned int i : from.anchors)
+        {
+                eraseValue(mAnchored[i], b);
+                anchor(a, i);
+        }
+        to.potential += from.potential;
+        if(from.splitQueued) queueSplit(a);
+
+        releaseIsland(b);
+        return a;
+}
+
+void IslandManager::queueSplit(unsigned int id)
+{
+        if(mIslands[id].splitQueued) return;
+        mIslands[id].splitQueued = true;
+        mSplits.push_back(id);
+}
+
+void IslandManager::split(unsigned int id, SpringSystem const& system)
+{
+        ParticleSet const& p = system.particles();
+        auto moving = [&p](unsigned int i) { return p.invMass[i] > 0.f; };
+
+        // The island is taken apart and handed out again; its pieces are
+        // awake, like everything a removal touches
+        wake(id);
+        mIslands[id].splitQueued = false;
+        std::vector<unsigned int> particles, springs, extras;
+        std::vector<std::vector<unsigned int>> elements(mModelCount);
+        particles.swap(mIslands[id].particles);
+        springs.swap(mIslands[id].springs);
+        extras.swap(mIslands[id].extras);
+        for(size_t m = 0; m < mModelCount; ++m) elements[m].swap(mIslands[id].elements[m]);
+        for(unsigned int i : mIslands[id].anchors) eraseValue(mAnchored[i], id);
+        mIslands[id].anchors.clear();
+
+        // Union find over the island's own particles, numbered locally
+        const size_t count = particles.size();
+        mParent.resize(count);
+        for(size_t k = 0; k < count; ++k)
+        {
+                mLocal[particles[k]] = static_cast<unsigned int>(k);
+                mParent[k] = static_cast<unsigned int>(k);
+        }
+        SpringSet const& set = system.springs();
+        for(unsigned int s : springs)
+                if(moving(set.a[s]) && moving(set.b[s]))
+                        unite(mParent, mLocal[set.a[s]], mLocal[set.b[s]]);
+        for(unsigned int e : extras)
+                if(moving(mExtraEdges[2 * e]) && moving(mExtraEdges[2 * e + 1]))
+                        unite(mParent, mLocal[mExtraEdges[2 * e]], mLocal[mExtraEdges[2 * e + 1]]);
+        for(size_t m = 0; m < mModelCount; ++m)
+        {
+                for(unsigned int e : elements[m])
+                {
+                        system.forceModels()[m]->elementParticles(e, mNodes);
+                        auto hub = std::find_if(mNodes.begin(), mNodes.end(), moving);
+                        for(unsigned int i : mNodes)
+                                if(moving(i)) unite(mParent, mLocal[*hub], mLocal[i]);
+                }
+        }
+
+        // The piece with the first particle keeps the island
+        for(size_t k = 0; k < count; ++k)
+        {
+                const unsigned int i = particles[k];
+                const unsigned int root = findRoot(mParent, static_cast<unsigned int>(k));
+                if(root == k) mIslandOf[i] = k == 0 ? id : newIsland();
+                else mIslandOf[i] = mIslandOf[particles[root]];
+                mIslands[mIslandOf[i]].particles.push_back(i);
+        }
+
+        for(unsigned int s : springs) placeSpring(attach(set.a[s], set.b[s], p), s);
+        for(unsigned int e : extras)
+                mIslands[attach(mExtraEdges[2 * e], mExtraEdges[2 * e + 1], p)].extras.push_back(e);
+        for(size_t m = 0; m < mModelCount; ++m)
+                for(unsigned int e : elements[m]) placeElement(m, e, system);
+}
+
+size_t IslandManager::activeParticleCount() const
+{
+        size_t count = 0;
+        for(unsigned int id : mAwake) count += mIslands[id].particles.size();
+        return count;
+}
+
+void IslandManager::awakeSprings(std::vector<unsigned int>& springs) const
+{
+        springs.clear();
+        for(unsigned int id : mAwake)
+                springs.insert(springs.end(), mIslands[id].springs.begin(), mIslands[id].springs.end());
+}
+
+void IslandManager::wake(unsigned int id)
+{
+        Island& isle = mIslands[id];
+        isle.stillSteps = 0;
+        if(isle.awake) return;
+        unlist(id);
+        isle.awake = true;
+        isle.slot = mAwake.size();
+        mAwake.push_back(id);
+        mSleepingPotential -= isle.potential;
+}
+
+void IslandManager::sleep(unsigned int id, ParticleSet& p)
+{
+        Island& isle = mIslands[id];
+        isle.bounds = Box();
+        for(unsigned int i : isle.particles)
+        {
+                p.vx[i] = 0.f;
+                p.vy[i] = 0.f;
+                p.vz[i] = 0.f;
+                isle.bounds.add(Vec3(p.x[i], p.y[i], p.z[i]));
+        }
+
+        unlist(id);
+        isle.awake = false;
+        isle.slot = mAsleep.size();
+        mAsleep.push_back(id);
+        mSleepingPotential += isle.potential;
+}
+
+void IslandManager::wakeParticle(size_t particle)
+{
+        if(particle >= mParticleCount) return;
+        if(mIslandOf[particle] != kNone) wake(mIslandOf[particle]);
+        else for(unsigned int id : mAnchored[particle]) wake(id);
+}
+
+void IslandManager::wakeAll()
+{
+        while(!mAsleep.empty()) wake(mAsleep.back());
+}
+
+void IslandManager::wakeOnContact(SpringSystem const& system)
+{
+        CollisionWorld const* colliders = system.colliders().get();
+        if(!colliders || mAsleep.empty()) return;
+        colliders->movingBounds(mMoving);
+        if(mMoving.empty()) return;
+
+        // Walk backwards so that woken islands leave the list in place
+        ParticleSet const& p = system.particles();
+        for(size_t slot = mAsleep.size(); slot-- > 0;)
+        {
+                const unsigned int id = mAsleep[slot];
+                Island const& isle = mIslands[id];
+                bool near = false;
+                for(Box const& box : mMoving) near = near || box.overlaps(isle.bounds);
+                if(!near) continue;
+                for(unsigned int i : isle.particles)
+                {
+                        if(!colliders->sweptBy(Vec3(p.x[i], p.y[i], p.z[i]))) continue;
+                        wake(id);
+                        break;
+                }
+        }
+}
+
+void IslandManager::step(SpringSystem& system, float dt)
+{
+        ParticleSet& p = system.particles();
+        if(p.size() != mParticleCount || system.forceModels().size() != mModelCount ||
+                        system.layoutVersion() != mLayoutVersion)
+                build(system, mExtraEdges);
+        followEdits(system);
+        // Springs added without going through the log
+        if(system.springs().size() != mSpringIsland.size()) build(system, mExtraEdges);
+        for(unsigned int id : mSplits)
+                if(mIslands[id].splitQueued) split(id, system);
+        mSplits.clear();
+
+        system.takeTouched(mTouched);
+        for(unsigned int i : mTouched) wakeParticle(i);
+        wakeOnContact(system);
+
+        const bool observing = system.observing();
+        Observables& observed = system.observables();
+        if(observing) observed.beginStep();
+        if(mAwake.empty())
+        {
+                if(!observing) return;
+                observed.potential = mSleepingPotential;
+                observed.finishStep();
+                return;
+        }
+
+        mActive.clear();
+        mActiveElements.resize(mModelCount);
+        for(auto& elements : mActiveElements) elements.clear();
+        for(unsigned int id : mAwake)
+        {
+                Island const& isle = mIslands[id];
+                mActive.insert(mActive.end(), isle.particles.begin(), isle.particles.end());
+                for(size_t m = 0; m < mModelCount; ++m)
+                        mActiveElements[m].insert(mActiveElements[m].end(),
+                                        isle.elements[m].begin(), isle.elements[m].end());
+        }
+
+        for(unsigned int i : mActive)
+        {
+                p.fx[i] = 0.f;
+                p.fy[i] = 0.f;
+                p.fz[i] = 0.f;
+        }
+        for(unsigned int id : mAwake)
+        {
+                Island& isle = mIslands[id];
+                if(!observing)
+                {
+                        system.springs().addForces(p, isle.springs);
+                        continue;
+                }
+                const double before = observed.potential;
+                system.springs().addForces(p, isle.springs, observed);
+                isle.potential = observed.potential - before;
+        }
+
+        // Models without elements are evaluated in full; forces landing
+        // on sleeping particles are never read
+        for(size_t m = 0; m < mModelCount; ++m)
+        {
+                ForceModel& model = *system.forceModels()[m];
+                if(model.elementCount() == 0) model.addForces(p);
+                else model.addForces(p, mActive, mActiveElements[m]);
+        }
+
+        // Walk backwards so that islands can fall asleep in place
+        for(size_t slot = mAwake.size(); slot-- > 0;)
+        {
+                const unsigned int id = mAwake[slot];
+                Island& isle = mIslands[id];
+                const double before = observed.potential;
+                system.integrate(dt, isle.particles);
+                isle.potential += observed.potential - before;
+
+                // The island was just integrated, so this pass runs over
+                // data that is still in cache
+                float energy = 0.f;
+                for(unsigned int i : isle.particles)
+                        energy += p.vx[i] * p.vx[i] + p.vy[i] * p.vy[i] + p.vz[i] * p.vz[i];
+                energy *= 0.5f / isle.particles.size();
+
+                if(energy < mSleepEnergy)
+                {
+                        if(++isle.stillSteps >= mSleepSteps) sleep(id, p);
+                }
+                else isle.stillSteps = 0;
+        }
+
+        if(!observing) return;
+        observed.potential += mSleepingPotential;
+        observed.finishStep();
+}
@@ -0,0 +1,365 @@
+#include "LodCloth.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+LodCloth::LodCloth(size_t width, size_t height, size_t ratio,
+                float originX, float originY, float originZ,
+                float spacing, float mass, float k, float damping) :
+        mWidth(width),
+        mHeight(height),
+        mRatio(ratio),
+        mCoarseWidth((width - 1) / ratio + 1),
+        mCoarseHeight((height - 1) / ratio + 1),
+        mTilesX(mCoarseWidth - 1),
+        mTilesY(mCoarseHeight - 1),
+        mRefineDistance(60.f),
+        mDirty(false)
+{
+        for(size_t ty = 0; ty < mTilesY; ++ty)
+        {
+                for(size_t tx = 0; tx < mTilesX; ++tx)
+                {
+                        Tile tile;
+                        tile.tx = tx;
+                        tile.ty = ty;
+                        tile.refined = false;
+                        mTiles.push_back(tile);
+                }
+        }
+
+        for(size_t j = 0; j < mHeight; ++j)
+                for(size_t i = 0; i < mWidth; ++i)
+                        mFine.addParticle(originX + i * spacing, originY, originZ + j * spacing,
+                                        j == 0 ? 0.f : mass);
+
+        // Every cell owns its bottom and left edges and both diagonals; the
+        // last row and column also own the closing edges
+        for(size_t cj = 0; cj + 1 < mHeight; ++cj)
+        {
+                for(size_t ci = 0; ci + 1 < mWidth; ++ci)
+                {
+                        Tile& tile = mTiles[ci / mRatio + mTilesX * (cj / mRatio)];
+                        auto spring = [&](size_t a, size_t b)
+                        {
+                                tile.springs.push_back(static_cast<unsigned int>(
+                                                        mFine.addSpring(a, b, k, damping)));
+                        };
+                        spring(fineIndex(ci, cj), fineIndex(ci + 1, cj));
+                        spring(fineIndex(ci, cj), fineIndex(ci, cj + 1));
+                        spring(fineIndex(ci, cj), fineIndex(ci + 1, cj + 1));
+                        spring(fineIndex(ci + 1, cj), fineIndex(ci, cj + 1));
+                        if(ci + 2 == mWidth) spring(fineIndex(ci + 1, cj), fineIndex(ci + 1, cj + 1));
+                        if(cj + 2 == mHeight) spring(fineIndex(ci, cj + 1), fineIndex(ci + 1, cj + 1));
+                }
+        }
+
+        // The sheet stiffness of a spring grid does not depend on the
+        // spacing, so the proxy keeps k and carries the mass of the fine
+        // particles it stands in for
+        ParticleSet const& p = mFine.particles();
+        const float coarseMass = mass * mRatio * mRatio;
+        for(size_t j = 0; j < mCoarseHeight; ++j)
+        {
+                for(size_t i = 0; i < mCoarseWidth; ++i)
+                {
+                        const size_t f = fineIndex(i * mRatio, j * mRatio);
+                        mCoarse.addParticle(p.x[f], p.y[f], p.z[f], j == 0 ? 0.f : coarseMass);
+                }
+        }
+        for(size_t j = 0; j + 1 < mCoarseHeight; ++j)
+        {
+                for(size_t i = 0; i + 1 < mCoarseWidth; ++i)
+                {
+                        mCoarse.addSpring(coarseIndex(i, j), coarseIndex(i + 1, j), k, damping);
+                        mCoarse.addSpring(coarseIndex(i, j), coarseIndex(i, j + 1), k, damping);
+                        mCoarse.addSpring(coarseIndex(i, j), coarseIndex(i + 1, j + 1), k, damping);
+                        mCoarse.addSpring(coarseIndex(i + 1, j), coarseIndex(i, j + 1), k, damping);
+                        if(i + 2 == mCoarseWidth)
+                                mCoarse.addSpring(coarseIndex(i + 1, j), coarseIndex(i + 1, j + 1), k, damping);
+                        if(j + 2 == mCoarseHeight)
+                                mCoarse.addSpring(coarseIndex(i, j + 1), coarseIndex(i + 1, j + 1), k, damping);
+                }
+        }
+
+        const size_t n = mWidth * mHeight;
+        mTouching.assign(n, 0);
+        mRefinedTouching.assign(n, 0);
+        mMark.assign(n, 0);
+        for(size_t j = 0; j < mHeight; ++j)
+                for(size_t i = 0; i < mWidth; ++i)
+                        forTilesTouching(i, j, [&](Tile&) { ++mTouching[fineIndex(i, j)]; });
+}
+
+template <typename F>
+void LodCloth::forTilesTouching(size_t i, size_t j, F f)
+{
+        size_t xs[2], ys[2];
+        size_t nx = 0, ny = 0;
+        if(i / mRatio < mTilesX) xs[nx++] = i / mRatio;
+        if(i > 0 && i % mRatio == 0) xs[nx++] = i / mRatio - 1;
+        if(j / mRatio < mTilesY) ys[ny++] = j / mRatio;
+        if(j > 0 && j % mRatio == 0) ys[ny++] = j / mRatio - 1;
+
+        for(size_t b = 0; b < ny; ++b)
+                for(size_t a = 0; a < nx; ++a)
+                        f(mTiles[xs[a] + mTilesX * ys[b]]);
+}
+
+std::vector<unsigned int> LodCloth::edges() const
+{
+        SpringSet const& springs = mFine.springs();
+        std::vector<unsigned int> edges;
+        edges.reserve(2 * springs.size());
+        for(size_t s = 0; s < springs.size(); ++s)
+        {
+                edges.push_back(springs.a[s]);
+                edges.push_back(springs.b[s]);
+        }
+        return edges;
+}
+
+void LodCloth::interpolate(size_t i, size_t j)
+{
+        const size_t I = std::min(i / mRatio, mCoarseWidth - 2);
+        const size_t J = std::min(j / mRatio, mCoarseHeight - 2);
+        const float u = static_cast<float>(i - I * mRatio) / mRatio;
+        const float v = static_cast<float>(j - J * mRatio) / mRatio;
+
+        const size_t c00 = coarseIndex(I, J);
+        const size_t c10 = coarseIndex(I + 1, J);
+        const size_t c01 = coarseIndex(I, J + 1);
+        const size_t c11 = coarseIndex(I + 1, J + 1);
+        const float w00 = (1.f - u) * (1.f - v);
+        const float w10 = u * (1.f - v);
+        const float w01 = (1.f - u) * v;
+        const float w11 = u * v;
+
+        ParticleSet const& c = mCoarse.particles();
+        ParticleSet& p = mFine.particles();
+        const size_t f = fineIndex(i, j);
+        auto blend = [&](std::vector<float> const& src)
+        {
+                return w00 * src[c00] + w10 * src[c10] + w01 * src[c01] + w11 * src[c11];
+        };
+        p.x[f] = blend(c.x);
+        p.y[f] = blend(c.y);
+        p.z[f] = blend(c.z);
+        p.vx[f] = blend(c.vx);
+        p.vy[f] = blend(c.vy);
+        p.vz[f] = blend(c.vz);
+}
+
+void LodCloth::setRefined(Tile& tile, bool refined)
+{
+        if(tile.refined == refined) return;
+        tile.refined = refined;
+        mDirty = true;
+
+        for(size_t j = tile.ty * mRatio; j <= (tile.ty + 1) * mRatio; ++j)
+        {
+                for(size_t i = tile.tx * mRatio; i <= (tile.tx + 1) * mRatio; ++i)
+                {
+                        // None of these were simulated before refining, so
+                        // they start from the proxy's state
+                        if(refined) interpolate(i, j);
+                        if(refined) ++mRefinedTouching[fineIndex(i, j)];
+                        else --mRefinedTouching[fineIndex(i, j)];
+                }
+        }
+}
+
+void LodCloth::updateRefinement(float ex, float ey, float ez)
+{
+        ParticleSet const& c = mCoarse.particles();
+        const float coarsen = 1.2f * mRefineDistance;
+
+        for(Tile& tile : mTiles)
+        {
+                const size_t corners[4] = {
+                        coarseIndex(tile.tx, tile.ty),
+                        coarseIndex(tile.tx + 1, tile.ty),
+                        coarseIndex(tile.tx, tile.ty + 1),
+                        coarseIndex(tile.tx + 1, tile.ty + 1)
+                };
+                float cx = 0.f, cy = 0.f, cz = 0.f;
+                for(size_t n : corners)
+                {
+                        cx += 0.25f * c.x[n];
+                        cy += 0.25f * c.y[n];
+                        cz += 0.25f * c.z[n];
+                }
+                const float d = std::sqrt((cx - ex) * (cx - ex) +
+                                (cy - ey) * (cy - ey) + (cz - ez) * (cz - ez));
+
+                // The gap between the two distances keeps tiles from
+                // flickering between levels
+                if(!tile.refined && d < mRefineDistance) setRefined(tile, true);
+                else if(tile.refined && d > coarsen) setRefined(tile, false);
+        }
+
+        if(mDirty) rebuildActiveLists();
+}
+
+void LodCloth::assignElements()
+{
+        auto const& models = mFine.forceModels();
+        mElementCounts.resize(models.size());
+        for(Tile& tile : mTiles) tile.elements.assign(models.size(), std::vector<unsigned int>());
+
+        // An element goes to the tile of the cell at its lowest corner;
+        // the corners of a grid triangle share a cell, so its particles
+        // are only simulated when that tile is refined
+        std::vector<unsigned int> nodes;
+        for(size_t m = 0; m < models.size(); ++m)
+        {
+                mElementCounts[m] = models[m]->elementCount();
+                for(size_t e = 0; e < mElementCounts[m]; ++e)
+                {
+                        models[m]->elementParticles(e, nodes);
+                        if(nodes.empty()) continue;
+                        size_t i = mWidth, j = mHeight;
+                        for(unsigned int f : nodes)
+                        {
+                                i = std::min(i, f % mWidth);
+                                j = std::min(j, f / mWidth);
+                        }
+                        const size_t tx = std::min(i / mRatio, mTilesX - 1);
+                        const size_t ty = std::min(j / mRatio, mTilesY - 1);
+                        mTiles[tx + mTilesX * ty].elements[m].push_back(static_cast<unsigned int>(e));
+                }
+        }
+
+        rebuildActiveLists();
+}
+
+void LodCloth::rebuildActiveLists()
+{
+        mDirty = false;
+        mRefinedTiles.clear();
+        mSimulated.clear();
+        mDriven.clear();
+        mSprings.clear();
+        mRestricted.clear();
+
+        for(size_t t = 0; t < mTiles.size(); ++t)
+        {
+                Tile const& tile = mTiles[t];
+                if(!tile.refined) continue;
+                mRefinedTiles.push_back(static_cast<unsigned int>(t));
+
+                for(size_t j = tile.ty * mRatio; j <= (tile.ty + 1) * mRatio; ++j)
+                {
+                        for(size_t i = tile.tx * mRatio; i <= (tile.tx + 1) * mRatio; ++i)
+                        {
+                                const size_t f = fineIndex(i, j);
+                                if(mMark[f]) continue;
+                                mMark[f] = 1;
+                                if(mRefinedTouching[f] < mTouching[f])
+                                {
+                                        mDriven.push_back(static_cast<unsigned int>(f));
+                                        continue;
+                                }
+                                mSimulated.push_back(static_cast<unsigned int>(f));
+                                if(i % mRatio == 0 && j % mRatio == 0)
+                                        mRestricted.push_back(static_cast<unsigned int>(
+                                                                coarseIndex(i / mRatio, j / mRatio)));
+                        }
+                }
+        }
+
+        // Springs between two driven particles would only push on the
+        // boundary, which the proxy overwrites anyway
+        SpringSet const& springs = mFine.springs();
+        for(unsigned int t : mRefinedTiles)
+        {
+                for(unsigned int s : mTiles[t].springs)
+                {
+                        const unsigned int a = springs.a[s];
+                        const unsigned int b = springs.b[s];
+                        if(mRefinedTouching[a] == mTouching[a] || mRefinedTouching[b] == mTouching[b])
+                                mSprings.push_back(s);
+                }
+        }
+
+        for(unsigned int f : mSimulated) mMark[f] = 0;
+        for(unsigned int f : mDriven) mMark[f] = 0;
+
+        mElements.resize(mElementCounts.size());
+        for(size_t m = 0; m < mElements.size(); ++m)
+        {
+                mElements[m].clear();
+                for(unsigned int t : mRefinedTiles)
+                        mElements[m].insert(mElements[m].end(),
+                                        mTiles[t].elements[m].begin(), mTiles[t].elements[m].end());
+        }
+}
+
+void LodCloth::step(float dt)
+{
+        mCoarse.step(dt);
+        if(mRefinedTiles.empty()) return;
+
+        // The border of the refined region follows the proxy
+        for(unsigned int f : mDriven) interpolate(f % mWidth, f / mWidth);
+
+        auto const& models = mFine.forceModels();
+        bool changed = models.size() != mElementCounts.size();
+        bool partial = true;
+        for(size_t m = 0; m < models.size(); ++m)
+        {
+                const size_t count = models[m]->elementCount();
+                if(!changed && count != mElementCounts[m]) changed = true;
+                if(count == 0) partial = false;
+        }
+        if(changed) assignElements();
+
+        // Element forces also land on the driven border, so it is cleared
+        // too. A model without elements runs over the whole sheet, and then
+        // every force is cleared; only the simulated particles use theirs.
+        ParticleSet& p = mFine.particles();
+        if(partial)
+        {
+                for(auto const* list : { &mSimulated, &mDriven })
+                {
+                        for(unsigned int f : *list)
+                        {
+                                p.fx[f] = 0.f;
+                                p.fy[f] = 0.f;
+                                p.fz[f] = 0.f;
+                        }
+                }
+        }
+        else p.clearForces();
+        for(size_t m = 0; m < models.size(); ++m)
+        {
+                if(mElementCounts[m] == 0) models[m]->addForces(p);
+                else models[m]->addForces(p, mSimulated, mElements[m]);
+        }
+        mFine.springs().addForces(p, mSprings);
+        mFine.integrate(dt, mSimulated);
+
+        // Proxy nodes inside the refined region take on the fine solution
+        ParticleSet& c = mCoarse.particles();
+        for(unsigned int n : mRestricted)
+        {
+                const size_t f = fineIndex((n % mCoarseWidth) * mRatio, (n / mCoarseWidth) * mRatio);
+                c.x[n] = p.x[f];
+                c.y[n] = p.y[f];
+                c.z[n] = p.z[f];
+                c.vx[n] = p.vx[f];
+                c.vy[n] = p.vy[f];
+                c.vz[n] = p.vz[f];
+        }
+}
+
+void LodCloth::interpolateCoarseTiles()
+{
+        for(Tile const& tile : mTiles)
+        {
+                if(tile.refined) continue;
+                for(size_t j = tile.ty * mRatio; j <= (tile.ty + 1) * mRatio; ++j)
+                        for(size_t i = tile.tx * mRatio; i <= (tile.tx + 1) * mRatio; ++i)
+                                interpolate(i, j);
+        }
+}
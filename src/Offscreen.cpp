@@ -0,0 +1,700 @@
+#include "Offscreen.hpp"
+#include "Scene.hpp"
+
+#include <atlas/core/Log.hpp>
+#include <atlas/core/GLFW.hpp>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifdef SPRINGS_HAVE_PNG
+#include <png.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace
+{
+        typedef std::vector<unsigned char> PixelBuffer;
+
+        // Creates the directory and any missing parents
+        bool makeDirectories(std::string const& path)
+        {
+                for(size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+                {
+                        const std::string part = path.substr(0, slash);
+                        if(!part.empty() && mkdir(part.c_str(), 0777) != 0 && errno != EEXIST) return false;
+                        if(slash == std::string::npos) break;
+                }
+                struct stat info;
+                return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+        }
+
+        struct Frame
+        {
+                int index;
+                PixelBuffer pixels;
+        };
+
+        // Writes frames on its own thread. Pixel buffers are recycled
+        // through a pool so that steady state rendering does not allocate.
+        class FrameEncoder
+        {
+                public:
+                        FrameEncoder(OffscreenOptions const& options) :
+                                mOptions(options),
+                                mStream(nullptr),
+                                mDone(false),
+                                mFailed(false),
+                                mWritten(0)
+                        {
+                                if(mOptions.format == OffscreenOptions::Format::RAWVIDEO)
+                                {
+                                        if(mOptions.output == "-") mStream = stdout;
+                                        else mStream = std::fopen(mOptions.output.c_str(), "wb");
+                                }
+                                mThread = std::thread(&FrameEncoder::run, this);
+                        }
+
+                        ~FrameEncoder()
+                        {
+                                finish();
+                                if(mStream && mStream != stdout) std::fclose(mStream);
+                        }
+
+                        PixelBuffer acquire(size_t size)
+                        {
+                                std::lock_guard<std::mutex> lock(mMutex);
+                                PixelBuffer buffer;
+                                if(!mPool.empty())
+                                {
+                                        buffer.swap(mPool.back());
+                                        mPool.pop_back();
+                                }
+                                buffer.resize(size);
+                                return buffer;
+                        }
+
+                        // Blocks when the encoder falls too far behind so
+                        // that memory use stays bounded.
+                        void push(Frame&& frame)
+                        {
+                                std::unique_lock<std::mutex> lock(mMutex);
+                                mSpace.wait(lock, [this]() { return mQueue.size() < kMaxQueued; });
+                                mQueue.push_back(std::move(frame));
+                                mReady.notify_one();
+                        }
+
+                        void finish()
+                        {
+                                {
+                                        std::lock_guard<std::mutex> lock(mMutex);
+                                        mDone = true;
+                                }
+                                mReady.notify_one();
+                                if(mThread.joinable()) mThread.join();
+                                if(mStream) std::fflush(mStream);
+                        }
+
+                        int written() const { return mWritten; }
+
+                        // False when the raw stream could not be opened
+                        bool isOpen() const
+                        {
+                                return mOptions.format != OffscreenOptions::Format::RAWVIDEO || mStream;
+                        }
+
+                        // Set after the first frame that could not be
+                        // written, later frames are dropped
+                        bool failed() const { return mFailed.load(); }
+
+                private:
+                        static const size_t kMaxQueued = 8;
+
+                        void run()
+                        {
+                                for(;;)
+                                {
+                                        Frame frame;
+                                        {
+                                                std::unique_lock<std::mutex> lock(mMutex);
+                                                mReady.wait(lock, [this]() { return mDone || !mQueue.empty(); });
+                                                if(mQueue.empty()) return;
+                                                frame = std::move(mQueue.front());
+                                                mQueue.pop_front();
+                                                mSpace.notify_one();
+                                        }
+
+                                        if(!mFailed.load())
+                                        {
+                                                if(write(frame)) ++mWritten;
+                                                else fail(frame.index);
+                                        }
+
+                                        std::lock_guard<std::mutex> lock(mMutex);
+                                        mPool.push_back(std::move(frame.pixels));
+                                }
+                        }
+
+                        void fail(int index)
+                        {
+                                USING_ATLAS_CORE_NS;
+                                const std::string target = mOptions.format == OffscreenOptions::Format::RAWVIDEO ?
+                                        mOptions.output : framePath(index, mOptions.format ==
+                                                        OffscreenOptions::Format::PNG ? "png" : "ppm");
+                                Log::log(Log::SeverityLevel::ERROR, "Could not write frame " +
+                                                std::to_string(index) + " to " + target + ": " +
+                                                std::strerror(errno) + ", stopping the capture");
+                                mFailed.store(true);
+                        }
+
+                        std::string framePath(int index, const char* extension) const
+                        {
+                                char name[32];
+                                std::snprintf(name, sizeof(name), "frame%06d.%s", index, extension);
+                                return mOptions.output + "/" + name;
+                        }
+
+                        // GL rows start at the bottom of the image, all of
+                        // the writers flip while walking the rows.
+                        const unsigned char* row(Frame const& frame, int y) const
+                        {
+                                const size_t stride = 4 * mOptions.width;
+                                return frame.pixels.data() + stride * (mOptions.height - 1 - y);
+                        }
+
+                        bool write(Frame const& frame)
+                        {
+                                switch(mOptions.format)
+                                {
+                                        case OffscreenOptions::Format::PNG:
+                                                return writePNG(frame);
+                                        case OffscreenOptions::Format::PPM:
+                                                return writePPM(frame);
+                                        case OffscreenOptions::Format::RAWVIDEO:
+                                                return writeRaw(frame);
+                                }
+                                return false;
+                        }
+
+                        bool writePPM(Frame const& frame)
+                        {
+                                FILE* file = std::fopen(framePath(frame.index, "ppm").c_str(), "wb");
+                                if(!file) return false;
+                                std::fprintf(file, "P6\n%d %d\n255\n", mOptions.width, mOptions.height);
+                                std::vector<unsigned char> rgb(3 * mOptions.width);
+                                for(int y = 0; y < mOptions.height; ++y)
+                                {
+                                        const unsigned char* src = row(frame, y);
+                                        for(int x = 0; x < mOptions.width; ++x)
+                                        {
+                                                rgb[3 * x]     = src[4 * x];
+                                                rgb[3 * x + 1] = src[4 * x + 1];
+                                                rgb[3 * x + 2] = src[4 * x + 2];
+                                        }
+                                        std::fwrite(rgb.data(), 1, rgb.size(), file);
+                                }
+                                const bool written = !std::ferror(file);
+                                return std::fclose(file) == 0 && written;
+                        }
+
+                        bool writeRaw(Frame const& frame)
+                        {
+                                if(!mStream) return false;
+                                const size_t stride = 4 * mOptions.width;
+                                for(int y = 0; y < mOptions.height; ++y)
+                                        if(std::fwrite(row(frame, y), 1, stride, mStream) != stride) return false;
+                                return true;
+                        }
+
+                        bool writePNG(Frame const& frame)
+                        {
+#ifdef SPRINGS_HAVE_PNG
+                                FILE* file = std::fopen(framePath(frame.index, "png").c_str(), "wb");
+                                if(!file) return false;
+
+                                png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+                                                nullptr, nullptr, nullptr);
+                                if(!png)
+                                {
+                                        std::fclose(file);
+                                        return false;
+                                }
+                                png_infop info = png_create_info_struct(png);
+                                if(!info || setjmp(png_jmpbuf(png)))
+                                {
+                                        png_destroy_write_struct(&png, &info);
+                                        std::fclose(file);
+                                        return false;
+                                }
+
+                                png_init_io(png, file);
+                                // Speed matters more than size for batch renders
+                                png_set_compression_level(png, 1);
+                                png_set_IHDR(png, info, mOptions.width, mOptions.height, 8,
+                                                PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
+                                                PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+                                png_write_info(png, info);
+                                for(int y = 0; y < mOptions.height; ++y)
+                                        png_write_row(png, const_cast<png_bytep>(row(frame, y)));
+                                png_write_end(png, nullptr);
+                                png_destroy_write_struct(&png, &info);
+                                // Buffered rows only reach the disk here
+                                return std::fclose(file) == 0;
+#else
+                                (void)frame;
+                                return false;
+#endif
+                        }
+
+                        OffscreenOptions mOptions;
+                        FILE* mStream;
+
+                        std::thread mThread;
+                        std::mutex mMutex;
+                        std::condition_variable mReady;
+                        std::condition_variable mSpace;
+                        std::deque<Frame> mQueue;
+                        std::vector<PixelBuffer> mPool;
+                        bool mDone;
+                        std::atomic<bool> mFailed;
+                        int mWritten;
+        };
+}
+
+OffscreenOptions::OffscreenOptions() :
+        width(800),
+        height(800),
+        frames(300),
+        fps(60.0),
+        scene("linear"),
+        output("."),
+#ifdef SPRINGS_HAVE_PNG
+        format(Format::PNG)
+#else
+        format(Format::PPM)
+#endif
+{ }
+
+struct OffscreenRenderer::OffscreenImpl
+{
+        // Three buffers in flight: one being written by the GPU, one
+        // waiting on its fence, one being copied out.
+        static const int kPboCount = 3;
+
+        OffscreenImpl(OffscreenOptions const& o) :
+                options(o),
+                display(EGL_NO_DISPLAY),
+                context(EGL_NO_CONTEXT),
+                surface(EGL_NO_SURFACE),
+                fbo(0),
+                colorBuffer(0),
+                depthBuffer(0),
+                frame(0)
+        {
+                pbos.fill(0);
+                fences.fill(nullptr);
+                frameIndex.fill(-1);
+        }
+
+        size_t frameSize() const
+        {
+                return 4 * static_cast<size_t>(options.width) * options.height;
+        }
+
+        bool createDisplay()
+        {
+                // Prefer the Mesa surfaceless platform, it needs neither X
+                // nor a GPU device node.
+                PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                                        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+                if(getPlatformDisplay)
+                {
+                        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                        EGL_DEFAULT_DISPLAY, nullptr);
+                }
+#endif
+                if(display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+                if(display == EGL_NO_DISPLAY) return false;
+
+                EGLint major, minor;
+                return eglInitialize(display, &major, &minor) == EGL_TRUE;
+        }
+
+        bool createContext()
+        {
+                USING_ATLAS_CORE_NS;
+                if(!createDisplay())
+                {
+                        Log::log(Log::SeverityLevel::ERROR, "Unable to open an EGL display");
+                        return false;
+                }
+
+                const EGLint configAttributes[] = {
+                        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                        EGL_RED_SIZE, 8,
+                        EGL_GREEN_SIZE, 8,
+                        EGL_BLUE_SIZE, 8,
+                        EGL_NONE
+                };
+                EGLConfig config;
+                EGLint count = 0;
+                if(!eglChooseConfig(display, configAttributes, &config, 1, &count) || count == 0)
+                {
+                        // The surfaceless platform exposes no pbuffer configs
+                        const EGLint anyConfig[] = {
+                                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                EGL_NONE
+                        };
+                        if(!eglChooseConfig(display, anyConfig, &config, 1, &count) || count == 0)
+                        {
+                                Log::log(Log::SeverityLevel::ERROR, "No usable EGL config");
+                                return false;
+                        }
+                }
+
+                eglBindAPI(EGL_OPENGL_API);
+                const EGLint contextAttributes[] = {
+                        EGL_CONTEXT_MAJOR_VERSION, 3,
+                        EGL_CONTEXT_MINOR_VERSION, 3,
+                        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                        EGL_NONE
+                };
+                context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+                if(context == EGL_NO_CONTEXT)
+                {
+                        Log::log(Log::SeverityLevel::ERROR, "Unable to create an OpenGL 3.3 context");
+                        return false;
+                }
+
+                // Everything is drawn into our own FBO, so no surface is
+                // needed. Fall back to a tiny pbuffer for drivers without
+                // EGL_KHR_surfaceless_context.
+                if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+                {
+                        const EGLint pbufferAttributes[] = {
+                                EGL_WIDTH, 1,
+                                EGL_HEIGHT, 1,
+                                EGL_NONE
+                        };
+                        surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+                        if(surface == EGL_NO_SURFACE ||
+                                        !eglMakeCurrent(display, surface, surface, context))
+                        {
+                                Log::log(Log::SeverityLevel::ERROR, "Unable to make the EGL context current");
+                                return false;
+                        }
+                }
+
+                glewExperimental = GL_TRUE;
+                GLenum err = glewInit();
+                // GLEW built against GLX complains about the missing X
+                // display after it has already loaded the core entry points
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+                if(err == GLEW_ERROR_NO_GLX_DISPLAY) err = GLEW_OK;
+#endif
+                if(err != GLEW_OK)
+                {
+                        Log::log(Log::SeverityLevel::ERROR, "Unable to load OpenGL functions");
+                        return false;
+                }
+                // glewInit may leave a spurious GL_INVALID_ENUM behind
+                glGetError();
+
+                return createFramebuffer();
+        }
+
+        bool createFramebuffer()
+        {
+                glGenRenderbuffers(1, &colorBuffer);
+                glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.width, options.height);
+
+                glGenRenderbuffers(1, &depthBuffer);
+                glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8,
+                                options.width, options.height);
+                glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+                glGenFramebuffers(1, &fbo);
+                glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                GL_RENDERBUFFER, colorBuffer);
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                                GL_RENDERBUFFER, depthBuffer);
+                if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                {
+                        USING_ATLAS_CORE_NS;
+                        Log::log(Log::SeverityLevel::ERROR, "Offscreen framebuffer is incomplete");
+                        return false;
+                }
+
+                glGenBuffers(kPboCount, pbos.data());
+                for(GLuint pbo : pbos)
+                {
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+                        glBufferData(GL_PIXEL_PACK_BUFFER, frameSize(), nullptr, GL_STREAM_READ);
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                glViewport(0, 0, options.width, options.height);
+
+                encoder.reset(new FrameEncoder(options));
+                if(!encoder->isOpen())
+                {
+                        USING_ATLAS_CORE_NS;
+                        Log::log(Log::SeverityLevel::ERROR, "Could not open " + options.output +
+                                        ": " + std::strerror(errno));
+                        return false;
+                }
+                return true;
+        }
+
+        void destroy()
+        {
+                if(context == EGL_NO_CONTEXT) return;
+                for(GLsync& fence : fences)
+                {
+                        if(fence) glDeleteSync(fence);
+                        fence = nullptr;
+                }
+                if(pbos[0]) glDeleteBuffers(kPboCount, pbos.data());
+                if(fbo) glDeleteFramebuffers(1, &fbo);
+                if(colorBuffer) glDeleteRenderbuffers(1, &colorBuffer);
+                if(depthBuffer) glDeleteRenderbuffers(1, &depthBuffer);
+
+                eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                if(surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+                eglDestroyContext(display, context);
+                eglTerminate(display);
+                context = EGL_NO_CONTEXT;
+        }
+
+        // Hand the pixels of a finished readback to the encoder
+        void drain(int slot)
+        {
+                if(frameIndex[slot] < 0) return;
+
+                GLenum status;
+                do
+                {
+                        status = glClientWaitSync(fences[slot],
+                                        GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                } while(status == GL_TIMEOUT_EXPIRED);
+                glDeleteSync(fences[slot]);
+                fences[slot] = nullptr;
+
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+                const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                frameSize(), GL_MAP_READ_BIT);
+                if(data)
+                {
+                        Frame f;
+                        f.index = frameIndex[slot];
+                        f.pixels = encoder->acquire(frameSize());
+                        std::memcpy(f.pixels.data(), data, frameSize());
+                        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                        encoder->push(std::move(f));
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                frameIndex[slot] = -1;
+        }
+
+        OffscreenOptions options;
+
+        EGLDisplay display;
+        EGLContext context;
+        EGLSurface surface;
+
+        GLuint fbo;
+        GLuint colorBuffer;
+        GLuint depthBuffer;
+        std::array<GLuint, kPboCount> pbos;
+        std::array<GLsync, kPboCount> fences;
+        std::array<int, kPboCount> frameIndex;
+
+        int frame;
+        std::unique_ptr<FrameEncoder> encoder;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+};
+
+OffscreenRenderer::OffscreenRenderer(OffscreenOptions const& options) :
+        mImpl(new OffscreenImpl(options))
+{ }
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+        finish();
+        mImpl->destroy();
+}
+
+bool OffscreenRenderer::createContext()
+{
+        return mImpl->createContext();
+}
+
+void OffscreenRenderer::beginFrame()
+{
+        if(mImpl->frame == 0) mImpl->start = std::chrono::steady_clock::now();
+        glBindFramebuffer(GL_FRAMEBUFFER, mImpl->fbo);
+        glViewport(0, 0, mImpl->options.width, mImpl->options.height);
+}
+
+void OffscreenRenderer::endFrame()
+{
+        const int slot = mImpl->frame % OffscreenImpl::kPboCount;
+
+        // The slot is reused every kPboCount frames, by now its readback
+        // has long finished and mapping it will not stall.
+        mImpl->drain(slot);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, mImpl->fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, mImpl->pbos[slot]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, mImpl->options.width, mImpl->options.height,
+                        GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        mImpl->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glFlush();
+
+        mImpl->frameIndex[slot] = mImpl->frame;
+        ++mImpl->frame;
+}
+
+void OffscreenRenderer::finish()
+{
+        if(!mImpl->encoder) return;
+
+        // Oldest first so the stream stays in order
+        for(int i = 0; i < OffscreenImpl::kPboCount; ++i)
+                mImpl->drain((mImpl->frame + i) % OffscreenImpl::kPboCount);
+        mImpl->encoder->finish();
+        mImpl->end = std::chrono::steady_clock::now();
+}
+
+bool OffscreenRenderer::failed() const
+{
+        return mImpl->encoder && mImpl->encoder->failed();
+}
+
+int OffscreenRenderer::framesWritten() const
+{
+        return mImpl->encoder ? mImpl->encoder->written() : 0;
+}
+
+double OffscreenRenderer::framesPerSecond() const
+{
+        const double seconds =
+                std::chrono::duration<double>(mImpl->end - mImpl->start).count();
+        if(seconds <= 0.0) return 0.0;
+        return mImpl->frame / seconds;
+}
+
+bool parseOffscreenOptions(int argc, char** argv, OffscreenOptions& options)
+{
+        bool offscreen = false;
+        for(int i = 1; i < argc; ++i)
+        {
+                const std::string arg = argv[i];
+                const bool hasValue = i + 1 < argc;
+                if(arg == "--offscreen" && hasValue)
+                {
+                        offscreen = true;
+                        options.output = argv[++i];
+                }
+                else if(arg == "--frames" && hasValue)
+                        options.frames = std::atoi(argv[++i]);
+                else if(arg == "--fps" && hasValue)
+                        options.fps = std::atof(argv[++i]);
+                else if(arg == "--scene" && hasValue)
+                        options.scene = argv[++i];
+                else if(arg == "--size" && hasValue)
+                        std::sscanf(argv[++i], "%dx%d", &options.width, &options.height);
+                else if(arg == "--format" && hasValue)
+                {
+                        const std::string format = argv[++i];
+                        if(format == "png") options.format = OffscreenOptions::Format::PNG;
+                        else if(format == "ppm") options.format = OffscreenOptions::Format::PPM;
+                        else if(format == "raw") options.format = OffscreenOptions::Format::RAWVIDEO;
+                }
+        }
+        return offscreen;
+}
+
+int renderOffscreen(OffscreenOptions const& options)
+{
+        USING_ATLAS_CORE_NS;
+
+#ifndef SPRINGS_HAVE_PNG
+        if(options.format == OffscreenOptions::Format::PNG)
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Built without libpng; use --format ppm or raw");
+                return 1;
+        }
+#endif
+        if(options.width <= 0 || options.height <= 0 || options.fps <= 0.0)
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Invalid offscreen size or frame rate");
+                return 1;
+        }
+
+        // Frames go into the directory, so have it before anything renders
+        if(options.format != OffscreenOptions::Format::RAWVIDEO && !makeDirectories(options.output))
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Could not create the output directory " +
+                                options.output + ": " + std::strerror(errno));
+                return 1;
+        }
+
+        // The renderer owns the context, so it must outlive the scene
+        OffscreenRenderer renderer(options);
+        if(!renderer.createContext()) return 1;
+
+        {
+                std::unique_ptr<atlas::utils::Scene> scene;
+                // Unthreaded, so every frame sees the same simulation time
+                if(options.scene == "angular") scene.reset(new AngularScene(false));
+                else if(options.scene == "softbody") scene.reset(new SoftBodyScene);
+                else if(options.scene == "cloth") scene.reset(new ClothScene);
+                else scene.reset(new LinearScene(false));
+
+                scene->screenResizeEvent(options.width, options.height);
+                // Both scenes start paused
+                scene->keyPressEvent(GLFW_KEY_SPACE, 0, GLFW_PRESS, 0);
+
+                for(int i = 0; i < options.frames && !renderer.failed(); ++i)
+                {
+                        scene->updateScene(i / options.fps);
+                        renderer.beginFrame();
+                        scene->renderScene();
+                        renderer.endFrame();
+                }
+                renderer.finish();
+        }
+
+        // Keep stdout clean when it carries the video stream
+        if(options.output != "-")
+        {
+                Log::log(Log::SeverityLevel::INFO, "Rendered " +
+                                std::to_string(renderer.framesWritten()) + " frames at " +
+                                std::to_string(renderer.framesPerSecond()) + " fps");
+        }
+        return renderer.framesWritten() == options.frames ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+#include "OutOfCore.hpp"
+#include "ChunkedSystem.hpp"
+
+#include <atlas/core/Log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+
+#include <sys/resource.h>
+
+namespace
+{
+        const float kGravity = -9.81f;
+
+        // The cloth of buildCloth, written tile by tile without ever
+        // being in memory as a whole
+        bool writeCloth(OutOfCoreOptions const& options)
+        {
+                const std::int64_t n = options.cloth;
+                const std::int64_t tile = options.tile;
+                const float height = clothHeight(static_cast<int>(n));
+
+                ChunkWriter writer;
+                if(!writer.open(options.file, 0.f, kGravity, 0.f, 0.f)) return false;
+
+                // Particles on the border of a tile may be halos of the
+                // neighbouring tiles; both sides ask for the same slot
+                std::unordered_map<std::uint64_t, std::uint32_t> slots;
+                auto slot = [&slots](std::uint64_t id) -> std::uint32_t
+                {
+                        auto found = slots.find(id);
+                        if(found != slots.end()) return found->second;
+                        const std::uint32_t next = static_cast<std::uint32_t>(slots.size());
+                        slots[id] = next;
+                        return next;
+                };
+
+                ChunkData chunk;
+                std::unordered_map<std::uint64_t, std::uint32_t> halo;
+                for(std::int64_t j0 = 0; j0 < n; j0 += tile)
+                {
+                        for(std::int64_t i0 = 0; i0 < n; i0 += tile)
+                        {
+                                const std::int64_t i1 = std::min(i0 + tile, n);
+                                const std::int64_t j1 = std::min(j0 + tile, n);
+                                auto owned = [=](std::int64_t i, std::int64_t j)
+                                { return i >= i0 && i < i1 && j >= j0 && j < j1; };
+                                auto add = [&](std::int64_t i, std::int64_t j)
+                                {
+                                        return chunk.addParticle(i * kClothSpacing, height, j * kClothSpacing, 0.f, 0.f, 0.f,
+                                                        j == 0 ? 0.f : 1.f / kClothMass);
+                                };
+
+                                chunk.clear();
+                                halo.clear();
+                                for(std::int64_t j = j0; j < j1; ++j)
+                                {
+                                        for(std::int64_t i = i0; i < i1; ++i)
+                                        {
+                                                const std::uint64_t id = static_cast<std::uint64_t>(i + n * j);
+                                                const size_t local = add(i, j);
+                                                chunk.ids.push_back(id);
+                                                if(i != i0 && i != i1 - 1 && j != j0 && j != j1 - 1) continue;
+                                                chunk.exportLocal.push_back(static_cast<std::uint32_t>(local));
+                                                chunk.exportSlot.push_back(slot(id));
+                                        }
+                                }
+
+                                auto local = [&](std::int64_t i, std::int64_t j) -> std::uint32_t
+                                {
+                                        if(owned(i, j))
+                                                return static_cast<std::uint32_t>((i - i0) + (i1 - i0) * (j - j0));
+                                        const std::uint64_t id = static_cast<std::uint64_t>(i + n * j);
+                                        auto found = halo.find(id);
+                                        if(found != halo.end()) return found->second;
+                                        const std::uint32_t index = static_cast<std::uint32_t>(add(i, j));
+                                        chunk.importSlot.push_back(slot(id));
+                                        halo[id] = index;
+                                        return index;
+                                };
+                                auto spring = [&](std::int64_t i, std::int64_t j,
+                                                std::int64_t k, std::int64_t l, float rest)
+                                {
+                                        if(!owned(i, j) && !owned(k, l)) return;
+                                        chunk.a.push_back(local(i, j));
+                                        chunk.b.push_back(local(k, l));
+                                        chunk.rest.push_back(rest);
+                                        chunk.k.push_back(kClothStiffness);
+                                        chunk.damping.push_back(kClothDamping);
+                                };
+
+                                // Every spring of an owned particle starts at
+                                // an owned particle or one row or column before
+                                const float diagonal = kClothSpacing * std::sqrt(2.f);
+                                for(std::int64_t j = std::max<std::int64_t>(j0 - 1, 0); j < j1; ++j)
+                                {
+                                        for(std::int64_t i = std::max<std::int64_t>(i0 - 1, 0); i < i1; ++i)
+                                        {
+                                                if(i + 1 < n) spring(i, j, i + 1, j, kClothSpacing);
+                                                if(j + 1 < n) spring(i, j, i, j + 1, kClothSpacing);
+                                                if(i + 1 >= n || j + 1 >= n) continue;
+                                                spring(i, j, i + 1, j + 1, diagonal);
+                                                spring(i + 1, j, i, j + 1, diagonal);
+                                        }
+                                }
+                                if(!writer.add(chunk)) return false;
+                        }
+                }
+                return writer.finish();
+        }
+
+        long peakMemory()
+        {
+                struct rusage usage;
+                getrusage(RUSAGE_SELF, &usage);
+                return usage.ru_maxrss;
+        }
+}
+
+OutOfCoreOptions::OutOfCoreOptions() :
+        steps(100),
+        cloth(1024),
+        tile(256),
+        dt(1.f / 600.f),
+        window(4),
+        cache(false),
+        reuse(false),
+        file("springs.chunks"),
+        reports(10)
+{ }
+
+bool parseOutOfCoreOptions(int argc, char** argv, OutOfCoreOptions& options)
+{
+        bool outOfCore = false;
+        for(int i = 1; i < argc; ++i)
+        {
+                const std::string arg = argv[i];
+                const bool hasValue = i + 1 < argc;
+                if(arg == "--outofcore" && hasValue)
+                {
+                        outOfCore = true;
+                        options.steps = std::atoi(argv[++i]);
+                }
+                else if(arg == "--cloth" && hasValue)
+                        options.cloth = std::atoi(argv[++i]);
+                else if(arg == "--tile" && hasValue)
+                        options.tile = std::atoi(argv[++i]);
+                else if(arg == "--dt" && hasValue)
+                        options.dt = static_cast<float>(std::atof(argv[++i]));
+                else if(arg == "--window" && hasValue)
+                        options.window = std::atoi(argv[++i]);
+                else if(arg == "--file" && hasValue)
+                        options.file = argv[++i];
+                else if(arg == "--reports" && hasValue)
+                        options.reports = std::atoi(argv[++i]);
+                else if(arg == "--cache")
+                        options.cache = true;
+                else if(arg == "--reuse")
+                        options.reuse = true;
+        }
+        return outOfCore;
+}
+
+int runOutOfCore(OutOfCoreOptions const& options)
+{
+        USING_ATLAS_CORE_NS;
+
+        if(options.steps <= 0 || options.cloth < 2 || options.tile < 2 || options.dt <= 0.f ||
+                        options.window < 1)
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Invalid out of core steps, cloth, tile, step or window");
+                return 1;
+        }
+
+        if(!options.reuse)
+        {
+                const auto start = std::chrono::steady_clock::now();
+                if(!writeCloth(options))
+                {
+                        Log::log(Log::SeverityLevel::ERROR, "Could not write " + options.file);
+                        return 1;
+                }
+                Log::log(Log::SeverityLevel::INFO, "Wrote " + options.file + " in " +
+                                std::to_string(std::chrono::duration<double>(
+                                                std::chrono::steady_clock::now() - start).count()) + " s");
+        }
+
+        ChunkedSpringSystem system;
+        if(!system.open(options.file, static_cast<unsigned int>(options.window), !options.cache))
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Could not open " + options.file);
+                return 1;
+        }
+        const double megabytes = system.fileBytes() / 1048576.0;
+        Log::log(Log::SeverityLevel::INFO, std::to_string(system.particleCount()) + " particles, " +
+                        std::to_string(system.springCount()) + " springs in " +
+                        std::to_string(system.chunkCount()) + " chunks, " +
+                        std::to_string(megabytes) + " MB");
+
+        const int reports = std::max(options.reports, 1);
+        int done = 0;
+        ChunkedSpringSystem::Stats last = system.stats();
+        for(int r = 1; r <= reports; ++r)
+        {
+                const int target = static_cast<int>(static_cast<long>(options.steps) * r / reports);
+                if(target == done) continue;
+                for(; done < target; ++done) system.step(options.dt);
+
+                ChunkedSpringSystem::Stats const& now = system.stats();
+                const double seconds = now.seconds - last.seconds;
+                const double steps = static_cast<double>(now.steps - last.steps);
+                Log::log(Log::SeverityLevel::INFO, "step " + std::to_string(done) + ": " +
+                                std::to_string(system.springCount() * steps / seconds) + " springs/s, " +
+                                std::to_string((now.bytes - last.bytes) / 1048576.0 / seconds) + " MB/s, " +
+                                std::to_string((now.majorFaults - last.majorFaults) / steps) +
+                                " waiting page faults per step");
+                last = now;
+        }
+
+        Log::log(Log::SeverityLevel::INFO, "peak resident memory " +
+                        std::to_string(peakMemory() / 1024) + " MB for a " +
+                        std::to_string(static_cast<long>(megabytes)) + " MB file");
+        return 0;
+}
@@ -0,0 +1,182 @@
+#include "ParallelStepper.hpp"
+
+#include <algorithm>
+
+#include <atlas/core/Log.hpp>
+
+ParallelStepper::ParallelStepper(SpringSystem& system, unsigned int threads, Mode mode) :
+        mSystem(system),
+        mMode(mode),
+        mPool(threads),
+        mVersion(0),
+        mSpringCount(0),
+        mParticleCount(0)
+{
+        refuseObserving();
+        prepare();
+}
+
+void ParallelStepper::refuseObserving()
+{
+        USING_ATLAS_CORE_NS;
+        if(!mSystem.observing()) return;
+        Log::log(Log::SeverityLevel::ERROR, "The parallel stepper cannot observe a system, observing is off");
+        mSystem.setObserving(false);
+}
+
+void ParallelStepper::prepare()
+{
+        SpringSet const& springs = mSystem.springs();
+        const size_t n = mSystem.particles().size();
+        mVersion = mSystem.topologyVersion();
+        mSpringCount = springs.size();
+        mParticleCount = n;
+
+        mSpringFx.resize(mSpringCount);
+        mSpringFy.resize(mSpringCount);
+        mSpringFz.resize(mSpringCount);
+
+        // Counting sort by particle; walking the springs in order leaves
+        // every list sorted by spring index
+        mFirst.assign(n + 1, 0);
+        for(size_t s = 0; s < mSpringCount; ++s)
+        {
+                ++mFirst[springs.a[s] + 1];
+                ++mFirst[springs.b[s] + 1];
+        }
+        for(size_t i = 0; i < n; ++i) mFirst[i + 1] += mFirst[i];
+        mIncident.resize(2 * mSpringCount);
+        std::vector<unsigned int> next(mFirst.begin(), mFirst.end() - 1);
+        for(size_t s = 0; s < mSpringCount; ++s)
+        {
+                const unsigned int edge = static_cast<unsigned int>(2 * s);
+                mIncident[next[springs.a[s]]++] = edge;
+                mIncident[next[springs.b[s]]++] = edge + 1;
+        }
+
+        mPartial.assign(3 * n * mPool.size(), 0.f);
+}
+
+void ParallelStepper::computeSprings(unsigned int worker)
+{
+        size_t begin, end;
+        mPool.range(worker, mSpringCount, begin, end);
+        mSystem.springs().springForces(mSystem.particles(), begin, end,
+                        mSpringFx.data(), mSpringFy.data(), mSpringFz.data());
+}
+
+void ParallelStepper::scatter(unsigned int worker)
+{
+        SpringSet const& springs = mSystem.springs();
+        const size_t n = mParticleCount;
+        float* fx = mPartial.data() + 3 * n * worker;
+        float* fy = fx + n;
+        float* fz = fy + n;
+        std::fill(fx, fx + 3 * n, 0.f);
+
+        size_t begin, end;
+        mPool.range(worker, mSpringCount, begin, end);
+        for(size_t s = begin; s < end; ++s)
+        {
+                const unsigned int i = springs.a[s];
+                const unsigned int j = springs.b[s];
+                fx[i] += mSpringFx[s];
+                fy[i] += mSpringFy[s];
+                fz[i] += mSpringFz[s];
+                fx[j] -= mSpringFx[s];
+                fy[j] -= mSpringFy[s];
+                fz[j] -= mSpringFz[s];
+        }
+}
+
+void ParallelStepper::reduce(size_t begin, size_t end)
+{
+        ParticleSet& p = mSystem.particles();
+        const size_t n = mParticleCount;
+        for(size_t i = begin; i < end; ++i)
+        {
+                float fx = 0.f, fy = 0.f, fz = 0.f;
+                for(unsigned int w = 0; w < mPool.size(); ++w)
+                {
+                        float const* partial = mPartial.data() + 3 * n * w;
+                        fx += partial[i];
+                        fy += partial[n + i];
+                        fz += partial[2 * n + i];
+                }
+                p.fx[i] = fx;
+                p.fy[i] = fy;
+                p.fz[i] = fz;
+        }
+}
+
+void ParallelStepper::gather(size_t begin, size_t end)
+{
+        ParticleSet& p = mSystem.particles();
+        for(size_t i = begin; i < end; ++i)
+        {
+                float fx = 0.f, fy = 0.f, fz = 0.f;
+                for(unsigned int e = mFirst[i]; e < mFirst[i + 1]; ++e)
+                {
+                        const unsigned int s = mIncident[e] >> 1;
+                        if(mIncident[e] & 1u)
+                        {
+                                fx -= mSpringFx[s];
+                                fy -= mSpringFy[s];
+                                fz -= mSpringFz[s];
+                        }
+                        else
+                        {
+                                fx += mSpringFx[s];
+                                fy += mSpringFy[s];
+                                fz += mSpringFz[s];
+                        }
+                }
+                p.fx[i] = fx;
+                p.fy[i] = fy;
+                p.fz[i] = fz;
+        }
+}
+
+void ParallelStepper::step(float dt)
+{
+        refuseObserving();
+        if(mSystem.topologyVersion() != mVersion || mSystem.springs().size() != mSpringCount ||
+                        mSystem.particles().size() != mParticleCount)
+                prepare();
+
+        const bool models = !mSystem.forceModels().empty();
+        const bool deterministic = mMode == Mode::Deterministic;
+
+        mPool.run([this, deterministic](unsigned int worker)
+        {
+                computeSprings(worker);
+                if(!deterministic) scatter(worker);
+        });
+
+        // Without extra models the particle forces are summed and
+        // integrated in one pass, since a particle only needs its own
+        mPool.run([this, deterministic, models, dt](unsigned int worker)
+        {
+                size_t begin, end;
+                mPool.range(worker, mParticleCount, begin, end);
+                if(deterministic) gather(begin, end);
+                else reduce(begin, end);
+                if(!models) mSystem.integrate(dt, begin, end);
+        });
+
+        if(models)
+        {
+                for(auto& model : mSystem.forceModels()) model->addForces(mSystem.particles());
+                mPool.run([this, dt](unsigned int worker)
+                {
+                        size_t begin, end;
+                        mPool.range(worker, mParticleCount, begin, end);
+                        mSystem.integrate(dt, begin, end);
+                });
+        }
+
+        // Everything was stepped, nobody needs to be woken, and spring
+        // edits were caught by the topology version
+        mSystem.takeTouched(mTouched);
+        mSystem.takeSpringEdits(mEdits);
+}
@@ -0,0 +1,57 @@
+#include "Partition.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+        void bisect(ParticleSet const& p, std::vector<unsigned int>& order,
+                        size_t begin, size_t end, unsigned int firstPart, unsigned int parts,
+                        std::vector<unsigned int>& partOf)
+        {
+                if(parts == 1 || end - begin <= 1)
+                {
+                        for(size_t r = begin; r < end; ++r) partOf[order[r]] = firstPart;
+                        return;
+                }
+
+                float lo[3] = {p.x[order[begin]], p.y[order[begin]], p.z[order[begin]]};
+                float hi[3] = {lo[0], lo[1], lo[2]};
+                for(size_t r = begin + 1; r < end; ++r)
+                {
+                        const unsigned int i = order[r];
+                        lo[0] = std::min(lo[0], p.x[i]);
+                        lo[1] = std::min(lo[1], p.y[i]);
+                        lo[2] = std::min(lo[2], p.z[i]);
+                        hi[0] = std::max(hi[0], p.x[i]);
+                        hi[1] = std::max(hi[1], p.y[i]);
+                        hi[2] = std::max(hi[2], p.z[i]);
+                }
+                const float ex = hi[0] - lo[0], ey = hi[1] - lo[1], ez = hi[2] - lo[2];
+                std::vector<float> const& axis = ex >= ey ? (ex >= ez ? p.x : p.z) : (ey >= ez ? p.y : p.z);
+
+                // Ties are broken by index so the split is the same on
+                // every process that computes it
+                const unsigned int left = parts / 2;
+                const size_t middle = begin + (end - begin) * left / parts;
+                std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                                [&axis](unsigned int i, unsigned int j)
+                                {
+                                        return axis[i] < axis[j] || (axis[i] == axis[j] && i < j);
+                                });
+
+                bisect(p, order, begin, middle, firstPart, left, partOf);
+                bisect(p, order, middle, end, firstPart + left, parts - left, partOf);
+        }
+}
+
+std::vector<unsigned int> recursiveBisection(ParticleSet const& particles, unsigned int parts)
+{
+        std::vector<unsigned int> partOf(particles.size(), 0);
+        if(parts <= 1 || particles.size() == 0) return partOf;
+
+        std::vector<unsigned int> order(particles.size());
+        std::iota(order.begin(), order.end(), 0u);
+        bisect(particles, order, 0, order.size(), 0, parts, partOf);
+        return partOf;
+}
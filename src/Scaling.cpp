@@ -0,0 +1,236 @@
+#include "Scaling.hpp"
+#include "Checksum.hpp"
+#include "Collision.hpp"
+#include "Domain.hpp"
+#include "Partition.hpp"
+#include "SharedMemoryTransport.hpp"
+#include "SpringSystem.hpp"
+
+#include <atlas/core/Log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+        // Particles sent per step by all ranks together: every particle
+        // goes once to each other domain that one of its springs reaches
+        size_t haloParticles(SpringSet const& springs, std::vector<unsigned int> const& partOf,
+                        unsigned int parts)
+        {
+                std::vector<std::uint64_t> sends;
+                for(size_t s = 0; s < springs.size(); ++s)
+                {
+                        const unsigned int a = springs.a[s], b = springs.b[s];
+                        if(partOf[a] == partOf[b]) continue;
+                        sends.push_back(static_cast<std::uint64_t>(a) * parts + partOf[b]);
+                        sends.push_back(static_cast<std::uint64_t>(b) * parts + partOf[a]);
+                }
+                std::sort(sends.begin(), sends.end());
+                return static_cast<size_t>(std::unique(sends.begin(), sends.end()) - sends.begin());
+        }
+
+        // What every rank does. The barriers around the stepping make rank
+        // zero's time that of the slowest rank, and rank zero gathers the
+        // final state into result. Returns false if a rank went missing.
+        bool stepDomain(ScalingOptions const& options, SpringSystem const& initial,
+                        std::vector<unsigned int> const& partOf, SharedMemoryTransport& transport,
+                        SpringSystem& result, double& seconds)
+        {
+                SpringDomain domain(initial, partOf, transport);
+
+                transport.barrier();
+                const auto start = std::chrono::steady_clock::now();
+                for(int step = 0; step < options.steps && !transport.aborted(); ++step)
+                        domain.step(options.dt);
+                transport.barrier();
+                seconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start).count();
+
+                domain.gather(result);
+                return !transport.aborted();
+        }
+
+        struct RunResult
+        {
+                double seconds;
+                size_t haloParticles;
+                std::uint64_t checksum;
+        };
+
+        // Rank zero runs here, the others in forked children
+        bool run(ScalingOptions const& options, SpringSystem const& initial, int processes,
+                        RunResult& result)
+        {
+                const std::vector<unsigned int> partOf = recursiveBisection(initial.particles(),
+                                static_cast<unsigned int>(processes));
+                result.haloParticles = haloParticles(initial.springs(), partOf,
+                                static_cast<unsigned int>(processes));
+
+                // The segment is mapped before forking, so the name is not
+                // needed by anyone and goes away even if a rank dies
+                SharedMemoryTransport transport;
+                const std::string name = "/springs-domains-" + std::to_string(getpid());
+                if(!transport.create(name, processes, static_cast<size_t>(options.ring) * 1024))
+                        return false;
+                transport.unlink();
+
+                std::fflush(nullptr);
+                const pid_t parent = getpid();
+                std::vector<pid_t> children;
+                for(int rank = 1; rank < processes; ++rank)
+                {
+                        const pid_t child = fork();
+                        if(child < 0) break;
+                        if(child == 0)
+                        {
+                                // Orphaned ranks stop waiting
+                                SpringSystem unused;
+                                double seconds;
+                                transport.setRank(rank);
+                                transport.setLiveness([parent]() { return getppid() == parent; });
+                                _exit(stepDomain(options, initial, partOf, transport, unused, seconds) ? 0 : 1);
+                        }
+                        children.push_back(child);
+                }
+                if(children.size() + 1 != static_cast<size_t>(processes))
+                {
+                        for(pid_t child : children)
+                        {
+                                kill(child, SIGKILL);
+                                waitpid(child, nullptr, 0);
+                        }
+                        return false;
+                }
+
+                // Rank zero polls the others while it waits, so one that
+                // crashes aborts the run instead of hanging it. Ranks that
+                // are done may exit while it still gathers.
+                bool clean = true;
+                std::vector<char> exited(children.size(), 0);
+                auto reap = [&](size_t c, int flags)
+                {
+                        int status = 0;
+                        const pid_t reaped = waitpid(children[c], &status, flags);
+                        if(reaped == 0) return;
+                        exited[c] = 1;
+                        if(reaped != children[c] || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                                clean = false;
+                };
+                transport.setLiveness([&]()
+                {
+                        for(size_t c = 0; c < children.size(); ++c)
+                                if(!exited[c]) reap(c, WNOHANG);
+                        return clean;
+                });
+
+                SpringSystem global = initial;
+                if(!stepDomain(options, initial, partOf, transport, global, result.seconds)) clean = false;
+                result.checksum = stateChecksum(global.particles());
+
+                for(size_t c = 0; c < children.size(); ++c)
+                        if(!exited[c]) reap(c, 0);
+                return clean;
+        }
+}
+
+ScalingOptions::ScalingOptions() :
+        steps(500),
+        lattice(256),
+        dt(1.f / 600.f),
+        processes(16),
+        ring(256)
+{ }
+
+bool parseScalingOptions(int argc, char** argv, ScalingOptions& options)
+{
+        bool scaling = false;
+        for(int i = 1; i < argc; ++i)
+        {
+                const std::string arg = argv[i];
+                const bool hasValue = i + 1 < argc;
+                if(arg == "--domains" && hasValue)
+                {
+                        scaling = true;
+                        options.steps = std::atoi(argv[++i]);
+                }
+                else if(arg == "--lattice" && hasValue)
+                        options.lattice = std::atoi(argv[++i]);
+                else if(arg == "--dt" && hasValue)
+                        options.dt = static_cast<float>(std::atof(argv[++i]));
+                else if(arg == "--processes" && hasValue)
+                        options.processes = std::atoi(argv[++i]);
+                else if(arg == "--ring" && hasValue)
+                        options.ring = std::atoi(argv[++i]);
+        }
+        return scaling;
+}
+
+int runScaling(ScalingOptions const& options)
+{
+        USING_ATLAS_CORE_NS;
+
+        if(options.steps <= 0 || options.lattice < 2 || options.dt <= 0.f || options.processes < 1 ||
+                        options.ring < 1)
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Invalid domain steps, lattice, step, processes or ring size");
+                return 1;
+        }
+
+        SpringSystem initial;
+        buildCloth(initial, options.lattice);
+        auto floor = std::make_shared<CollisionWorld>();
+        floor->add(std::make_shared<PlaneCollider>());
+        initial.setColliders(floor);
+        const double springSteps = static_cast<double>(initial.springs().size()) * options.steps;
+
+        // The serial step is the reference every decomposition must match
+        SpringSystem serial = initial;
+        const auto start = std::chrono::steady_clock::now();
+        for(int step = 0; step < options.steps; ++step) serial.step(options.dt);
+        const double serialSeconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+        const std::uint64_t reference = stateChecksum(serial.particles());
+        Log::log(Log::SeverityLevel::INFO, "serial: " + std::to_string(initial.particles().size()) +
+                        " particles, " + std::to_string(springSteps / serialSeconds) + " springs/s");
+
+        std::vector<int> counts;
+        for(int p = 1; p < options.processes; p *= 2) counts.push_back(p);
+        counts.push_back(options.processes);
+
+        int status = 0;
+        double single = 0.0;
+        for(int processes : counts)
+        {
+                RunResult result;
+                if(!run(options, initial, processes, result))
+                {
+                        Log::log(Log::SeverityLevel::ERROR, "Could not run " + std::to_string(processes) +
+                                        " processes");
+                        return 1;
+                }
+                if(processes == 1) single = result.seconds;
+                const double speedup = single / result.seconds;
+                const bool same = result.checksum == reference;
+                if(!same) status = 1;
+
+                Log::log(Log::SeverityLevel::INFO, std::to_string(processes) +
+                                (processes == 1 ? " process: " : " processes: ") +
+                                std::to_string(springSteps / result.seconds) + " springs/s, speedup " +
+                                std::to_string(speedup) + ", efficiency " +
+                                std::to_string(speedup / processes) + ", halo " +
+                                std::to_string(result.haloParticles * 6 * sizeof(float) / 1024.0) +
+                                " KB per step, " + (same ? "identical to" : "differs from") + " the serial step");
+        }
+        return status;
+}
@@ -1,22 +1,79 @@
 #include "Scene.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 
 #include <atlas/core/Log.hpp>
 #include <atlas/core/GLFW.hpp>
 
-LinearScene::LinearScene() :
+namespace
+{
+        const double kSimulationRate = 1000.0;
+        const float kPi = 3.14159265f;
+
+        // Half size of the Grid, which lies in the xz plane
+        const float kFloorSize = 12.f;
+
+        // The cloth scene's bar swings across the hanging cloth
+        const float kBarHeight = 6.f;
+        const float kBarSwing = 3.f;
+        const float kBarPeriod = 4.f;
+        const float kPyramidTurn = 0.3f;        // Radians per second
+
+        // The energy a body trades in normal running, taken as that of its
+        // free particles falling through height
+        double fallEnergy(SpringSystem const& system, double height)
+        {
+                ParticleSet const& p = system.particles();
+                double mass = 0.0;
+                for(float w : p.invMass)
+                        if(w > 0.f) mass += 1.0 / w;
+                return mass * 9.81 * height;
+        }
+}
+
+LinearScene::LinearScene(bool threaded, std::string const& control) :
         mDragging(false),
         mPaused(true),
-        mPrevTime(0.0)
+        mThreaded(threaded),
+        mColliding(false),
+        mPrevTime(0.0),
+        // The scene has always run at twice real time
+        mSimulation([this](float dt) { mSpring.simulate(2.f * dt); },
+                        [this]() { publish(); },
+                        kSimulationRate)
 {
         glEnable(GL_DEPTH_TEST);
         glDisable(GL_CULL_FACE);
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+        mColliders = std::make_shared<CollisionWorld>();
+        mColliders->add(std::make_shared<PlaneCollider>(kFloorSize, kFloorSize));
+
+        mSimulation.setPaused(mPaused);
+        publish();
+        if(!control.empty())
+        {
+                mControl.reset(new ControlServer(control, mSimulation, mSpring));
+                if(!mControl->start()) mControl.reset();
+        }
+        if(mThreaded) mSimulation.start();
+}
+
+LinearScene::~LinearScene()
+{
+        // The control server's observer is only dropped once nothing steps
+        mSimulation.stop();
+        if(mControl) mControl->stop();
+}
+
+void LinearScene::publish()
+{
+        mSnapshots.writeBuffer() = mSpring.points();
+        mSnapshots.publish();
 }
-LinearScene::~LinearScene() { }
 
 void LinearScene::mousePressEvent(int b, int a, int m, double x, double y)
 {
@@ -77,40 +134,51 @@ void LinearScene::keyPressEvent(int key, int scancode, int action, int modes)
         {
                 if (key == GLFW_KEY_SPACE)
                 {
-                        mPaused = !mPaused;
+                        // The control socket may have paused it too
+                        mPaused = !mSimulation.isPaused();
+                        mSimulation.setPaused(mPaused);
                 }
                 else if (key == GLFW_KEY_R)
                 {
-                        mSpring.resetGeometry();
+                        mSimulation.post([this]() { mSpring.reset(); });
+                }
+                else if (key == GLFW_KEY_C)
+                {
+                        // The bob lands on the grid
+                        mColliding = !mColliding;
+                        std::shared_ptr<CollisionWorld> colliders = mColliding ? mColliders : nullptr;
+                        mSimulation.post([this, colliders]() { mSpring.setColliders(colliders); });
                 }
                 else
                 {
+                        // Edits run on the simulation thread between steps
                         USING_ATLAS_MATH_NS;
+                        Spring& spring = mSpring;
                         switch(key)
                         {
                                 case GLFW_KEY_W:
-                                        mSpring.moveFixed(Vector(1, 0, 0));
+                                        mSimulation.post([&spring]() { spring.moveFixed(Vector(1, 0, 0)); });
                                         break;
                                 case GLFW_KEY_S:
-                                        mSpring.moveFixed(Vector(-1, 0, 0));
+                                        mSimulation.post([&spring]() { spring.moveFixed(Vector(-1, 0, 0)); });
                                         break;
                                 case GLFW_KEY_A:
-                                        mSpring.moveFixed(Vector(0, 0, -1));
+                                        mSimulation.post([&spring]() { spring.moveFixed(Vector(0, 0, -1)); });
                                         break;
                                 case GLFW_KEY_D:
-                                        mSpring.moveFixed(Vector(0, 0, 1));
+                                        mSimulation.post([&spring]() { spring.moveFixed(Vector(0, 0, 1)); });
                                         break;
                                 case GLFW_KEY_Q:
-                                        mSpring.changeLength(1.25);
+                                        mSimulation.post([&spring]() { spring.changeLength(1.25); });
                                         break;
                                 case GLFW_KEY_E:
-                                        mSpring.changeLength(0.25);
+                                        mSimulation.post([&spring]() { spring.changeLength(0.25); });
                                         break;
                                 case GLFW_KEY_Z:
-                                        mSpring.changeMass(0.5f);
+                                        mSimulation.post([&spring]() { spring.changeMass(0.5f); });
                                         break;
                                 case GLFW_KEY_X:
-                                        mSpring.changeMass(-0.5f);
+                                        mSimulation.post([&spring]() { spring.changeMass(-0.5f); });
                                         break;
 
 
@@ -121,18 +189,17 @@ void LinearScene::keyPressEvent(int key, int scancode, int action, int modes)
 
 void LinearScene::updateScene(double time)
 {
-        if(!mPaused)
-        {
-                mTime.deltaTime = static_cast<float>(time) - mTime.currentTime;
-                mTime.totalTime += static_cast<float>(time);
-                mTime.currentTime = static_cast<float>(time);
-                mTime.deltaTime *= 2.f;
-                mSpring.updateGeometry(mTime);
-        }
+        // Threaded, the physics keeps its own clock
+        if(!mThreaded) mSimulation.advance(time - mPrevTime);
+        mPrevTime = time;
 }
 
 void LinearScene::renderScene()
 {
+        // Never waits on the simulation, the last snapshot is drawn again
+        // if no new one has arrived
+        if(mSnapshots.update()) mSpring.uploadPoints(mSnapshots.readBuffer());
+
         const float grey = 0.631;
         glClearColor(grey, grey, grey, 1.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -142,16 +209,42 @@ void LinearScene::renderScene()
         mGrid.renderGeometry(mProjection, mView);
 }
 
-AngularScene::AngularScene() :
+AngularScene::AngularScene(bool threaded, std::string const& control) :
         mDragging(false),
         mPaused(true),
-        mPrevTime(0.f)
+        mThreaded(threaded),
+        mPrevTime(0.0),
+        // The rod used to advance half a time unit per 60 Hz frame; keep
+        // that speed at the higher step rate
+        mSimulation([this](float dt) { mSpring.simulate(30.f * dt); },
+                        [this]() { publish(); },
+                        kSimulationRate)
 {
         glEnable(GL_DEPTH_TEST);
         glDisable(GL_CULL_FACE);
+
+        mSimulation.setPaused(mPaused);
+        publish();
+        if(!control.empty())
+        {
+                mControl.reset(new ControlServer(control, mSimulation, mSpring));
+                if(!mControl->start()) mControl.reset();
+        }
+        if(mThreaded) mSimulation.start();
+}
+
+AngularScene::~AngularScene()
+{
+        // The control server's observer is only dropped once nothing steps
+        mSimulation.stop();
+        if(mControl) mControl->stop();
 }
 
-AngularScene::~AngularScene() { }
+void AngularScene::publish()
+{
+        mSnapshots.writeBuffer() = mSpring.points();
+        mSnapshots.publish();
+}
 
 void AngularScene::mousePressEvent(int b, int a, int m, double x, double y)
 {
@@ -202,48 +295,53 @@ void AngularScene::keyPressEvent(int key, int scancode, int action, int modes)
 {
         if(action == GLFW_PRESS)
         {
-                if(key == GLFW_KEY_SPACE) mPaused = !mPaused;
+                if(key == GLFW_KEY_SPACE)
+                {
+                        // The control socket may have paused it too
+                        mPaused = !mSimulation.isPaused();
+                        mSimulation.setPaused(mPaused);
+                }
                 else if (key == GLFW_KEY_S && modes == GLFW_MOD_CONTROL)
                 {
-                        mTime.deltaTime = 0.5f;
-                        mTime.totalTime += 0.5f;
-                        mSpring.stepGeometry(mTime);
+                        // Single step, one old frame's worth
+                        mSimulation.post([this]() { mSpring.wake(); mSpring.simulate(0.5f); });
                 }
-                else if (key == GLFW_KEY_R) mSpring.resetGeometry();
+                else if (key == GLFW_KEY_R) mSimulation.post([this]() { mSpring.reset(); });
                 else
                 {
                         USING_ATLAS_MATH_NS;
+                        AngularSpring& spring = mSpring;
                         switch(key)
                         {
                                 case GLFW_KEY_Q:
-                                        mSpring.changeRest(glm::vec3(1.25f, 0.f, 0.f));
+                                        mSimulation.post([&spring]() { spring.changeRest(glm::vec3(1.25f, 0.f, 0.f)); });
                                         break;
                                 case GLFW_KEY_E:
-                                        mSpring.changeRest(glm::vec3(0.25, 0.f, 0.f));
+                                        mSimulation.post([&spring]() { spring.changeRest(glm::vec3(0.25, 0.f, 0.f)); });
                                         break;
                                 case GLFW_KEY_W:
-                                        mSpring.changeRest(glm::vec3(1.f, 1.1f, 0.f));
+                                        mSimulation.post([&spring]() { spring.changeRest(glm::vec3(1.f, 1.1f, 0.f)); });
                                         break;
                                 case GLFW_KEY_S:
-                                        mSpring.changeRest(glm::vec3(1.f, -1.1f, 0.f));
+                                        mSimulation.post([&spring]() { spring.changeRest(glm::vec3(1.f, -1.1f, 0.f)); });
                                         break;
                                 case GLFW_KEY_A:
-                                        mSpring.changeRest(glm::vec3(1.f, 0.f, 1.f));
+                                        mSimulation.post([&spring]() { spring.changeRest(glm::vec3(1.f, 0.f, 1.f)); });
                                         break;
                                 case GLFW_KEY_D:
-                                        mSpring.changeRest(glm::vec3(1.f, 0.f, -1.f));
+                                        mSimulation.post([&spring]() { spring.changeRest(glm::vec3(1.f, 0.f, -1.f)); });
                                         break;
                                 case GLFW_KEY_Z:
-                                        mSpring.changeMass(0.5f);
+                                        mSimulation.post([&spring]() { spring.changeMass(0.5f); });
                                         break;
                                 case GLFW_KEY_X:
-                                        mSpring.changeMass(-0.5f);
+                                        mSimulation.post([&spring]() { spring.changeMass(-0.5f); });
                                         break;
                                 case GLFW_KEY_F:
-                                        mSpring.changeK(0.5f);
+                                        mSimulation.post([&spring]() { spring.changeK(0.5f); });
                                         break;
                                 case GLFW_KEY_G:
-                                        mSpring.changeK(-0.5f);
+                                        mSimulation.post([&spring]() { spring.changeK(-0.5f); });
                                         break;
                         }
                 }
@@ -253,25 +351,487 @@ void AngularScene::keyPressEvent(int key, int scancode, int action, int modes)
 
 void AngularScene::updateScene(double time)
 {
+        if(!mThreaded) mSimulation.advance(time - mPrevTime);
+        mPrevTime = time;
+}
+
+void AngularScene::renderScene()
+{
+        if(mSnapshots.update()) mSpring.uploadPoints(mSnapshots.readBuffer());
+
+        const float grey = 0.631;
+        glClearColor(grey, grey, grey, 1.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        mView = mCamera.getCameraMatrix();
+        mSpring.renderGeometry(mProjection, mView);
+        mGrid.renderGeometry(mProjection, mView);
+}
+
+SoftBodyScene::SoftBodyScene() :
+        mDragging(false),
+        mPaused(true),
+        mAccumulator(0.f),
+        mMode(TetMesh::Mode::COROTATIONAL),
+        mGuardScale(0.0),
+        mGuardArmed(false)
+{
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        buildSystem();
+}
+
+SoftBodyScene::~SoftBodyScene() { }
+
+void SoftBodyScene::buildSystem()
+{
+        // A cantilever beam of tetrahedra clamped at one end, with a weight
+        // hanging off the free end on a spring
+        const size_t nx = 8, ny = 2, nz = 2;
+        const float spacing = 1.f;
+
+        mSystem.reset(new SpringSystem);
+        mTets = std::make_shared<TetMesh>(8000.f, 0.3f, mMode);
+        const size_t first = addTetBox(*mSystem, *mTets, -4.f, 6.f, -1.f,
+                        nx, ny, nz, spacing, 20.f);
+
+        ParticleSet& p = mSystem->particles();
+        for(size_t k = 0; k <= nz; ++k)
+                for(size_t j = 0; j <= ny; ++j)
+                        p.setMass(first + (nx + 1) * (j + (ny + 1) * k), 0.f);
+
+        mTip = first + nx;
+        mWeight = mSystem->addParticle(p.x[mTip], p.y[mTip] - 3.f, p.z[mTip], 20.f);
+        mWeightSpring = mSystem->addSpring(mTip, mWeight, 400.f, 2.f);
+
+        mSystem->addForceModel(mTets);
+        mSystem->setDamping(0.5f);
+        mSystem->setObserving(true);
+        mTopology.reset(new SpringTopology(*mSystem));
+        mGuardScale = fallEnergy(*mSystem, nx * spacing);
+        mGuardArmed = false;
+
+        // Element edges first, then one line per spring slot
+        std::vector<unsigned int> edges;
+        mTets->appendEdges(edges);
+        mIslands.build(*mSystem);
+        mTetIndexCount = edges.size();
+        edges.insert(edges.end(), mTopology->indices().begin(), mTopology->indices().end());
+        mMesh.setEdges(edges);
+        mMesh.updatePositions(p);
+
+        size_t begin, end;
+        mTopology->takeDirtyRange(begin, end);
+        mAccumulator = 0.f;
+}
+
+void SoftBodyScene::uploadSprings()
+{
+        // Only the spring slots that changed go to the GPU
+        std::vector<unsigned int> const& indices = mTopology->indices();
+        size_t begin, end;
+        if(mTopology->takeDirtyRange(begin, end))
+                mMesh.updateEdges(mTetIndexCount + 2 * begin, &indices[2 * begin], 2 * (end - begin));
+        mMesh.setEdgeCount(mTetIndexCount + indices.size());
+}
+
+void SoftBodyScene::mousePressEvent(int b, int a, int m, double x, double y)
+{
+        USING_ATLAS_MATH_NS;
+        if(b == GLFW_MOUSE_BUTTON_MIDDLE)
+        {
+                if(a == GLFW_PRESS)
+                {
+                        mDragging = true;
+                        Camera::CameraMovements movements;
+                        switch(m)
+                        {
+                                case GLFW_MOD_CONTROL:
+                                        movements = Camera::CameraMovements::DOLLY;
+                                        break;
+                                case GLFW_MOD_SHIFT:
+                                        movements = Camera::CameraMovements::TRACK;
+                                        break;
+                                default:
+                                        movements= Camera::CameraMovements::TUMBLE;
+                                        break;
+                        }
+                        mCamera.mouseDown(Point2(x, y), movements);
+                }
+                else
+                {
+                        mDragging = false;
+                        mCamera.mouseUp();
+                }
+        }
+}
+
+void SoftBodyScene::mouseMoveEvent(double x, double y)
+{
+        USING_ATLAS_MATH_NS;
+        if(mDragging) mCamera.mouseDrag(Point2(x, y));
+}
+
+void SoftBodyScene::scrollEvent(double x, double y)
+{
+        USING_ATLAS_MATH_NS;
+        mCamera.mouseScroll(Point2(x, y));
+}
+
+void SoftBodyScene::keyPressEvent(int key, int scancode, int action, int modes)
+{
+        if(action == GLFW_PRESS)
+        {
+                if(key == GLFW_KEY_SPACE) mPaused = !mPaused;
+                else if(key == GLFW_KEY_R) buildSystem();
+                else if(key == GLFW_KEY_L)
+                {
+                        // Linear elements balloon as soon as the beam bends
+                        mMode = (mMode == TetMesh::Mode::LINEAR) ?
+                                TetMesh::Mode::COROTATIONAL : TetMesh::Mode::LINEAR;
+                        mTets->setMode(mMode);
+                        mIslands.wakeAll();
+                }
+                else if(key == GLFW_KEY_Z || key == GLFW_KEY_X)
+                {
+                        // A heavy enough weight tears its spring
+                        ParticleSet& p = mSystem->particles();
+                        const float mass = 1.f / p.invMass[mWeight] + (key == GLFW_KEY_Z ? 10.f : -10.f);
+                        p.setMass(mWeight, std::max(mass, 1.f));
+                        mSystem->touch(mWeight);
+                        mGuardArmed = false;
+                }
+                else if(key == GLFW_KEY_C)
+                {
+                        // Hook the weight back onto the tip of the beam,
+                        // unless it still hangs there
+                        if(!mTopology->isAlive(mWeightSpring))
+                        {
+                                mWeightSpring = mTopology->addSpring(mTip, mWeight, 400.f, 2.f);
+                                uploadSprings();
+                                mGuardArmed = false;
+                        }
+                }
+                else if(key == GLFW_KEY_V)
+                {
+                        // Cut across the middle of the weight's spring
+                        ParticleSet const& p = mSystem->particles();
+                        const float nx = p.x[mWeight] - p.x[mTip];
+                        const float ny = p.y[mWeight] - p.y[mTip];
+                        const float nz = p.z[mWeight] - p.z[mTip];
+                        if(mTopology->cut(p.x[mTip] + 0.5f * nx, p.y[mTip] + 0.5f * ny,
+                                                p.z[mTip] + 0.5f * nz, nx, ny, nz, 0.5f) > 0)
+                        {
+                                uploadSprings();
+                                mGuardArmed = false;
+                        }
+                }
+        }
+}
+
+void SoftBodyScene::updateScene(double time)
+{
+        const float substep = 1.f / 600.f;
+
         if(!mPaused)
         {
                 mTime.deltaTime = static_cast<float>(time) - mTime.currentTime;
                 mTime.totalTime += static_cast<float>(time);
-                mTime.currentTime= static_cast<float>(time);
-                mTime.deltaTime /= 10000.f;
+                mTime.currentTime = static_cast<float>(time);
 
-                mSpring.updateGeometry(mTime);
+                // Explicit integration needs a fixed, small step; cap the
+                // catch up so a long frame does not spiral
+                mAccumulator = std::min(mAccumulator + mTime.deltaTime, 0.1f);
+                while(mAccumulator >= substep)
+                {
+                        mIslands.step(*mSystem, substep);
+                        mAccumulator -= substep;
+                }
+                checkEnergy();
+                mIslands.awakeSprings(mAwakeSprings);
+                if(mTopology->tear(1.f, mAwakeSprings) > 0) uploadSprings();
+                // Nothing moves once the beam has settled
+                if(mIslands.awakeCount() > 0) mMesh.updatePositions(mSystem->particles());
         }
+        else
+        {
+                mTime.currentTime = static_cast<float>(time);
+        }
+}
 
+void SoftBodyScene::checkEnergy()
+{
+        USING_ATLAS_CORE_NS;
+        // The tetrahedra's own energy is not counted, but it only ever
+        // comes out of what the beam had to begin with
+        Observables const& observed = mSystem->observables();
+        if(observed.steps == 0) return;
+        if(!mGuardArmed)
+        {
+                mGuard.reset(observed.energy(), mGuardScale);
+                mGuardArmed = true;
+        }
+        else if(mGuard.diverged(observed.energy()))
+        {
+                Log::log(Log::SeverityLevel::ERROR, "The beam has blown up, pausing (R rebuilds it)");
+                mPaused = true;
+                mGuardArmed = false;
+        }
 }
 
-void AngularScene::renderScene()
+void SoftBodyScene::renderScene()
 {
         const float grey = 0.631;
         glClearColor(grey, grey, grey, 1.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glEnable(GL_DEPTH_TEST);
         mView = mCamera.getCameraMatrix();
-        mSpring.renderGeometry(mProjection, mView);
+        mMesh.renderGeometry(mProjection, mView);
+        mGrid.renderGeometry(mProjection, mView);
+}
+
+ClothScene::ClothScene() :
+        mDragging(false),
+        mPaused(true),
+        mWindy(true),
+        mColliding(false),
+        mAccumulator(0.f),
+        mColliderTime(0.f),
+        mGuardScale(0.0),
+        mGuardArmed(false)
+{
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        buildColliders();
+        buildCloth();
+}
+
+ClothScene::~ClothScene() { }
+
+void ClothScene::buildCloth()
+{
+        // 12 x 12 units, pinned along its far edge, with one proxy node
+        // every 8 particles
+        mCloth.reset(new LodCloth(97, 97, 8, -6.f, 12.f, -6.f, 0.125f,
+                                0.005f, 200.f, 0.05f));
+        mMesh.setEdges(mCloth->edges());
+        mMesh.updatePositions(mCloth->particles());
+        mAccumulator = 0.f;
+
+        // The wind does work on the cloth, but never more than lifting it
+        // back up its own length
+        mCloth->coarse().setObserving(true);
+        mGuardScale = fallEnergy(mCloth->coarse(), 12.0);
+        mGuardArmed = false;
+
+        // A steady breeze across the sheet with turbulence on top. The
+        // noise lattice is a lot coarser than the fine particles.
+        mBreeze = std::make_shared<UniformWind>(0.f, 0.f, mWindy ? 3.f : 0.f);
+        mGusts = std::make_shared<NoiseWind>(mWindy ? 1.5f : 0.f, 8.f, 1.f, 3, 0.5f);
+
+        mCoarseWind = std::make_shared<WindForce>();
+        mFineWind = std::make_shared<WindForce>();
+        for(auto& wind : { mCoarseWind, mFineWind })
+        {
+                wind->addField(mBreeze);
+                wind->addField(mGusts);
+        }
+        mCoarseWind->addGrid(mCloth->coarseWidth(), mCloth->coarseHeight());
+        mFineWind->addGrid(mCloth->width(), mCloth->height());
+        mCloth->coarse().addForceModel(mCoarseWind);
+        mCloth->fine().addForceModel(mFineWind);
+
+        std::shared_ptr<CollisionWorld> colliders = mColliding ? mColliders : nullptr;
+        mCloth->coarse().setColliders(colliders);
+        mCloth->fine().setColliders(colliders);
+}
+
+void ClothScene::buildColliders()
+{
+        mColliders = std::make_shared<CollisionWorld>();
+        mColliders->setRadius(0.05f);
+        mColliders->add(std::make_shared<PlaneCollider>(kFloorSize, kFloorSize));
+
+        // A bar across the whole width of the cloth
+        mBar = std::make_shared<CapsuleCollider>(7.f, 0.4f);
+        mColliders->add(mBar);
+
+        const std::vector<Vec3> vertices
+        {
+                Vec3(-2.5f, 0.f, -2.5f), Vec3(2.5f, 0.f, -2.5f),
+                Vec3(2.5f, 0.f, 2.5f), Vec3(-2.5f, 0.f, 2.5f),
+                Vec3(0.f, 3.f, 0.f)
+        };
+        const std::vector<unsigned int> triangles
+        {
+                0, 1, 4,   1, 2, 4,   2, 3, 4,   3, 0, 4,
+                0, 2, 1,   0, 3, 2
+        };
+        mPyramid = std::make_shared<MeshCollider>(vertices, triangles);
+        mColliders->add(mPyramid);
+
+        // Twice, so that they start out at rest
+        mColliderTime = 0.f;
+        moveColliders(0.f);
+        moveColliders(0.f);
+
+        uploadOutlines();
+        std::vector<unsigned int> edges(mOutlineLines.size());
+        for(unsigned int i = 0; i < edges.size(); ++i) edges[i] = i;
+        mOutlines.setEdges(edges);
+}
+
+void ClothScene::moveColliders(float dt)
+{
+        mColliderTime += dt;
+        const float phase = 2.f * kPi * mColliderTime / kBarPeriod;
+        mBar->moveTo(RigidPose::axisAngle(Vec3(0.f, 0.f, 1.f), 0.5f * kPi,
+                                Vec3(0.f, kBarHeight, -6.f + kBarSwing * std::sin(phase))));
+        mPyramid->moveTo(RigidPose::axisAngle(Vec3(0.f, 1.f, 0.f), kPyramidTurn * mColliderTime,
+                                Vec3(0.f, 0.f, -4.f)));
+}
+
+void ClothScene::uploadOutlines()
+{
+        mOutlineLines.clear();
+        for(auto const& collider : mColliders->colliders()) collider->outline(mOutlineLines);
+        mOutlinePositions.resize(3 * mOutlineLines.size());
+        for(size_t i = 0; i < mOutlineLines.size(); ++i)
+        {
+                mOutlinePositions[3 * i]     = mOutlineLines[i].x;
+                mOutlinePositions[3 * i + 1] = mOutlineLines[i].y;
+                mOutlinePositions[3 * i + 2] = mOutlineLines[i].z;
+        }
+        mOutlines.updatePositions(mOutlinePositions);
+}
+
+void ClothScene::mousePressEvent(int b, int a, int m, double x, double y)
+{
+        USING_ATLAS_MATH_NS;
+        if(b == GLFW_MOUSE_BUTTON_MIDDLE)
+        {
+                if(a == GLFW_PRESS)
+                {
+                        mDragging = true;
+                        Camera::CameraMovements movements;
+                        switch(m)
+                        {
+                                case GLFW_MOD_CONTROL:
+                                        movements = Camera::CameraMovements::DOLLY;
+                                        break;
+                                case GLFW_MOD_SHIFT:
+                                        movements = Camera::CameraMovements::TRACK;
+                                        break;
+                                default:
+                                        movements= Camera::CameraMovements::TUMBLE;
+                                        break;
+                        }
+                        mCamera.mouseDown(Point2(x, y), movements);
+                }
+                else
+                {
+                        mDragging = false;
+                        mCamera.mouseUp();
+                }
+        }
+}
+
+void ClothScene::mouseMoveEvent(double x, double y)
+{
+        USING_ATLAS_MATH_NS;
+        if(mDragging) mCamera.mouseDrag(Point2(x, y));
+}
+
+void ClothScene::scrollEvent(double x, double y)
+{
+        USING_ATLAS_MATH_NS;
+        mCamera.mouseScroll(Point2(x, y));
+}
+
+void ClothScene::keyPressEvent(int key, int scancode, int action, int modes)
+{
+        if(action == GLFW_PRESS)
+        {
+                if(key == GLFW_KEY_SPACE) mPaused = !mPaused;
+                else if(key == GLFW_KEY_R) buildCloth();
+                else if(key == GLFW_KEY_W)
+                {
+                        mWindy = !mWindy;
+                        mBreeze->setVelocity(0.f, 0.f, mWindy ? 3.f : 0.f);
+                        mGusts->setAmplitude(mWindy ? 1.5f : 0.f);
+                }
+                else if(key == GLFW_KEY_C)
+                {
+                        mColliding = !mColliding;
+                        std::shared_ptr<CollisionWorld> colliders = mColliding ? mColliders : nullptr;
+                        mCloth->coarse().setColliders(colliders);
+                        mCloth->fine().setColliders(colliders);
+                }
+        }
+}
+
+void ClothScene::updateScene(double time)
+{
+        const float substep = 1.f / 600.f;
+
+        USING_ATLAS_MATH_NS;
+        const Point eye = mCamera.getEyePosition();
+        mCloth->updateRefinement(eye.x, eye.y, eye.z);
+
+        if(!mPaused)
+        {
+                mTime.deltaTime = static_cast<float>(time) - mTime.currentTime;
+                mTime.totalTime += static_cast<float>(time);
+                mTime.currentTime = static_cast<float>(time);
+
+                mAccumulator = std::min(mAccumulator + mTime.deltaTime, 0.1f);
+                while(mAccumulator >= substep)
+                {
+                        // The colliders keep moving while switched off, so
+                        // they never jump when switched on
+                        moveColliders(substep);
+                        mCloth->step(substep);
+                        mCoarseWind->advance(substep);
+                        mFineWind->advance(substep);
+                        mAccumulator -= substep;
+                }
+                checkEnergy();
+                mCloth->interpolateCoarseTiles();
+                mMesh.updatePositions(mCloth->particles());
+                if(mColliding) uploadOutlines();
+        }
+        else
+        {
+                mTime.currentTime = static_cast<float>(time);
+        }
+}
+
+void ClothScene::checkEnergy()
+{
+        USING_ATLAS_CORE_NS;
+        Observables const& observed = mCloth->coarse().observables();
+        if(observed.steps == 0) return;
+        if(!mGuardArmed)
+        {
+                mGuard.reset(observed.energy(), mGuardScale);
+                mGuardArmed = true;
+        }
+        else if(mGuard.diverged(observed.energy()))
+        {
+                Log::log(Log::SeverityLevel::ERROR, "The cloth has blown up, pausing (R rebuilds it)");
+                mPaused = true;
+                mGuardArmed = false;
+        }
+}
+
+void ClothScene::renderScene()
+{
+        const float grey = 0.631;
+        glClearColor(grey, grey, grey, 1.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        mView = mCamera.getCameraMatrix();
+        mMesh.renderGeometry(mProjection, mView);
+        if(mColliding) mOutlines.renderGeometry(mProjection, mView);
         mGrid.renderGeometry(mProjection, mView);
 }
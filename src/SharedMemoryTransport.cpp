@@ -0,0 +1,275 @@
+#include "SharedMemoryTransport.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory rings need lock free 64 bit atomics");
+
+namespace
+{
+        const std::uint32_t kMagic = 0x4f4c4148;        // "HALO"
+        const size_t kLine = 64;
+
+        // Idle passes between liveness checks
+        const unsigned int kCheckEvery = 256;
+
+        size_t roundUp(size_t bytes)
+        {
+                return (bytes + kLine - 1) / kLine * kLine;
+        }
+}
+
+// Placed at the start of the segment. The barrier counts the ranks that
+// have arrived; the last one resets it and bumps the generation the others
+// are waiting on. Any rank may raise the abort flag.
+struct SharedMemoryTransport::Header
+{
+        std::uint32_t magic;
+        std::uint32_t size;
+        std::uint64_t capacity;
+        alignas(64) std::atomic<std::uint32_t> arrived;
+        alignas(64) std::atomic<std::uint32_t> generation;
+        alignas(64) std::atomic<std::uint32_t> aborted;
+};
+
+// Followed by capacity bytes of data. The positions only ever grow and
+// are taken modulo the capacity; the reader and the writer each own one
+// and keep it on a cache line of its own.
+struct SharedMemoryTransport::Ring
+{
+        alignas(64) std::atomic<std::uint64_t> head;    // Read position
+        alignas(64) std::atomic<std::uint64_t> tail;    // Write position
+};
+
+SharedMemoryTransport::SharedMemoryTransport() :
+        mBase(nullptr),
+        mBytes(0),
+        mHeader(nullptr),
+        mRank(0),
+        mSize(0),
+        mCapacity(0),
+        mStride(0),
+        mBytesSent(0),
+        mIdle(0)
+{ }
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+        if(mBase) munmap(mBase, mBytes);
+}
+
+bool SharedMemoryTransport::map(int fd, size_t bytes)
+{
+        void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(base == MAP_FAILED) return false;
+        mBase = static_cast<unsigned char*>(base);
+        mBytes = bytes;
+        mHeader = reinterpret_cast<Header*>(mBase);
+        return true;
+}
+
+bool SharedMemoryTransport::create(std::string const& name, int size, size_t capacity)
+{
+        if(mBase || size < 1 || capacity == 0) return false;
+
+        mCapacity = roundUp(capacity);
+        mStride = sizeof(Ring) + mCapacity;
+        const size_t bytes = roundUp(sizeof(Header)) + mStride * size * size;
+
+        const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if(fd < 0) return false;
+        const bool mapped = ftruncate(fd, static_cast<off_t>(bytes)) == 0 && map(fd, bytes);
+        // The mapping keeps the segment, the descriptor is done with
+        close(fd);
+        if(!mapped)
+        {
+                shm_unlink(name.c_str());
+                return false;
+        }
+        mName = name;
+
+        // The segment comes zero filled, the atomics are constructed in it
+        new (mHeader) Header();
+        mHeader->magic = kMagic;
+        mHeader->size = static_cast<std::uint32_t>(size);
+        mHeader->capacity = mCapacity;
+        mHeader->arrived.store(0);
+        mHeader->generation.store(0);
+        mHeader->aborted.store(0);
+        mSize = size;
+        for(int from = 0; from < size; ++from)
+        {
+                for(int to = 0; to < size; ++to)
+                {
+                        Ring* r = new (&ring(from, to)) Ring();
+                        r->head.store(0);
+                        r->tail.store(0);
+                }
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        mRank = 0;
+        return true;
+}
+
+bool SharedMemoryTransport::attach(std::string const& name, int rank)
+{
+        if(mBase) return false;
+
+        const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if(fd < 0) return false;
+        struct stat info;
+        const bool mapped = fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(Header) &&
+                map(fd, static_cast<size_t>(info.st_size));
+        close(fd);
+        if(!mapped) return false;
+
+        mSize = static_cast<int>(mHeader->size);
+        mCapacity = static_cast<size_t>(mHeader->capacity);
+        mStride = sizeof(Ring) + mCapacity;
+        if(mHeader->magic != kMagic || rank < 0 || rank >= mSize ||
+                        roundUp(sizeof(Header)) + mStride * mSize * mSize > mBytes)
+        {
+                munmap(mBase, mBytes);
+                mBase = nullptr;
+                mHeader = nullptr;
+                return false;
+        }
+        mName = name;
+        mRank = rank;
+        return true;
+}
+
+void SharedMemoryTransport::unlink()
+{
+        if(!mName.empty()) shm_unlink(mName.c_str());
+        mName.clear();
+}
+
+SharedMemoryTransport::Ring& SharedMemoryTransport::ring(int from, int to) const
+{
+        const size_t index = static_cast<size_t>(from) * mSize + to;
+        return *reinterpret_cast<Ring*>(mBase + roundUp(sizeof(Header)) + mStride * index);
+}
+
+unsigned char* SharedMemoryTransport::ringData(Ring& r) const
+{
+        return reinterpret_cast<unsigned char*>(&r) + sizeof(Ring);
+}
+
+void SharedMemoryTransport::exchange(std::vector<Buffer> const& sends,
+                std::vector<Buffer> const& receives)
+{
+        // Bytes moved so far of every message. Each pass moves what fits
+        // into, or is waiting in, every ring, so a rank never blocks on one
+        // peer while another peer waits on it.
+        std::vector<size_t> sent(sends.size(), 0), received(receives.size(), 0);
+        std::vector<char> busy(mSize);
+        size_t pending = sends.size() + receives.size();
+        for(Buffer const& b : sends) if(b.count == 0) --pending;
+        for(Buffer const& b : receives) if(b.count == 0) --pending;
+
+        while(pending > 0)
+        {
+                bool progress = false;
+
+                // Messages to one peer go out in order
+                std::fill(busy.begin(), busy.end(), 0);
+                for(size_t m = 0; m < sends.size(); ++m)
+                {
+                        Buffer const& message = sends[m];
+                        const size_t bytes = message.count * sizeof(float);
+                        if(sent[m] == bytes || busy[message.peer]) continue;
+                        busy[message.peer] = 1;
+
+                        Ring& r = ring(mRank, message.peer);
+                        const std::uint64_t tail = r.tail.load(std::memory_order_relaxed);
+                        const std::uint64_t head = r.head.load(std::memory_order_acquire);
+                        const size_t room = mCapacity - static_cast<size_t>(tail - head);
+                        const size_t start = static_cast<size_t>(tail % mCapacity);
+                        const size_t count = std::min(std::min(room, bytes - sent[m]), mCapacity - start);
+                        if(count == 0) continue;
+
+                        std::memcpy(ringData(r) + start,
+                                        reinterpret_cast<unsigned char const*>(message.data) + sent[m], count);
+                        r.tail.store(tail + count, std::memory_order_release);
+                        sent[m] += count;
+                        mBytesSent += count;
+                        progress = true;
+                        if(sent[m] == bytes) --pending;
+                }
+
+                std::fill(busy.begin(), busy.end(), 0);
+                for(size_t m = 0; m < receives.size(); ++m)
+                {
+                        Buffer const& message = receives[m];
+                        const size_t bytes = message.count * sizeof(float);
+                        if(received[m] == bytes || busy[message.peer]) continue;
+                        busy[message.peer] = 1;
+
+                        Ring& r = ring(message.peer, mRank);
+                        const std::uint64_t head = r.head.load(std::memory_order_relaxed);
+                        const std::uint64_t tail = r.tail.load(std::memory_order_acquire);
+                        const size_t start = static_cast<size_t>(head % mCapacity);
+                        const size_t count = std::min(std::min(static_cast<size_t>(tail - head),
+                                                        bytes - received[m]), mCapacity - start);
+                        if(count == 0) continue;
+
+                        std::memcpy(reinterpret_cast<unsigned char*>(message.data) + received[m],
+                                        ringData(r) + start, count);
+                        r.head.store(head + count, std::memory_order_release);
+                        received[m] += count;
+                        progress = true;
+                        if(received[m] == bytes) --pending;
+                }
+
+                if(!progress)
+                {
+                        if(!keepWaiting()) return;
+                        std::this_thread::yield();
+                }
+        }
+}
+
+void SharedMemoryTransport::barrier()
+{
+        const std::uint32_t generation = mHeader->generation.load(std::memory_order_acquire);
+        if(mHeader->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == static_cast<std::uint32_t>(mSize))
+        {
+                mHeader->arrived.store(0, std::memory_order_relaxed);
+                mHeader->generation.store(generation + 1, std::memory_order_release);
+                return;
+        }
+        while(mHeader->generation.load(std::memory_order_acquire) == generation)
+        {
+                if(!keepWaiting()) return;
+                std::this_thread::yield();
+        }
+}
+
+void SharedMemoryTransport::abort()
+{
+        if(mHeader) mHeader->aborted.store(1, std::memory_order_release);
+}
+
+bool SharedMemoryTransport::aborted() const
+{
+        return mHeader && mHeader->aborted.load(std::memory_order_acquire) != 0;
+}
+
+bool SharedMemoryTransport::keepWaiting()
+{
+        if(aborted()) return false;
+        if(!mAlive || ++mIdle < kCheckEvery) return true;
+        mIdle = 0;
+        if(mAlive()) return true;
+        abort();
+        return false;
+}
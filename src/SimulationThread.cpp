@@ -0,0 +1,121 @@
+#include "SimulationThread.hpp"
+
+#include <chrono>
+
+namespace
+{
+        // When the thread falls further behind than this many steps (the
+        // process was suspended, say) it drops the backlog instead of
+        // racing to catch up
+        const int kMaxCatchUp = 50;
+}
+
+SimulationThread::SimulationThread(StepFunction step, PublishFunction publish, double rate) :
+        mStep(step),
+        mPublish(publish),
+        mRate(rate),
+        mCarry(0.0),
+        mRunning(false),
+        mPaused(false),
+        mSteps(0),
+        mRequested(0)
+{ }
+
+SimulationThread::~SimulationThread()
+{
+        stop();
+}
+
+void SimulationThread::start()
+{
+        if(mThread.joinable()) return;
+        mRunning.store(true);
+        mThread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop()
+{
+        mRunning.store(false);
+        if(mThread.joinable()) mThread.join();
+}
+
+bool SimulationThread::post(CommandQueue::Command command)
+{
+        return mCommands.push(std::move(command));
+}
+
+bool SimulationThread::runCommands()
+{
+        return mCommands.drain() > 0;
+}
+
+void SimulationThread::stepOnce(float dt)
+{
+        if(!mObserver)
+        {
+                mStep(dt);
+                ++mSteps;
+                return;
+        }
+
+        typedef std::chrono::steady_clock Clock;
+        const Clock::time_point start = Clock::now();
+        mStep(dt);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        mObserver(++mSteps, seconds);
+}
+
+bool SimulationThread::runRequested(float dt)
+{
+        if(mRequested.load(std::memory_order_relaxed) == 0) return false;
+        for(unsigned int n = mRequested.exchange(0); n > 0; --n) stepOnce(dt);
+        return true;
+}
+
+void SimulationThread::advance(double seconds)
+{
+        const float dt = static_cast<float>(1.0 / mRate);
+        bool changed = runCommands();
+        changed = runRequested(dt) || changed;
+        if(!mPaused.load())
+        {
+                mCarry += seconds * mRate;
+                for(; mCarry >= 1.0; mCarry -= 1.0)
+                {
+                        stepOnce(dt);
+                        changed = true;
+                }
+        }
+        if(changed) mPublish();
+}
+
+void SimulationThread::run()
+{
+        typedef std::chrono::steady_clock Clock;
+        const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(1.0 / mRate));
+        const float dt = static_cast<float>(1.0 / mRate);
+
+        Clock::time_point next = Clock::now();
+        while(mRunning.load())
+        {
+                bool changed = runCommands();
+                changed = runRequested(dt) || changed;
+
+                if(!mPaused.load())
+                {
+                        const Clock::time_point now = Clock::now();
+                        if(now - next > kMaxCatchUp * period) next = now;
+                        while(next <= now)
+                        {
+                                stepOnce(dt);
+                                next += period;
+                                changed = true;
+                        }
+                }
+                else next = Clock::now() + period;
+
+                if(changed) mPublish();
+                std::this_thread::sleep_until(next);
+        }
+}
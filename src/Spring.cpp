@@ -1,10 +1,22 @@
 #include "Spring.hpp"
+#include "Collision.hpp"
 #include <atlas/core/Float.hpp>
 
 // Debug
 #include <atlas/core/Log.hpp>
 #include <string>
 
+namespace
+{
+        // Kinetic energy below which a spring counts as still, and how many
+        // still steps it takes to fall asleep (two seconds at 1 kHz)
+        const float kSleepEnergy = 1e-6f;
+        const int kSleepSteps = 2000;
+
+        // Used by Spring::simulate
+        const float kGravity = 9.087f;
+}
+
 // Linear Spring Implementation
 
 Spring::Spring() :
@@ -15,7 +27,9 @@ Spring::Spring() :
         mLength(4.f),
         mDampen(0.15f),
         mK(4.f),
-        mPaused(false)
+        mPaused(false),
+        mAsleep(false),
+        mStillSteps(0)
 {
         USING_ATLAS_GL_NS;
         USING_ATLAS_CORE_NS;
@@ -63,9 +77,16 @@ Spring::~Spring()
 
 void Spring::updateGeometry(atlas::utils::Time const& t)
 {
-        if(mPaused) return;
+        if(mPaused || mAsleep) return;
+        simulate(t.deltaTime);
+        uploadPoints(mPoints);
+}
+
+void Spring::simulate(float dt)
+{
+        if(mAsleep) return;
         USING_ATLAS_MATH_NS;
-        const Vector g = Vector(0, -9.087, 0);
+        const Vector g = Vector(0, -kGravity, 0);
 
         Vector F = Vector(0.f);
         Vector s = Vector(0.f);
@@ -76,23 +97,55 @@ void Spring::updateGeometry(atlas::utils::Time const& t)
         float x = glm::length(d);
         F += mK * (mLength - x) * glm::normalize(d);
 
+        // Potential energy and strain from the force pass
+        const float stretch = x - mLength;
+        mObservables.potential = 0.5f * mK * stretch * stretch + mMass[1] * kGravity * mPoints[1].y;
+        mObservables.strain = std::fabs(stretch) / mLength;
+
         Vector a = F / mMass[1];
 
-        s = mVelocity[1] * t.deltaTime + 0.5f * a * t.deltaTime * t.deltaTime;
-        mVelocity[1] = mVelocity[1] + a * t.deltaTime;
+        s = mVelocity[1] * dt + 0.5f * a * dt * dt;
+        mVelocity[1] = mVelocity[1] + a * dt;
+        const Vector start = mPoints[1];
         mPoints[1] = mPoints[1] + s;
 
-        USING_ATLAS_CORE_NS;
+        if(mColliders)
+        {
+                Vec3 end(mPoints[1].x, mPoints[1].y, mPoints[1].z);
+                Vec3 velocity(mVelocity[1].x, mVelocity[1].y, mVelocity[1].z);
+                if(mColliders->collide(Vec3(start.x, start.y, start.z), end, velocity, dt))
+                {
+                        mPoints[1] = Vector(end.x, end.y, end.z);
+                        mVelocity[1] = Vector(velocity.x, velocity.y, velocity.z);
+                }
+        }
 
-        // Upload point data to the GPU
+        // The rest from the integration, angular momentum about the anchor
+        const Vector p = mMass[1] * mVelocity[1];
+        const Vector l = glm::cross(mPoints[1] - mPoints[0], p);
+        const float energy = 0.5f * glm::dot(p, mVelocity[1]);
+        mObservables.kinetic = energy;
+        mObservables.momentum = {{p.x, p.y, p.z}};
+        mObservables.angularMomentum = {{l.x, l.y, l.z}};
+        mObservables.finishStep();
+        mSeries.record(mObservables);
+
+        if(energy < kSleepEnergy && ++mStillSteps >= kSleepSteps)
+        {
+                mVelocity[1] = Vector(0.f);
+                mAsleep = true;
+        }
+        else if(energy >= kSleepEnergy) mStillSteps = 0;
+}
+
+void Spring::uploadPoints(SpringPoints const& points)
+{
+        USING_ATLAS_MATH_NS;
         glBindVertexArray(mVao);
         glBindBuffer(GL_ARRAY_BUFFER, mVbo);
-
-        // Only need to update the one point
         glBufferSubData(GL_ARRAY_BUFFER,
-                        sizeof(Vector),
-                        sizeof(Vector),
-                        &mPoints[1][0]);
+                        0, sizeof(Vector) * 2,
+                        &points[0][0]);
         glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
@@ -115,34 +168,54 @@ void Spring::renderGeometry(
 }
 
 void Spring::resetGeometry()
+{
+        reset();
+        uploadPoints(mPoints);
+}
+
+void Spring::reset()
 {
         USING_ATLAS_MATH_NS;
         mPoints = {Vector(0, 10, 0), Vector(0, -1, 0)};
         mVelocity = {Vector(0.f), Vector(0.f)};
         mForce = {Vector(0.f), Vector(0.f)};
         mLength = 1.f;
-
-        // Upload reset vertex data
-        glBindVertexArray(mVao);
-        glBindBuffer(GL_ARRAY_BUFFER, mVbo);
-        glBufferSubData(GL_ARRAY_BUFFER,
-                        0, sizeof(Vector) * 2,
-                        &mPoints[0][0]);
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        mObservables.reset();
+        mSeries.clear();
+        wake();
 }
 
 void Spring::moveFixed(atlas::math::Vector vec)
 {
-        USING_ATLAS_MATH_NS;
         mPoints[0] += vec;
+        wake();
+}
 
-        glBindVertexArray(mVao);
-        glBindBuffer(GL_ARRAY_BUFFER, mVbo);
-        glBufferSubData(GL_ARRAY_BUFFER,
-                0, sizeof(Vector), &mPoints[0][0]);
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+bool Spring::setParameter(std::string const& name, float value)
+{
+        if(name == "k") mK = value;
+        else if(name == "damping") mDampen = value;
+        else if(name == "mass" && value > 0.f) mMass[1] = value;
+        else if(name == "length" && value > 0.f) mLength = value;
+        else return false;
+        wake();
+        return true;
+}
+
+void Spring::parameters(std::vector<Parameter>& out) const
+{
+        out.push_back(Parameter("k", mK));
+        out.push_back(Parameter("damping", mDampen));
+        out.push_back(Parameter("mass", mMass[1]));
+        out.push_back(Parameter("length", mLength));
+}
+
+double Spring::energy() const
+{
+        const float stretch = glm::length(mPoints[1] - mPoints[0]) - mLength;
+        return 0.5 * mMass[1] * glm::dot(mVelocity[1], mVelocity[1]) +
+                0.5 * mK * stretch * stretch +
+                mMass[1] * kGravity * mPoints[1].y;
 }
 
 
@@ -150,6 +223,8 @@ void Spring::moveFixed(atlas::math::Vector vec)
 
 AngularSpring::AngularSpring() :
         mPaused(false),
+        mAsleep(false),
+        mStillSteps(0),
         mLength(5.1f),
         mDampen(0.01f),
         mK(0.1f),
@@ -212,11 +287,14 @@ AngularSpring::~AngularSpring()
         glDeleteBuffers(1, &mVbo);
 }
 
-void AngularSpring::stepGeometry(atlas::utils::Time const& t)
+void AngularSpring::simulate(float dt)
 {
+        if(mAsleep) return;
         USING_ATLAS_CORE_NS;
         glm::vec2 x = glm::vec2(mPosition.x - mRest.x, mPosition.y - mRest.y);
         glm::vec2 F = glm::vec2(-mK * x) - glm::vec2(mDampen * mVelocity);
+        mObservables.potential = 0.5f * mK * glm::dot(x, x);
+        mObservables.strain = glm::length(x);
 
 #ifdef PROG_DEBUG
         Log::log(Log::SeverityLevel::DEBUG, "Force: (" +
@@ -236,7 +314,7 @@ void AngularSpring::stepGeometry(atlas::utils::Time const& t)
                         std::to_string(a.y) + ")");
 #endif
 
-        glm::vec2 v = mVelocity + a * 0.5f;
+        glm::vec2 v = mVelocity + a * dt;
 
 #ifdef PROG_DEBUG
         Log::log(Log::SeverityLevel::DEBUG, "Velocity: (" +
@@ -245,7 +323,7 @@ void AngularSpring::stepGeometry(atlas::utils::Time const& t)
                         std::to_string(v.y) + ")");
 #endif
 
-        glm::vec2 p = mPosition + v * 0.5f;
+        glm::vec2 p = mPosition + v * dt;
 
 #ifdef PROG_DEBUG
         Log::log(Log::SeverityLevel::DEBUG, "Position: (" +
@@ -257,11 +335,30 @@ void AngularSpring::stepGeometry(atlas::utils::Time const& t)
         mVelocity = v;
         mPosition = p;
 
-        const std::array<glm::vec3, 2> points {
+        // Sleep once the rod has settled on its rest angle
+        const float energy = 0.5f * mMass * glm::dot(mVelocity, mVelocity);
+        mObservables.kinetic = energy;
+        mObservables.angularMomentum = {{mMass * v.x, mMass * v.y, 0.0}};
+        mObservables.finishStep();
+        mSeries.record(mObservables);
+        if(energy < kSleepEnergy && ++mStillSteps >= kSleepSteps)
+        {
+                mVelocity = glm::vec2(0.f);
+                mAsleep = true;
+        }
+        else if(energy >= kSleepEnergy) mStillSteps = 0;
+}
+
+SpringPoints AngularSpring::points() const
+{
+        return SpringPoints {{
                 glm::vec3(0, mRest),
                 glm::vec3(mLength, mPosition)
-        };
+        }};
+}
 
+void AngularSpring::uploadPoints(SpringPoints const& points)
+{
         glBindVertexArray(mVao);
         glBindBuffer(GL_ARRAY_BUFFER, mVbo);
         glBufferSubData(GL_ARRAY_BUFFER,
@@ -269,15 +366,15 @@ void AngularSpring::stepGeometry(atlas::utils::Time const& t)
                         sizeof(glm::vec3) * 2,
                         points.data());
 
-        glBindBuffer(GL_ARRAY_BUFFER, mVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
-
 }
 
 void AngularSpring::updateGeometry(atlas::utils::Time const& t)
 {
-        if(mPaused) return;
-        stepGeometry(t);
+        if(mPaused || mAsleep) return;
+        simulate(t.deltaTime);
+        uploadPoints(points());
 }
 
 void AngularSpring::changeRest(glm::vec3 d)
@@ -298,6 +395,7 @@ void AngularSpring::changeRest(glm::vec3 d)
         // y is the theta
         // z is the phi
         mRest = mRest + glm::vec2(glm::radians(d.y), glm::radians(d.z));
+        wake();
 
 }
 
@@ -317,24 +415,46 @@ void AngularSpring::renderGeometry(atlas::math::Matrix4 proj,
 }
 
 void AngularSpring::resetGeometry()
+{
+        reset();
+        uploadPoints(points());
+}
+
+void AngularSpring::reset()
 {
         mVelocity = glm::vec2(0.f);
         mPosition = glm::vec2(0.f, glm::radians(45.f));
+        mObservables.reset();
+        mSeries.clear();
+        wake();
+}
 
-        const std::array<glm::vec3, 2> points
-        {
-                glm::vec3(0.f),
-                glm::vec3(mLength, mPosition)
-        };
-
+bool AngularSpring::setParameter(std::string const& name, float value)
+{
+        if(name == "k") mK = value;
+        else if(name == "damping") mDampen = value;
+        else if(name == "mass" && value >= 0.f) mMass = value;
+        else if(name == "length" && value > 0.f) mLength = value;
+        else if(name == "theta") mRest.x = glm::radians(value);
+        else if(name == "phi") mRest.y = glm::radians(value);
+        else return false;
+        wake();
+        return true;
+}
 
-        // Upload reset vertex data
-        glBindVertexArray(mVao);
-        glBindBuffer(GL_ARRAY_BUFFER, mVbo);
-        glBufferSubData(GL_ARRAY_BUFFER,
-                        0, sizeof(glm::vec3) * 2,
-                        points.data());
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+void AngularSpring::parameters(std::vector<Parameter>& out) const
+{
+        out.push_back(Parameter("k", mK));
+        out.push_back(Parameter("damping", mDampen));
+        out.push_back(Parameter("mass", mMass));
+        out.push_back(Parameter("length", mLength));
+        out.push_back(Parameter("theta", glm::degrees(mRest.x)));
+        out.push_back(Parameter("phi", glm::degrees(mRest.y)));
+}
 
+double AngularSpring::energy() const
+{
+        // The same angular quantities simulate() integrates
+        const glm::vec2 x = mPosition - mRest;
+        return 0.5 * mMass * glm::dot(mVelocity, mVelocity) + 0.5 * mK * glm::dot(x, x);
 }
@@ -0,0 +1,146 @@
+#include "SpringMesh.hpp"
+
+#include <atlas/gl/Shader.hpp>
+
+#include <algorithm>
+
+SpringMesh::SpringMesh() :
+        mIndexCount(0),
+        mIndexCapacity(0),
+        mVertexCapacity(0)
+{
+        USING_ATLAS_GL_NS;
+        USING_ATLAS_MATH_NS;
+
+        mModel = Matrix4(1.f);
+        glGenVertexArrays(1, &mVao);
+        glBindVertexArray(mVao);
+        glGenBuffers(1, &mVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, mVbo);
+        glGenBuffers(1, &mEbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
+
+        const std::string shader_dir = generated::ShaderPaths::getShaderDirectory();
+        std::vector<ShaderInfo> shaders
+        {
+                { GL_VERTEX_SHADER, shader_dir + "grid.vs.glsl"},
+                { GL_FRAGMENT_SHADER, shader_dir + "grid.fs.glsl"}
+        };
+
+        mShaders.push_back(ShaderPointer(new Shader));
+        mShaders[0]->compileShaders(shaders);
+        mShaders[0]->linkShaders();
+
+        GLuint varID;
+        varID = mShaders[0]->getUniformVariable("MVP");
+        mUniforms.insert(UniformKey("MVP", varID));
+        varID = mShaders[0]->getUniformVariable("color");
+        mUniforms.insert(UniformKey("color", varID));
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(0);
+
+        glBindVertexArray(0);
+        mShaders[0]->disableShaders();
+}
+
+SpringMesh::~SpringMesh()
+{
+        glDeleteVertexArrays(1, &mVao);
+        glDeleteBuffers(1, &mVbo);
+        glDeleteBuffers(1, &mEbo);
+}
+
+void SpringMesh::setEdges(std::vector<unsigned int> const& edges)
+{
+        mIndices = edges;
+        mIndexCount = edges.size();
+        mIndexCapacity = edges.size();
+        glBindVertexArray(mVao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * edges.size(),
+                        edges.data(), GL_DYNAMIC_DRAW);
+        glBindVertexArray(0);
+}
+
+void SpringMesh::updateEdges(size_t offset, unsigned int const* edges, size_t count)
+{
+        if(offset + count > mIndices.size()) mIndices.resize(offset + count);
+        std::copy(edges, edges + count, mIndices.begin() + offset);
+
+        glBindVertexArray(mVao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
+        if(mIndices.size() > mIndexCapacity)
+        {
+                // Grow geometrically so repeated insertions stay cheap
+                mIndexCapacity = std::max(mIndices.size(), 2 * mIndexCapacity);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * mIndexCapacity,
+                                nullptr, GL_DYNAMIC_DRAW);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0,
+                                sizeof(unsigned int) * mIndices.size(), mIndices.data());
+        }
+        else
+        {
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * offset,
+                                sizeof(unsigned int) * count, edges);
+        }
+        glBindVertexArray(0);
+}
+
+void SpringMesh::setEdgeCount(size_t count)
+{
+        mIndexCount = std::min(count, mIndices.size());
+}
+
+void SpringMesh::updatePositions(ParticleSet const& p)
+{
+        // Interleave the structure of arrays into xyz vertices
+        mVertices.resize(3 * p.size());
+        for(size_t i = 0; i < p.size(); ++i)
+        {
+                mVertices[3 * i]     = p.x[i];
+                mVertices[3 * i + 1] = p.y[i];
+                mVertices[3 * i + 2] = p.z[i];
+        }
+        uploadPositions();
+}
+
+void SpringMesh::updatePositions(std::vector<float> const& positions)
+{
+        mVertices = positions;
+        uploadPositions();
+}
+
+void SpringMesh::uploadPositions()
+{
+        const size_t count = mVertices.size() / 3;
+        glBindBuffer(GL_ARRAY_BUFFER, mVbo);
+        if(count > mVertexCapacity)
+        {
+                mVertexCapacity = count;
+                glBufferData(GL_ARRAY_BUFFER, sizeof(float) * mVertices.size(),
+                                mVertices.data(), GL_DYNAMIC_DRAW);
+        }
+        else
+        {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * mVertices.size(),
+                                mVertices.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SpringMesh::renderGeometry(atlas::math::Matrix4 proj,
+                atlas::math::Matrix4 view)
+{
+        USING_ATLAS_MATH_NS;
+        if(mIndexCount == 0) return;
+        mShaders[0]->enableShaders();
+        glBindVertexArray(mVao);
+        Matrix4 mvp = proj * view * mModel;
+        glUniformMatrix4fv(mUniforms["MVP"], 1, GL_FALSE, &mvp[0][0]);
+        GLfloat color[] = {0.1, 0.4, 0.7};
+        glUniform3fv(mUniforms["color"], 1, color);
+        glDrawElements(GL_LINES, static_cast<GLsizei>(mIndexCount), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        mShaders[0]->disableShaders();
+}
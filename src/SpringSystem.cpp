@@ -0,0 +1,508 @@
+#include "SpringSystem.hpp"
+#include "Collision.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Particle Set
+
+template <typename Real, typename Accum>
+size_t BasicParticleSet<Real, Accum>::add(Accum px, Accum py, Accum pz, Real mass)
+{
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+        vx.push_back(Real(0));
+        vy.push_back(Real(0));
+        vz.push_back(Real(0));
+        fx.push_back(Accum(0));
+        fy.push_back(Accum(0));
+        fz.push_back(Accum(0));
+        invMass.push_back(mass > Real(0) ? Real(1) / mass : Real(0));
+        return x.size() - 1;
+}
+
+template <typename Real, typename Accum>
+void BasicParticleSet<Real, Accum>::setMass(size_t i, Real mass)
+{
+        invMass[i] = mass > Real(0) ? Real(1) / mass : Real(0);
+}
+
+template <typename Real, typename Accum>
+void BasicParticleSet<Real, Accum>::clearForces()
+{
+        std::fill(fx.begin(), fx.end(), Accum(0));
+        std::fill(fy.begin(), fy.end(), Accum(0));
+        std::fill(fz.begin(), fz.end(), Accum(0));
+}
+
+// Spring Set
+
+template <typename Real, typename Accum>
+size_t BasicSpringSet<Real, Accum>::add(unsigned int i, unsigned int j, Real r, Real stiffness, Real d)
+{
+        a.push_back(i);
+        b.push_back(j);
+        rest.push_back(r);
+        k.push_back(stiffness);
+        damping.push_back(d);
+        return a.size() - 1;
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSet<Real, Accum>::resize(size_t n)
+{
+        a.resize(n);
+        b.resize(n);
+        rest.resize(n);
+        k.resize(n);
+        damping.resize(n);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSet<Real, Accum>::addForces(Particles& p)
+{
+        addForces(p, 0, size());
+}
+
+namespace
+{
+        // Force on the a end of spring s and its stretch, false for
+        // springs of no length. Evaluated in Accum, only the result of the
+        // square root and the parameters come from Real.
+        template <typename Real, typename Accum>
+        inline bool springVector(BasicSpringSet<Real, Accum> const& springs,
+                        BasicParticleSet<Real, Accum> const& p, size_t s,
+                        Accum& fx, Accum& fy, Accum& fz, Accum& stretch)
+        {
+                const unsigned int i = springs.a[s];
+                const unsigned int j = springs.b[s];
+
+                const Accum dx = p.x[j] - p.x[i];
+                const Accum dy = p.y[j] - p.y[i];
+                const Accum dz = p.z[j] - p.z[i];
+                const Accum length = std::sqrt(dx * dx + dy * dy + dz * dz);
+                if(length <= Accum(0)) return false;
+
+                const Accum nx = dx / length;
+                const Accum ny = dy / length;
+                const Accum nz = dz / length;
+
+                // Damping only acts along the spring so it does not slow
+                // down rigid rotation
+                const Accum dv = (Accum(p.vx[j]) - p.vx[i]) * nx +
+                        (Accum(p.vy[j]) - p.vy[i]) * ny +
+                        (Accum(p.vz[j]) - p.vz[i]) * nz;
+                stretch = length - springs.rest[s];
+                const Accum f = Accum(springs.k[s]) * stretch + Accum(springs.damping[s]) * dv;
+
+                fx = f * nx;
+                fy = f * ny;
+                fz = f * nz;
+                return true;
+        }
+
+        // The potential and strain are only written when observing
+        template <bool Observe, typename Real, typename Accum>
+        inline void springForce(BasicSpringSet<Real, Accum> const& springs,
+                        BasicParticleSet<Real, Accum>& p, size_t s,
+                        double& potential, double& strain)
+        {
+                Accum fx, fy, fz, stretch;
+                if(!springVector(springs, p, s, fx, fy, fz, stretch)) return;
+                if(Observe)
+                {
+                        potential += 0.5 * springs.k[s] * static_cast<double>(stretch) * stretch;
+                        if(springs.rest[s] > Real(0))
+                                strain = std::fmax(strain, std::fabs(static_cast<double>(stretch)) / springs.rest[s]);
+                }
+
+                const unsigned int i = springs.a[s];
+                const unsigned int j = springs.b[s];
+                p.fx[i] += fx;
+                p.fy[i] += fy;
+                p.fz[i] += fz;
+                p.fx[j] -= fx;
+                p.fy[j] -= fy;
+                p.fz[j] -= fz;
+        }
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSet<Real, Accum>::addForces(Particles& p, size_t begin, size_t end)
+{
+        double unused = 0.0;
+        for(size_t s = begin; s < end; ++s) springForce<false>(*this, p, s, unused, unused);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSet<Real, Accum>::addForces(Particles& p, std::vector<unsigned int> const& springs)
+{
+        double unused = 0.0;
+        for(unsigned int s : springs) springForce<false>(*this, p, s, unused, unused);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSet<Real, Accum>::addForces(Particles& p, size_t begin, size_t end,
+                Observables& observables)
+{
+        // Summed in locals, which cannot alias the particle arrays
+        double potential = 0.0;
+        double strain = observables.strain;
+        for(size_t s = begin; s < end; ++s) springForce<true>(*this, p, s, potential, strain);
+        observables.potential += potential;
+        observables.strain = strain;
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSet<Real, Accum>::addForces(Particles& p, std::vector<unsigned int> const& springs,
+                Observables& observables)
+{
+        double potential = 0.0;
+        double strain = observables.strain;
+        for(unsigned int s : springs) springForce<true>(*this, p, s, potential, strain);
+        observables.potential += potential;
+        observables.strain = strain;
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSet<Real, Accum>::springForces(Particles const& p, size_t begin, size_t end,
+                Accum* fx, Accum* fy, Accum* fz) const
+{
+        for(size_t s = begin; s < end; ++s)
+        {
+                Accum stretch;
+                if(springVector(*this, p, s, fx[s], fy[s], fz[s], stretch)) continue;
+                fx[s] = fy[s] = fz[s] = Accum(0);
+        }
+}
+
+// Spring System
+
+template <typename Real, typename Accum>
+BasicSpringSystem<Real, Accum>::BasicSpringSystem() :
+        mGravity({{Real(0), Real(-9.81), Real(0)}}),
+        mDamping(Real(0)),
+        mTopologyVersion(0),
+        mLayoutVersion(0),
+        mObserving(false)
+{ }
+
+template <typename Real, typename Accum>
+size_t BasicSpringSystem<Real, Accum>::addParticle(Accum x, Accum y, Accum z, Real mass)
+{
+        return mParticles.add(x, y, z, mass);
+}
+
+template <typename Real, typename Accum>
+size_t BasicSpringSystem<Real, Accum>::addSpring(size_t i, size_t j, Real k, Real damping)
+{
+        const Accum dx = mParticles.x[j] - mParticles.x[i];
+        const Accum dy = mParticles.y[j] - mParticles.y[i];
+        const Accum dz = mParticles.z[j] - mParticles.z[i];
+        return mSprings.add(static_cast<unsigned int>(i), static_cast<unsigned int>(j),
+                        static_cast<Real>(std::sqrt(dx * dx + dy * dy + dz * dz)), k, damping);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::addForceModel(std::shared_ptr<Model> model)
+{
+        mModels.push_back(model);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::moveParticle(size_t i, Accum dx, Accum dy, Accum dz)
+{
+        mParticles.x[i] += dx;
+        mParticles.y[i] += dy;
+        mParticles.z[i] += dz;
+        touch(i);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::setRestLength(size_t s, Real rest)
+{
+        mSprings.rest[s] = rest;
+        touch(mSprings.a[s]);
+        touch(mSprings.b[s]);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::setStiffness(size_t s, Real k)
+{
+        mSprings.k[s] = k;
+        touch(mSprings.a[s]);
+        touch(mSprings.b[s]);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::takeTouched(std::vector<unsigned int>& touched)
+{
+        touched.clear();
+        touched.swap(mTouched);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::springInserted(size_t s)
+{
+        SpringEdit edit = { static_cast<unsigned int>(s), mSprings.a[s], mSprings.b[s], true };
+        mSpringEdits.push_back(edit);
+        ++mTopologyVersion;
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::springRemoved(size_t s)
+{
+        SpringEdit edit = { static_cast<unsigned int>(s), mSprings.a[s], mSprings.b[s], false };
+        mSpringEdits.push_back(edit);
+        ++mTopologyVersion;
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::takeSpringEdits(std::vector<SpringEdit>& edits)
+{
+        edits.clear();
+        edits.swap(mSpringEdits);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::topologyChanged()
+{
+        ++mTopologyVersion;
+        ++mLayoutVersion;
+        mSpringEdits.clear();
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::computeForces()
+{
+        mParticles.clearForces();
+        if(mObserving) mSprings.addForces(mParticles, 0, mSprings.size(), mObservables);
+        else mSprings.addForces(mParticles);
+        for(auto& model : mModels) model->addForces(mParticles);
+}
+
+namespace
+{
+        // What the integrator measures, summed over the particles it moves
+        struct StepSums
+        {
+                StepSums() :
+                        kinetic(0.0), potential(0.0),
+                        px(0.0), py(0.0), pz(0.0),
+                        lx(0.0), ly(0.0), lz(0.0)
+                { }
+
+                void addTo(Observables& observables) const
+                {
+                        observables.kinetic += kinetic;
+                        observables.potential += potential;
+                        observables.momentum[0] += px;
+                        observables.momentum[1] += py;
+                        observables.momentum[2] += pz;
+                        observables.angularMomentum[0] += lx;
+                        observables.angularMomentum[1] += ly;
+                        observables.angularMomentum[2] += lz;
+                }
+
+                double kinetic, potential;
+                double px, py, pz;
+                double lx, ly, lz;
+        };
+
+        template <typename Real, typename Accum>
+        struct Integrator
+        {
+                Integrator(BasicParticleSet<Real, Accum>& particles,
+                                std::array<Real, 3> const& g, Real drag, Real dt) :
+                        p(particles), gx(g[0]), gy(g[1]), gz(g[2]), drag(drag), dt(dt)
+                { }
+
+                inline void operator()(size_t i) const { advance<false>(i, nullptr); }
+                inline void operator()(size_t i, StepSums& sums) const { advance<true>(i, &sums); }
+
+                template <bool Observe>
+                inline void advance(size_t i, StepSums* sums) const
+                {
+                        const Accum w = p.invMass[i];
+                        // Fixed particles have no inverse mass and receive
+                        // neither gravity nor spring forces
+                        const Accum g = w > Accum(0) ? Accum(1) : Accum(0);
+
+                        const Accum vx = p.vx[i] + dt * (w * (p.fx[i] - drag * p.vx[i]) + g * gx);
+                        const Accum vy = p.vy[i] + dt * (w * (p.fy[i] - drag * p.vy[i]) + g * gy);
+                        const Accum vz = p.vz[i] + dt * (w * (p.fz[i] - drag * p.vz[i]) + g * gz);
+
+                        if(Observe && w > Accum(0))
+                        {
+                                // Gravity's potential before the move, the
+                                // momenta after the kick
+                                const double m = 1.0 / w;
+                                const double x = p.x[i], y = p.y[i], z = p.z[i];
+                                const double mx = m * vx, my = m * vy, mz = m * vz;
+                                sums->potential -= m * (gx * x + gy * y + gz * z);
+                                sums->kinetic += 0.5 * (mx * vx + my * vy + mz * vz);
+                                sums->px += mx;
+                                sums->py += my;
+                                sums->pz += mz;
+                                sums->lx += y * mz - z * my;
+                                sums->ly += z * mx - x * mz;
+                                sums->lz += x * my - y * mx;
+                        }
+
+                        // Positions advance with the unrounded velocity
+                        p.x[i] += dt * vx;
+                        p.y[i] += dt * vy;
+                        p.z[i] += dt * vz;
+
+                        p.vx[i] = static_cast<Real>(vx);
+                        p.vy[i] = static_cast<Real>(vy);
+                        p.vz[i] = static_cast<Real>(vz);
+                }
+
+                BasicParticleSet<Real, Accum>& p;
+                const Accum gx, gy, gz;
+                const Accum drag;
+                const Accum dt;
+        };
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::integrate(Real dt, size_t begin, size_t end)
+{
+        const Integrator<Real, Accum> integrator(mParticles, mGravity, mDamping, dt);
+        if(mObserving)
+        {
+                StepSums sums;
+                for(size_t i = begin; i < end; ++i) integrator(i, sums);
+                sums.addTo(mObservables);
+        }
+        else for(size_t i = begin; i < end; ++i) integrator(i);
+        if(mColliders) mColliders->collide(mParticles, static_cast<float>(dt), begin, end);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::integrate(Real dt, std::vector<unsigned int> const& particles)
+{
+        const Integrator<Real, Accum> integrator(mParticles, mGravity, mDamping, dt);
+        if(mObserving)
+        {
+                StepSums sums;
+                for(unsigned int i : particles) integrator(i, sums);
+                sums.addTo(mObservables);
+        }
+        else for(unsigned int i : particles) integrator(i);
+        if(mColliders) mColliders->collide(mParticles, static_cast<float>(dt), particles);
+}
+
+template <typename Real, typename Accum>
+void BasicSpringSystem<Real, Accum>::step(Real dt)
+{
+        if(mObserving) mObservables.beginStep();
+        computeForces();
+        integrate(dt, 0, mParticles.size());
+        if(mObserving) mObservables.finishStep();
+        // Everything was stepped, nobody needs to be woken and there is
+        // nothing to follow
+        mTouched.clear();
+        mSpringEdits.clear();
+}
+
+template <typename Real, typename Accum>
+double BasicSpringSystem<Real, Accum>::kineticEnergy() const
+{
+        double energy = 0.0;
+        Particles const& p = mParticles;
+        for(size_t i = 0; i < p.size(); ++i)
+        {
+                if(p.invMass[i] <= Real(0)) continue;
+                const double vx = p.vx[i];
+                const double vy = p.vy[i];
+                const double vz = p.vz[i];
+                energy += 0.5 * (vx * vx + vy * vy + vz * vz) / p.invMass[i];
+        }
+        return energy;
+}
+
+template <typename Real, typename Accum>
+double BasicSpringSystem<Real, Accum>::potentialEnergy() const
+{
+        double energy = 0.0;
+        Particles const& p = mParticles;
+        for(size_t s = 0; s < mSprings.size(); ++s)
+        {
+                const unsigned int i = mSprings.a[s];
+                const unsigned int j = mSprings.b[s];
+                const double dx = static_cast<double>(p.x[j]) - p.x[i];
+                const double dy = static_cast<double>(p.y[j]) - p.y[i];
+                const double dz = static_cast<double>(p.z[j]) - p.z[i];
+                const double stretch = std::sqrt(dx * dx + dy * dy + dz * dz) - mSprings.rest[s];
+                energy += 0.5 * mSprings.k[s] * stretch * stretch;
+        }
+
+        // Gravity does work on free particles only
+        for(size_t i = 0; i < p.size(); ++i)
+        {
+                if(p.invMass[i] <= Real(0)) continue;
+                const double mass = 1.0 / p.invMass[i];
+                energy -= mass * (mGravity[0] * static_cast<double>(p.x[i]) +
+                                mGravity[1] * static_cast<double>(p.y[i]) +
+                                mGravity[2] * static_cast<double>(p.z[i]));
+        }
+        return energy;
+}
+
+template <typename Real, typename Accum>
+std::array<double, 3> BasicSpringSystem<Real, Accum>::momentum() const
+{
+        std::array<double, 3> total = {{0.0, 0.0, 0.0}};
+        Particles const& p = mParticles;
+        for(size_t i = 0; i < p.size(); ++i)
+        {
+                if(p.invMass[i] <= Real(0)) continue;
+                const double mass = 1.0 / p.invMass[i];
+                total[0] += mass * p.vx[i];
+                total[1] += mass * p.vy[i];
+                total[2] += mass * p.vz[i];
+        }
+        return total;
+}
+
+// The three precision modes, see SpringSystem.hpp
+
+template struct BasicParticleSet<float>;
+template struct BasicSpringSet<float>;
+template class BasicSpringSystem<float>;
+
+template struct BasicParticleSet<double>;
+template struct BasicSpringSet<double>;
+template class BasicSpringSystem<double>;
+
+template struct BasicParticleSet<float, double>;
+template struct BasicSpringSet<float, double>;
+template class BasicSpringSystem<float, double>;
+
+// Cloth
+
+void buildCloth(SpringSystem& system, int n)
+{
+        const float height = clothHeight(n);
+        auto index = [n](int i, int j) { return static_cast<size_t>(i + n * j); };
+        for(int j = 0; j < n; ++j)
+                for(int i = 0; i < n; ++i)
+                        system.addParticle(i * kClothSpacing, height, j * kClothSpacing, j == 0 ? 0.f : kClothMass);
+
+        for(int j = 0; j < n; ++j)
+        {
+                for(int i = 0; i < n; ++i)
+                {
+                        if(i + 1 < n) system.addSpring(index(i, j), index(i + 1, j), kClothStiffness, kClothDamping);
+                        if(j + 1 < n) system.addSpring(index(i, j), index(i, j + 1), kClothStiffness, kClothDamping);
+                        if(i + 1 < n && j + 1 < n)
+                        {
+                                system.addSpring(index(i, j), index(i + 1, j + 1), kClothStiffness, kClothDamping);
+                                system.addSpring(index(i + 1, j), index(i, j + 1), kClothStiffness, kClothDamping);
+                        }
+                }
+        }
+}
@@ -0,0 +1,347 @@
+#include "Sweep.hpp"
+#include "Observables.hpp"
+#include "StaticSpringSystem.hpp"
+
+#include <atlas/core/Log.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+        struct SweepResult
+        {
+                float k;
+                float damping;
+                float tipX, tipY, tipZ;
+                float maxStretch;       // Largest pin to tip distance over the chain length
+                float maxStrain;        // Largest strain of any one spring
+                float energy;           // At the last step run
+                int steps;              // Fewer than asked if the chain diverged
+                bool diverged;
+        };
+
+        // The generic engine is only timed on a sample of the sweep, it
+        // would otherwise dominate the run
+        const long kCompareSystems = 100000;
+
+        void parameters(SweepOptions const& options, long index, float& k, float& damping)
+        {
+                const long side = std::max(1L, static_cast<long>(std::ceil(
+                                                std::sqrt(static_cast<double>(options.systems)))));
+                const float u = side > 1 ? static_cast<float>(index % side) / (side - 1) : 0.f;
+                const float v = side > 1 ? static_cast<float>(index / side) / (side - 1) : 0.f;
+                k = options.kMin + u * (options.kMax - options.kMin);
+                damping = options.dampingMin + v * (options.dampingMax - options.dampingMin);
+        }
+
+        // Chains stepped together by the static kernel
+        const size_t kLanes = 8;
+
+        // Steps between measurements of the energy and strain. A diverging
+        // chain grows by orders of magnitude in that time, so it is caught
+        // just as well, for a fraction of the cost.
+        const int kObserveEvery = 8;
+
+        template <size_t Links>
+        void runStatic(SweepOptions const& options, long begin, long end, SweepResult* results)
+        {
+                // The batch stays in L1 for every step of the run
+                StaticSpringBatch<Links + 1, Links, kLanes> batch;
+                for(long first = begin; first < end; first += kLanes)
+                {
+                        const long count = std::min<long>(kLanes, end - first);
+                        // Spare lanes repeat the last chain, which is thrown away
+                        for(size_t l = 0; l < kLanes; ++l)
+                        {
+                                const long index = first + std::min<long>(l, count - 1);
+                                float k, damping;
+                                parameters(options, index, k, damping);
+                                batch.load(l, makeChain<Links>(1.f, options.mass, k, damping));
+                        }
+
+                        std::array<float, kLanes> stretch, strain, energy;
+                        std::array<EnergyGuard, kLanes> guards;
+                        std::array<bool, kLanes> diverged;
+                        stretch.fill(1.f);
+                        strain.fill(0.f);
+                        guards.fill(EnergyGuard(options.abort));
+                        diverged.fill(false);
+
+                        auto record = [&](long l, int steps)
+                        {
+                                SweepResult& result = results[first + l - begin];
+                                parameters(options, first + l, result.k, result.damping);
+                                result.tipX = batch.x[Links][l];
+                                result.tipY = batch.y[Links][l];
+                                result.tipZ = batch.z[Links][l];
+                                result.maxStretch = std::sqrt(stretch[l]);
+                                result.maxStrain = strain[l];
+                                result.energy = energy[l];
+                                result.steps = steps;
+                                result.diverged = diverged[l];
+                        };
+
+                        // A chain is recorded as it diverges, and the batch
+                        // stops once all of its chains have
+                        typename StaticSpringBatch<Links + 1, Links, kLanes>::LaneObservables observed;
+                        long running = count;
+                        for(int step = 0; step < options.steps && running > 0; ++step)
+                        {
+                                const bool observe = step % kObserveEvery == 0 ||
+                                        step + 1 == options.steps;
+                                if(observe) batch.step(options.dt, observed);
+                                else batch.step(options.dt);
+                                for(size_t l = 0; l < kLanes; ++l)
+                                {
+                                        const float dx = batch.x[Links][l] - batch.x[0][l];
+                                        const float dy = batch.y[Links][l] - batch.y[0][l];
+                                        const float dz = batch.z[Links][l] - batch.z[0][l];
+                                        stretch[l] = std::max(stretch[l], dx * dx + dy * dy + dz * dz);
+                                }
+                                if(!observe) continue;
+                                for(size_t l = 0; l < kLanes; ++l)
+                                {
+                                        strain[l] = std::max(strain[l], observed.strain[l]);
+                                        energy[l] = observed.kinetic[l] + observed.potential[l];
+                                }
+
+                                if(!guards[0].enabled()) continue;
+                                // The energy a chain has to give is that of
+                                // falling its own length
+                                if(step == 0)
+                                {
+                                        for(size_t l = 0; l < kLanes; ++l)
+                                                guards[l].reset(energy[l], options.mass * Links * 9.81f);
+                                }
+                                for(long l = 0; l < count; ++l)
+                                {
+                                        if(diverged[l] || !guards[l].diverged(energy[l])) continue;
+                                        diverged[l] = true;
+                                        record(l, step + 1);
+                                        --running;
+                                }
+                        }
+
+                        for(long l = 0; l < count; ++l)
+                                if(!diverged[l]) record(l, options.steps);
+                }
+        }
+
+        template <size_t Links>
+        void runGeneric(SweepOptions const& options, long begin, long end, SweepResult* results)
+        {
+                for(long index = begin; index < end; ++index)
+                {
+                        SweepResult& result = results[index - begin];
+                        parameters(options, index, result.k, result.damping);
+
+                        SpringSystem system;
+                        makeChain<Links>(1.f, options.mass, result.k, result.damping).copyTo(system);
+                        ParticleSet const& p = system.particles();
+                        float stretch = 1.f;
+                        for(int step = 0; step < options.steps; ++step)
+                        {
+                                system.step(options.dt);
+                                const float dx = p.x[Links] - p.x[0];
+                                const float dy = p.y[Links] - p.y[0];
+                                const float dz = p.z[Links] - p.z[0];
+                                stretch = std::max(stretch, dx * dx + dy * dy + dz * dz);
+                        }
+                        result.tipX = p.x[Links];
+                        result.tipY = p.y[Links];
+                        result.tipZ = p.z[Links];
+                        result.maxStretch = std::sqrt(stretch);
+                        // Only compared on the tips, so not measured per step
+                        result.maxStrain = 0.f;
+                        result.energy = static_cast<float>(system.energy());
+                        result.steps = options.steps;
+                        result.diverged = false;
+                }
+        }
+
+        typedef void (*SweepKernel)(SweepOptions const&, long, long, SweepResult*);
+
+        // Systems are independent, so each thread takes a contiguous block
+        // and the results do not depend on the thread count
+        double runAll(SweepOptions const& options, SweepKernel kernel, long count,
+                        std::vector<SweepResult>& results)
+        {
+                results.resize(count);
+                unsigned int threads = options.threads > 0 ?
+                        static_cast<unsigned int>(options.threads) :
+                        std::max(1u, std::thread::hardware_concurrency());
+                threads = static_cast<unsigned int>(std::min<long>(threads, std::max(1L, count)));
+
+                const auto start = std::chrono::steady_clock::now();
+                std::vector<std::thread> workers;
+                for(unsigned int t = 0; t < threads; ++t)
+                {
+                        const long begin = count * t / threads;
+                        const long end = count * (t + 1) / threads;
+                        workers.emplace_back([&options, &results, kernel, begin, end]()
+                        {
+                                kernel(options, begin, end, results.data() + begin);
+                        });
+                }
+                for(auto& worker : workers) worker.join();
+                const auto stop = std::chrono::steady_clock::now();
+                return std::chrono::duration<double>(stop - start).count();
+        }
+
+        bool kernels(int links, SweepKernel& fixed, SweepKernel& generic)
+        {
+                switch(links)
+                {
+                        case 1: fixed = runStatic<1>; generic = runGeneric<1>; return true;
+                        case 2: fixed = runStatic<2>; generic = runGeneric<2>; return true;
+                        case 4: fixed = runStatic<4>; generic = runGeneric<4>; return true;
+                        case 8: fixed = runStatic<8>; generic = runGeneric<8>; return true;
+                        case 16: fixed = runStatic<16>; generic = runGeneric<16>; return true;
+                }
+                return false;
+        }
+
+        void parseRange(const char* arg, float& lo, float& hi)
+        {
+                std::sscanf(arg, "%f:%f", &lo, &hi);
+        }
+}
+
+SweepOptions::SweepOptions() :
+        systems(100000),
+        links(4),
+        steps(1000),
+        dt(1.f / 600.f),
+        kMin(10.f), kMax(1000.f),
+        dampingMin(0.f), dampingMax(1.f),
+        mass(1.f),
+        threads(0),
+        abort(1.f),
+        compare(false)
+{ }
+
+bool parseSweepOptions(int argc, char** argv, SweepOptions& options)
+{
+        bool sweep = false;
+        for(int i = 1; i < argc; ++i)
+        {
+                const std::string arg = argv[i];
+                const bool hasValue = i + 1 < argc;
+                if(arg == "--sweep" && hasValue)
+                {
+                        sweep = true;
+                        options.systems = std::atol(argv[++i]);
+                }
+                else if(arg == "--links" && hasValue)
+                        options.links = std::atoi(argv[++i]);
+                else if(arg == "--steps" && hasValue)
+                        options.steps = std::atoi(argv[++i]);
+                else if(arg == "--dt" && hasValue)
+                        options.dt = static_cast<float>(std::atof(argv[++i]));
+                else if(arg == "--stiffness" && hasValue)
+                        parseRange(argv[++i], options.kMin, options.kMax);
+                else if(arg == "--damping" && hasValue)
+                        parseRange(argv[++i], options.dampingMin, options.dampingMax);
+                else if(arg == "--mass" && hasValue)
+                        options.mass = static_cast<float>(std::atof(argv[++i]));
+                else if(arg == "--threads" && hasValue)
+                        options.threads = std::atoi(argv[++i]);
+                else if(arg == "--csv" && hasValue)
+                        options.output = argv[++i];
+                else if(arg == "--abort" && hasValue)
+                        options.abort = static_cast<float>(std::atof(argv[++i]));
+                else if(arg == "--compare")
+                        options.compare = true;
+        }
+        return sweep;
+}
+
+int runSweep(SweepOptions const& options)
+{
+        USING_ATLAS_CORE_NS;
+
+        SweepKernel fixed = nullptr;
+        SweepKernel generic = nullptr;
+        if(!kernels(options.links, fixed, generic))
+        {
+                Log::log(Log::SeverityLevel::ERROR, "--links must be 1, 2, 4, 8 or 16");
+                return 1;
+        }
+        if(options.systems <= 0 || options.steps <= 0 || options.dt <= 0.f || options.mass <= 0.f)
+        {
+                Log::log(Log::SeverityLevel::ERROR, "Invalid sweep size, step or mass");
+                return 1;
+        }
+
+        std::vector<SweepResult> results;
+        const double seconds = runAll(options, fixed, options.systems, results);
+
+        // Steps actually run, diverged chains stop early
+        double steps = 0.0;
+        long diverged = 0;
+        for(SweepResult const& r : results)
+        {
+                steps += r.steps;
+                diverged += r.diverged ? 1 : 0;
+        }
+        const double rate = steps / seconds;
+        Log::log(Log::SeverityLevel::INFO, "Swept " + std::to_string(options.systems) +
+                        " chains of " + std::to_string(options.links) + " links in " +
+                        std::to_string(seconds) + " s, " + std::to_string(rate) +
+                        " system steps/s");
+        if(diverged > 0)
+        {
+                Log::log(Log::SeverityLevel::INFO, std::to_string(diverged) +
+                                " chains diverged and were stopped early, saving " +
+                                std::to_string(100.0 * (1.0 - steps /
+                                                (static_cast<double>(options.systems) * options.steps))) +
+                                "% of the steps");
+        }
+
+        if(options.compare)
+        {
+                const long count = std::min(options.systems, kCompareSystems);
+                std::vector<SweepResult> reference;
+                const double genericSeconds = runAll(options, generic, count, reference);
+                const double genericRate = static_cast<double>(count) * options.steps / genericSeconds;
+
+                float difference = 0.f;
+                for(long i = 0; i < count; ++i)
+                {
+                        if(results[i].diverged) continue;
+                        difference = std::max(difference, std::fabs(results[i].tipX - reference[i].tipX));
+                        difference = std::max(difference, std::fabs(results[i].tipY - reference[i].tipY));
+                        difference = std::max(difference, std::fabs(results[i].tipZ - reference[i].tipZ));
+                }
+                Log::log(Log::SeverityLevel::INFO, "SpringSystem: " +
+                                std::to_string(genericRate) + " system steps/s, speedup " +
+                                std::to_string(rate / genericRate) + "x, largest tip difference " +
+                                std::to_string(difference));
+        }
+
+        if(!options.output.empty())
+        {
+                std::ofstream out(options.output);
+                if(!out)
+                {
+                        Log::log(Log::SeverityLevel::ERROR, "Could not open " + options.output);
+                        return 1;
+                }
+                out << "k,damping,tip_x,tip_y,tip_z,max_stretch,max_strain,energy,steps,diverged\n";
+                for(SweepResult const& r : results)
+                {
+                        out << r.k << ',' << r.damping << ',' << r.tipX << ',' << r.tipY << ',' <<
+                                r.tipZ << ',' << r.maxStretch << ',' << r.maxStrain << ',' <<
+                                r.energy << ',' << r.steps << ',' << (r.diverged ? 1 : 0) << '\n';
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,399 @@
+#include "TetMesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+        // Inverse of a row major 3x3 matrix, returns the determinant. The
+        // inverse is left at zero for degenerate matrices.
+        template <typename Real>
+        Real invert3(const Real m[9], Real out[9])
+        {
+                const Real c0 = m[4] * m[8] - m[5] * m[7];
+                const Real c1 = m[5] * m[6] - m[3] * m[8];
+                const Real c2 = m[3] * m[7] - m[4] * m[6];
+                const Real det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+                if(std::fabs(det) < Real(1e-12))
+                {
+                        std::fill(out, out + 9, Real(0));
+                        return Real(0);
+                }
+                const Real inv = Real(1) / det;
+                out[0] = c0 * inv;
+                out[1] = (m[2] * m[7] - m[1] * m[8]) * inv;
+                out[2] = (m[1] * m[5] - m[2] * m[4]) * inv;
+                out[3] = c1 * inv;
+                out[4] = (m[0] * m[8] - m[2] * m[6]) * inv;
+                out[5] = (m[2] * m[3] - m[0] * m[5]) * inv;
+                out[6] = c2 * inv;
+                out[7] = (m[1] * m[6] - m[0] * m[7]) * inv;
+                out[8] = (m[0] * m[4] - m[1] * m[3]) * inv;
+                return det;
+        }
+
+        // Number of Newton iterations for the polar decomposition. Explicit
+        // time steps are small, so elements rarely rotate far between steps
+        // and a fixed count converges well while keeping the loop free of
+        // data dependent branches.
+        const int kPolarIterations = 6;
+}
+
+template <typename Real, typename Accum>
+BasicTetMesh<Real, Accum>::BasicTetMesh(Real youngsModulus, Real poissonRatio, Mode mode) :
+        mMu(youngsModulus / (Real(2) * (Real(1) + poissonRatio))),
+        mLambda(youngsModulus * poissonRatio /
+                        ((Real(1) + poissonRatio) * (Real(1) - Real(2) * poissonRatio))),
+        mMode(mode),
+        mV(nullptr)
+{
+        mB.fill(nullptr);
+}
+
+template <typename Real, typename Accum>
+size_t BasicTetMesh<Real, Accum>::addTetrahedron(Particles const& p,
+                unsigned int a, unsigned int b, unsigned int c, unsigned int d)
+{
+        const unsigned int nodes[4] = {a, b, c, d};
+        for(int n = 0; n < 4; ++n) mNodes[n].push_back(nodes[n]);
+
+        // Columns are the edges from the first node
+        Real dm[9];
+        for(int col = 0; col < 3; ++col)
+        {
+                const unsigned int n = nodes[col + 1];
+                dm[col]     = static_cast<Real>(p.x[n] - p.x[a]);
+                dm[3 + col] = static_cast<Real>(p.y[n] - p.y[a]);
+                dm[6 + col] = static_cast<Real>(p.z[n] - p.z[a]);
+        }
+
+        Real inverse[9];
+        const Real det = invert3(dm, inverse);
+        for(int i = 0; i < 9; ++i) mRestInverse[i].push_back(inverse[i]);
+        mVolume.push_back(std::fabs(det) / Real(6));
+
+        return mVolume.size() - 1;
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::appendEdges(std::vector<unsigned int>& edges) const
+{
+        static const int pairs[6][2] = {{0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3}};
+        for(size_t e = 0; e < size(); ++e)
+        {
+                for(auto const& pair : pairs)
+                {
+                        edges.push_back(mNodes[pair[0]][e]);
+                        edges.push_back(mNodes[pair[1]][e]);
+                }
+        }
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::elementParticles(size_t e, std::vector<unsigned int>& out) const
+{
+        out.clear();
+        for(int n = 0; n < 4; ++n) out.push_back(mNodes[n][e]);
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::addForces(Particles& particles)
+{
+        evaluate(particles, nullptr, size());
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::addForces(Particles& particles, std::vector<unsigned int> const&,
+                std::vector<unsigned int> const& elements)
+{
+        evaluate(particles, elements.data(), elements.size());
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::evaluate(Particles& particles, unsigned int const* elements, size_t count)
+{
+        if(count == 0) return;
+        for(int i = 0; i < 9; ++i)
+        {
+                if(mShape[i].size() < count) mShape[i].resize(count);
+                if(mForce[i].size() < count) mForce[i].resize(count);
+        }
+
+        gather(particles, elements, count);
+        if(mMode == Mode::LINEAR) evaluateLinear(count);
+        else evaluateCorotational(count);
+        scatter(particles, elements, count);
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::gather(Particles const& p, unsigned int const* elements, size_t count)
+{
+        if(!elements)
+        {
+                for(int i = 0; i < 9; ++i) mB[i] = mRestInverse[i].data();
+                mV = mVolume.data();
+
+                const unsigned int* n0 = mNodes[0].data();
+                for(int col = 0; col < 3; ++col)
+                {
+                        const unsigned int* n = mNodes[col + 1].data();
+                        Real* sx = mShape[col].data();
+                        Real* sy = mShape[3 + col].data();
+                        Real* sz = mShape[6 + col].data();
+                        for(size_t e = 0; e < count; ++e)
+                        {
+                                sx[e] = static_cast<Real>(p.x[n[e]] - p.x[n0[e]]);
+                                sy[e] = static_cast<Real>(p.y[n[e]] - p.y[n0[e]]);
+                                sz[e] = static_cast<Real>(p.z[n[e]] - p.z[n0[e]]);
+                        }
+                }
+                return;
+        }
+
+        for(int i = 0; i < 9; ++i)
+        {
+                mPackedRest[i].resize(count);
+                for(size_t r = 0; r < count; ++r) mPackedRest[i][r] = mRestInverse[i][elements[r]];
+                mB[i] = mPackedRest[i].data();
+        }
+        mPackedVolume.resize(count);
+        for(size_t r = 0; r < count; ++r) mPackedVolume[r] = mVolume[elements[r]];
+        mV = mPackedVolume.data();
+
+        for(int col = 0; col < 3; ++col)
+        {
+                for(size_t r = 0; r < count; ++r)
+                {
+                        const unsigned int e = elements[r];
+                        const unsigned int n0 = mNodes[0][e];
+                        const unsigned int n = mNodes[col + 1][e];
+                        mShape[col][r] = static_cast<Real>(p.x[n] - p.x[n0]);
+                        mShape[3 + col][r] = static_cast<Real>(p.y[n] - p.y[n0]);
+                        mShape[6 + col][r] = static_cast<Real>(p.z[n] - p.z[n0]);
+                }
+        }
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::evaluateLinear(size_t count)
+{
+        const Real mu2 = Real(2) * mMu;
+        const Real lambda = mLambda;
+
+        for(size_t e = 0; e < count; ++e)
+        {
+                Real B[9], F[9];
+                for(int i = 0; i < 9; ++i) B[i] = mB[i][e];
+
+                // F = Ds * Dm^-1
+                for(int r = 0; r < 3; ++r)
+                        for(int c = 0; c < 3; ++c)
+                                F[3 * r + c] =
+                                        mShape[3 * r][e]     * B[c] +
+                                        mShape[3 * r + 1][e] * B[3 + c] +
+                                        mShape[3 * r + 2][e] * B[6 + c];
+
+                // Small strain: sym(F) - I
+                Real P[9];
+                const Real trace = F[0] + F[4] + F[8] - Real(3);
+                for(int r = 0; r < 3; ++r)
+                        for(int c = 0; c < 3; ++c)
+                                P[3 * r + c] = mu2 * (Real(0.5) * (F[3 * r + c] + F[3 * c + r]) -
+                                                (r == c ? Real(1) : Real(0))) +
+                                        (r == c ? lambda * trace : Real(0));
+
+                // H = -V * P * Dm^-T, column i is the force on node i + 1
+                const Real V = mV[e];
+                for(int r = 0; r < 3; ++r)
+                        for(int c = 0; c < 3; ++c)
+                                mForce[3 * r + c][e] = -V * (
+                                                P[3 * r]     * B[3 * c] +
+                                                P[3 * r + 1] * B[3 * c + 1] +
+                                                P[3 * r + 2] * B[3 * c + 2]);
+        }
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::evaluateCorotational(size_t count)
+{
+        const Real mu2 = Real(2) * mMu;
+        const Real lambda = mLambda;
+
+        for(size_t e = 0; e < count; ++e)
+        {
+                Real B[9], F[9];
+                for(int i = 0; i < 9; ++i) B[i] = mB[i][e];
+
+                for(int r = 0; r < 3; ++r)
+                        for(int c = 0; c < 3; ++c)
+                                F[3 * r + c] =
+                                        mShape[3 * r][e]     * B[c] +
+                                        mShape[3 * r + 1][e] * B[3 + c] +
+                                        mShape[3 * r + 2][e] * B[6 + c];
+
+                // Rotation from the polar decomposition F = RS, through the
+                // Newton iteration R <- (R + R^-T) / 2
+                Real R[9];
+                for(int i = 0; i < 9; ++i) R[i] = F[i];
+                for(int it = 0; it < kPolarIterations; ++it)
+                {
+                        const Real c0 = R[4] * R[8] - R[5] * R[7];
+                        const Real c1 = R[5] * R[6] - R[3] * R[8];
+                        const Real c2 = R[3] * R[7] - R[4] * R[6];
+                        Real det = R[0] * c0 + R[1] * c1 + R[2] * c2;
+                        // Keep collapsed elements from dividing by zero
+                        det = std::copysign(std::max(std::fabs(det), Real(1e-6)), det);
+                        const Real inv = Real(0.5) / det;
+
+                        // Cofactor matrix divided by det is R^-T
+                        const Real cof[9] = {
+                                c0, c1, c2,
+                                R[2] * R[7] - R[1] * R[8],
+                                R[0] * R[8] - R[2] * R[6],
+                                R[1] * R[6] - R[0] * R[7],
+                                R[1] * R[5] - R[2] * R[4],
+                                R[2] * R[3] - R[0] * R[5],
+                                R[0] * R[4] - R[1] * R[3]
+                        };
+                        for(int i = 0; i < 9; ++i) R[i] = Real(0.5) * R[i] + inv * cof[i];
+                }
+
+                // Strain measured in the unrotated frame: sym(R^T F) - I
+                Real S[9];
+                for(int r = 0; r < 3; ++r)
+                        for(int c = 0; c < 3; ++c)
+                                S[3 * r + c] =
+                                        R[r]     * F[c] +
+                                        R[3 + r] * F[3 + c] +
+                                        R[6 + r] * F[6 + c];
+
+                Real stress[9];
+                const Real trace = S[0] + S[4] + S[8] - Real(3);
+                for(int r = 0; r < 3; ++r)
+                        for(int c = 0; c < 3; ++c)
+                                stress[3 * r + c] = mu2 * (Real(0.5) * (S[3 * r + c] + S[3 * c + r]) -
+                                                (r == c ? Real(1) : Real(0))) +
+                                        (r == c ? lambda * trace : Real(0));
+
+                // Rotate back: P = R * stress
+                Real P[9];
+                for(int r = 0; r < 3; ++r)
+                        for(int c = 0; c < 3; ++c)
+                                P[3 * r + c] =
+                                        R[3 * r]     * stress[c] +
+                                        R[3 * r + 1] * stress[3 + c] +
+                                        R[3 * r + 2] * stress[6 + c];
+
+                const Real V = mV[e];
+                for(int r = 0; r < 3; ++r)
+                        for(int c = 0; c < 3; ++c)
+                                mForce[3 * r + c][e] = -V * (
+                                                P[3 * r]     * B[3 * c] +
+                                                P[3 * r + 1] * B[3 * c + 1] +
+                                                P[3 * r + 2] * B[3 * c + 2]);
+        }
+}
+
+template <typename Real, typename Accum>
+void BasicTetMesh<Real, Accum>::scatter(Particles& p, unsigned int const* elements, size_t count)
+{
+        for(size_t r = 0; r < count; ++r)
+        {
+                const size_t e = elements ? elements[r] : r;
+                Real sx = Real(0), sy = Real(0), sz = Real(0);
+                for(int col = 0; col < 3; ++col)
+                {
+                        const unsigned int n = mNodes[col + 1][e];
+                        const Real fx = mForce[col][r];
+                        const Real fy = mForce[3 + col][r];
+                        const Real fz = mForce[6 + col][r];
+                        p.fx[n] += fx;
+                        p.fy[n] += fy;
+                        p.fz[n] += fz;
+                        sx += fx;
+                        sy += fy;
+                        sz += fz;
+                }
+                const unsigned int n0 = mNodes[0][e];
+                p.fx[n0] -= sx;
+                p.fy[n0] -= sy;
+                p.fz[n0] -= sz;
+        }
+}
+
+template <typename Real, typename Accum>
+size_t addTetBox(BasicSpringSystem<Real, Accum>& system, BasicTetMesh<Real, Accum>& mesh,
+                typename BasicParticleSet<Real, Accum>::AccumType originX,
+                typename BasicParticleSet<Real, Accum>::AccumType originY,
+                typename BasicParticleSet<Real, Accum>::AccumType originZ,
+                size_t nx, size_t ny, size_t nz,
+                typename BasicParticleSet<Real, Accum>::AccumType spacing,
+                typename BasicParticleSet<Real, Accum>::RealType density)
+{
+        BasicParticleSet<Real, Accum>& p = system.particles();
+        const size_t first = p.size();
+        const size_t px = nx + 1;
+        const size_t py = ny + 1;
+        const size_t pz = nz + 1;
+
+        for(size_t k = 0; k < pz; ++k)
+                for(size_t j = 0; j < py; ++j)
+                        for(size_t i = 0; i < px; ++i)
+                                system.addParticle(originX + i * spacing,
+                                                originY + j * spacing,
+                                                originZ + k * spacing, Real(0));
+
+        auto index = [=](size_t i, size_t j, size_t k)
+        {
+                return static_cast<unsigned int>(first + i + px * (j + py * k));
+        };
+
+        // Two mirrored splits alternate so that neighbouring cubes share
+        // their face diagonals
+        static const int even[5][4] = {
+                {0, 1, 2, 4}, {1, 3, 2, 7}, {1, 4, 5, 7}, {2, 4, 7, 6}, {1, 2, 4, 7}
+        };
+        static const int odd[5][4] = {
+                {1, 0, 3, 5}, {2, 0, 3, 6}, {4, 0, 5, 6}, {7, 3, 5, 6}, {0, 3, 5, 6}
+        };
+
+        std::vector<Real> mass(p.size() - first, Real(0));
+        for(size_t k = 0; k < nz; ++k)
+                for(size_t j = 0; j < ny; ++j)
+                        for(size_t i = 0; i < nx; ++i)
+                        {
+                                const unsigned int corner[8] = {
+                                        index(i, j, k),         index(i + 1, j, k),
+                                        index(i, j + 1, k),     index(i + 1, j + 1, k),
+                                        index(i, j, k + 1),     index(i + 1, j, k + 1),
+                                        index(i, j + 1, k + 1), index(i + 1, j + 1, k + 1)
+                                };
+                                const int (*split)[4] = ((i + j + k) % 2 == 0) ? even : odd;
+                                for(int t = 0; t < 5; ++t)
+                                {
+                                        const size_t e = mesh.addTetrahedron(p,
+                                                        corner[split[t][0]], corner[split[t][1]],
+                                                        corner[split[t][2]], corner[split[t][3]]);
+                                        const Real share = Real(0.25) * density * mesh.restVolume(e);
+                                        for(int n = 0; n < 4; ++n)
+                                                mass[corner[split[t][n]] - first] += share;
+                                }
+                        }
+
+        for(size_t i = 0; i < mass.size(); ++i) p.setMass(first + i, mass[i]);
+        return first;
+}
+
+// The three precision modes, see SpringSystem.hpp
+
+template class BasicTetMesh<float>;
+template size_t addTetBox(SpringSystem&, BasicTetMesh<float>&,
+                float, float, float, size_t, size_t, size_t, float, float);
+
+template class BasicTetMesh<double>;
+template size_t addTetBox(SpringSystemDouble&, BasicTetMesh<double>&,
+                double, double, double, size_t, size_t, size_t, double, double);
+
+template class BasicTetMesh<float, double>;
+template size_t addTetBox(SpringSystemMixed&, BasicTetMesh<float, double>&,
+                double, double, double, size_t, size_t, size_t, double, float);
@@ -0,0 +1,187 @@
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+SpringTopology::SpringTopology(SpringSystem& system) :
+        mSystem(system),
+        mDirtyBegin(std::numeric_limits<size_t>::max()),
+        mDirtyEnd(0)
+{
+        SpringSet const& springs = mSystem.springs();
+        const size_t n = springs.size();
+        mAlive.assign(n, 1);
+        mIndices.resize(2 * n);
+        for(size_t s = 0; s < n; ++s) setIndices(s);
+}
+
+void SpringTopology::markDirty(size_t s)
+{
+        mDirtyBegin = std::min(mDirtyBegin, s);
+        mDirtyEnd = std::max(mDirtyEnd, s + 1);
+}
+
+void SpringTopology::setIndices(size_t s)
+{
+        SpringSet const& springs = mSystem.springs();
+        mIndices[2 * s] = springs.a[s];
+        mIndices[2 * s + 1] = springs.b[s];
+        markDirty(s);
+}
+
+bool SpringTopology::takeDirtyRange(size_t& begin, size_t& end)
+{
+        if(mDirtyBegin >= mDirtyEnd) return false;
+        begin = mDirtyBegin;
+        end = std::min(mDirtyEnd, mAlive.size());
+        mDirtyBegin = std::numeric_limits<size_t>::max();
+        mDirtyEnd = 0;
+        return begin < end;
+}
+
+size_t SpringTopology::addSpring(size_t i, size_t j, float k, float damping)
+{
+        SpringSet& springs = mSystem.springs();
+        ParticleSet const& p = mSystem.particles();
+
+        const float dx = p.x[j] - p.x[i];
+        const float dy = p.y[j] - p.y[i];
+        const float dz = p.z[j] - p.z[i];
+        const float rest = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        size_t s;
+        if(!mFree.empty())
+        {
+                s = mFree.back();
+                mFree.pop_back();
+                springs.a[s] = static_cast<unsigned int>(i);
+                springs.b[s] = static_cast<unsigned int>(j);
+                springs.rest[s] = rest;
+                springs.k[s] = k;
+                springs.damping[s] = damping;
+                mAlive[s] = 1;
+        }
+        else
+        {
+                s = springs.add(static_cast<unsigned int>(i), static_cast<unsigned int>(j),
+                                rest, k, damping);
+                mAlive.push_back(1);
+                mIndices.resize(2 * springs.size());
+        }
+
+        setIndices(s);
+        mSystem.touch(i);
+        mSystem.touch(j);
+        mSystem.springInserted(s);
+        return s;
+}
+
+void SpringTopology::removeSpring(size_t s)
+{
+        if(s >= mAlive.size() || !mAlive[s]) return;
+
+        SpringSet& springs = mSystem.springs();
+        mSystem.touch(springs.a[s]);
+        mSystem.touch(springs.b[s]);
+        mSystem.springRemoved(s);
+
+        // A tombstone has zero length and zero stiffness, which the force
+        // loops already skip
+        springs.b[s] = springs.a[s];
+        springs.rest[s] = 0.f;
+        springs.k[s] = 0.f;
+        springs.damping[s] = 0.f;
+        mAlive[s] = 0;
+        mFree.push_back(static_cast<unsigned int>(s));
+
+        setIndices(s);
+}
+
+size_t SpringTopology::tear(float maxStrain, std::vector<unsigned int> const& springs)
+{
+        // The check only reads positions; the edits cost O(torn)
+        SpringSet const& set = mSystem.springs();
+        ParticleSet const& p = mSystem.particles();
+        mRemoved.clear();
+        for(unsigned int s : springs)
+        {
+                if(!mAlive[s] || set.rest[s] <= 0.f) continue;
+                const unsigned int a = set.a[s];
+                const unsigned int b = set.b[s];
+                const float dx = p.x[b] - p.x[a];
+                const float dy = p.y[b] - p.y[a];
+                const float dz = p.z[b] - p.z[a];
+                const float limit = (1.f + maxStrain) * set.rest[s];
+                if(dx * dx + dy * dy + dz * dz > limit * limit) mRemoved.push_back(s);
+        }
+
+        for(unsigned int s : mRemoved) removeSpring(s);
+        if(4 * mFree.size() > mAlive.size()) compact();
+        return mRemoved.size();
+}
+
+size_t SpringTopology::cut(float px, float py, float pz,
+                float nx, float ny, float nz, float radius)
+{
+        SpringSet const& springs = mSystem.springs();
+        ParticleSet const& p = mSystem.particles();
+        mRemoved.clear();
+        for(size_t s = 0; s < springs.size(); ++s)
+        {
+                if(!mAlive[s]) continue;
+                const unsigned int a = springs.a[s];
+                const unsigned int b = springs.b[s];
+                const float da = (p.x[a] - px) * nx + (p.y[a] - py) * ny + (p.z[a] - pz) * nz;
+                const float db = (p.x[b] - px) * nx + (p.y[b] - py) * ny + (p.z[b] - pz) * nz;
+                if(da * db >= 0.f) continue;
+
+                const float t = da / (da - db);
+                const float cx = p.x[a] + t * (p.x[b] - p.x[a]) - px;
+                const float cy = p.y[a] + t * (p.y[b] - p.y[a]) - py;
+                const float cz = p.z[a] + t * (p.z[b] - p.z[a]) - pz;
+                if(cx * cx + cy * cy + cz * cz <= radius * radius)
+                        mRemoved.push_back(static_cast<unsigned int>(s));
+        }
+
+        for(unsigned int s : mRemoved) removeSpring(s);
+        if(4 * mFree.size() > mAlive.size()) compact();
+        return mRemoved.size();
+}
+
+void SpringTopology::moveSlot(size_t from, size_t to)
+{
+        SpringSet& springs = mSystem.springs();
+        springs.a[to] = springs.a[from];
+        springs.b[to] = springs.b[from];
+        springs.rest[to] = springs.rest[from];
+        springs.k[to] = springs.k[from];
+        springs.damping[to] = springs.damping[from];
+        mAlive[to] = 1;
+        mAlive[from] = 0;
+        setIndices(to);
+}
+
+void SpringTopology::compact()
+{
+        if(mFree.empty()) return;
+
+        // Fill the lowest holes with the highest live springs; only the
+        // moved springs and the holes are touched
+        std::sort(mFree.begin(), mFree.end());
+        size_t end = mAlive.size();
+        for(unsigned int hole : mFree)
+        {
+                while(end > 0 && !mAlive[end - 1]) --end;
+                if(hole >= end) break;
+                moveSlot(end - 1, hole);
+                --end;
+        }
+        while(end > 0 && !mAlive[end - 1]) --end;
+        mFree.clear();
+
+        mSystem.springs().resize(end);
+        mAlive.resize(end);
+        mIndices.resize(2 * end);
+        mSystem.topologyChanged();
+}
@@ -0,0 +1,68 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int threads) :
+        mSize(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+        mTask(nullptr),
+        mGeneration(0),
+        mPending(0),
+        mStopping(false)
+{
+        for(unsigned int w = 1; w < mSize; ++w)
+                mThreads.emplace_back(&WorkerPool::work, this, w);
+}
+
+WorkerPool::~WorkerPool()
+{
+        {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopping = true;
+        }
+        mStart.notify_all();
+        for(auto& thread : mThreads) thread.join();
+}
+
+void WorkerPool::run(Task const& task)
+{
+        if(mSize == 1)
+        {
+                task(0);
+                return;
+        }
+
+        {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mTask = &task;
+                mPending = mSize - 1;
+                ++mGeneration;
+        }
+        mStart.notify_all();
+
+        task(0);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [this]() { return mPending == 0; });
+        mTask = nullptr;
+}
+
+void WorkerPool::work(unsigned int worker)
+{
+        unsigned long long seen = 0;
+        for(;;)
+        {
+                Task const* task;
+                {
+                        std::unique_lock<std::mutex> lock(mMutex);
+                        mStart.wait(lock, [this, seen]() { return mStopping || mGeneration != seen; });
+                        if(mStopping) return;
+                        seen = mGeneration;
+                        task = mTask;
+                }
+
+                (*task)(worker);
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                if(--mPending == 0) mDone.notify_one();
+        }
+}
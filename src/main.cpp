@@ -1,13 +1,59 @@
 #include <atlas/utils/Application.hpp>
 
+#include <string>
+
 #include "Scene.hpp"
+#include "Determinism.hpp"
+#include "Drift.hpp"
+#include "Offscreen.hpp"
+#include "OutOfCore.hpp"
+#include "Scaling.hpp"
+#include "Sweep.hpp"
 
-int main()
+int main(int argc, char** argv)
 {
+        // Render to image files instead of a window, e.g. on a display-less
+        // server: Springs --offscreen <dir> [--frames n] [--size WxH]
+        OffscreenOptions options;
+        if(parseOffscreenOptions(argc, argv, options))
+                return renderOffscreen(options);
+
+        // Headless parameter sweep: Springs --sweep <systems> [--links n]
+        SweepOptions sweep;
+        if(parseSweepOptions(argc, argv, sweep))
+                return runSweep(sweep);
+
+        // Precision report: Springs --drift <steps> [--lattice n]
+        DriftOptions drift;
+        if(parseDriftOptions(argc, argv, drift))
+                return runDrift(drift);
+
+        // Reproducibility report: Springs --determinism <steps> [--threads n]
+        DeterminismOptions determinism;
+        if(parseDeterminismOptions(argc, argv, determinism))
+                return runDeterminism(determinism);
+
+        // Out of core benchmark: Springs --outofcore <steps> [--cloth n]
+        OutOfCoreOptions outOfCore;
+        if(parseOutOfCoreOptions(argc, argv, outOfCore))
+                return runOutOfCore(outOfCore);
+
+        // Domain decomposition scaling: Springs --domains <steps> [--processes n]
+        ScalingOptions scaling;
+        if(parseScalingOptions(argc, argv, scaling))
+                return runScaling(scaling);
+
+        // Control sockets for the spring scenes: Springs --control <prefix>
+        // opens <prefix>-linear.sock and <prefix>-angular.sock
+        std::string control;
+        for(int i = 1; i + 1 < argc; ++i)
+                if(std::string(argv[i]) == "--control") control = argv[i + 1];
 
         APPLICATION.createWindow(800, 800, "Springs");
-        APPLICATION.addScene(new LinearScene);
-        APPLICATION.addScene(new AngularScene);
+        APPLICATION.addScene(new LinearScene(true, control.empty() ? "" : control + "-linear.sock"));
+        APPLICATION.addScene(new AngularScene(true, control.empty() ? "" : control + "-angular.sock"));
+        APPLICATION.addScene(new SoftBodyScene);
+        APPLICATION.addScene(new ClothScene);
         APPLICATION.runApplication();
         return 0;
 }